@@ -0,0 +1,624 @@
+/************************************************************************
+     File:        AnalyzeMain.cpp
+
+     Comment:     The RideAnalyzer program - no window, no OpenGL
+
+						Reads track files (the same ones the program
+						saves), runs a train round each one for a number
+						of laps or a length of time at a fixed step (see
+						RideAnalyzer.H) and writes how the ride went: the
+						lap times, the speeds, and the worst g-forces and
+						jerk. Built with HEADLESS, so it runs anywhere
+						there is a C++ compiler, without a display.
+
+						The files are shared out over the cores, and the
+						segments of each file too - a thread that runs out
+						of files helps with the segments of another. The
+						results are written in the order the files were
+						given, as text to read, CSV (a line a file) or
+						JSON, so a sweep over a catalogue of tracks can be
+						compared night to night.
+
+						--bench-trains times TrainManager on a long loop it
+						makes up itself, with thousands of trains at 60
+						steps a second on one thread, to see how much of a
+						frame they take. --bench-read writes a track of
+						as many points as it is told (a million, say) and
+						times reading it back.
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "RideAnalyzer.H"
+#include "ThreadPool.H"
+#include "Track.H"
+#include "TrainManager.H"
+
+// how long the --trains run goes on for, in seconds
+static const int CAPACITY_TIME = 600;
+
+// the --bench-trains loop: at least BENCH_LOOP long, with BENCH_ROOM of it
+// for each train, in blocks of BENCH_BLOCK; it is timed for BENCH_FRAMES
+// steps of 1/60 s
+static const double BENCH_LOOP = 50000;
+static const double BENCH_ROOM = 10;
+static const float BENCH_BLOCK = 5;
+static const int BENCH_FRAMES = 600;
+
+enum Format {
+	FORMAT_TEXT,
+	FORMAT_CSV,
+	FORMAT_JSON
+};
+
+// everything the command line says
+struct Settings {
+	RideAnalyzer::Options	options;
+	bool					rows;
+	int						trains;
+	float					block;
+	Format					format;
+	unsigned int			jobs;
+	int						benchTrains;
+	long					benchRead;
+
+	Settings() : rows(false), trains(0), block(50), format(FORMAT_TEXT), jobs(0),
+				 benchTrains(0), benchRead(0) {}
+};
+
+// what --trains found
+struct Capacity {
+	unsigned int	blocks;
+	double			perHour;
+	float			slowest;
+	int				stopped;
+};
+
+// one track file, and how it went
+struct Job {
+	enum Status {
+		JOB_OK,
+		JOB_UNREADABLE,
+		JOB_NO_TRACK
+	};
+
+	std::string				file;
+	Status					status;
+	const char*				error;		// why it couldn't be read
+	unsigned int			points;
+	RideAnalyzer::Result	result;
+	bool					hasCapacity;
+	Capacity				capacity;
+};
+
+static void usage()
+{
+	printf("usage: RideAnalyzer [options] track...\n"
+		   "  --type n        spline type: 1 linear, 2 cardinal (default), 3 b-spline\n"
+		   "  --laps n        laps to run (default 1)\n"
+		   "  --duration t    run for t seconds instead of a number of laps\n"
+		   "  --dt t          the fixed simulation step, s (default 1/120)\n"
+		   "  --speed v       speed at the start, m/s (default 10)\n"
+		   "  --step d        distance between rows, m (default 1)\n"
+		   "  --carts n       carts in the train (default 6)\n"
+		   "  --spacing d     distance between carts, m (default 2)\n"
+		   "  --friction f    rolling friction (default 0.015)\n"
+		   "  --drag d        air drag per speed squared (default 0.0002)\n"
+		   "  --lift v        chain lift: never slower than this, m/s (default none)\n"
+		   "  --rows          every row, not just the worst (text and json)\n"
+		   "  --trains n      also run n trains at once, kept apart by blocks,\n"
+		   "                  and say how many go round an hour\n"
+		   "  --block d       block length for --trains, m (default 50)\n"
+		   "  --format f      text (default), csv or json\n"
+		   "  --jobs n        threads (default one per core)\n"
+		   "  --bench-trains n\n"
+		   "                  no tracks: time n trains on a made up loop at 60\n"
+		   "                  steps a second, on one thread\n"
+		   "  --bench-read n  no tracks: write an n point track (text and binary)\n"
+		   "                  and time reading it\n");
+}
+
+//****************************************************************************
+//
+// * n trains spread round the track for CAPACITY_TIME seconds: how many
+//   pass the start an hour, and how slow the blocks make them
+//============================================================================
+static void capacity(const std::vector<ControlPoint>& points, const Settings& settings,
+					 Capacity& out)
+//============================================================================
+{
+	const RideAnalyzer::Options& options = settings.options;
+	TrackProfile profile;
+	profile.update(points, options.type);
+	TrainManager manager;
+	TrainManager::Params params;
+	params.physics = options.physics;
+	params.cartSpacing = options.cartSpacing;
+	params.blockLength = settings.block;
+	manager.setTrack(profile, params);
+	manager.spread(settings.trains, options.startSpeed, options.carts, (float)options.carts);
+
+	unsigned long passed = 0;
+	float slowest = options.startSpeed;
+	std::vector<double> before;
+	int frames = (int)(CAPACITY_TIME / options.dt);
+	for (int f = 0; f < frames; ++f) {
+		before = manager.s;
+		manager.step(options.dt);
+		for (size_t i = 0; i < manager.count(); ++i) {
+			passed += manager.s[i] < before[i];
+			slowest = (manager.v[i] < slowest) ? manager.v[i] : slowest;
+		}
+	}
+	out.blocks = (unsigned int)manager.blockCount();
+	out.perHour = passed * 3600.0 / CAPACITY_TIME;
+	out.slowest = slowest;
+	out.stopped = 0;
+	for (float v : manager.v)
+		out.stopped += (v == 0);
+}
+
+//****************************************************************************
+//
+// * n trains of 2 to 5 carts on a big wavy loop, stepped 60 times a
+//   second: how long a step takes, against the 16.7 ms there is for it
+//============================================================================
+static int benchTrains(const Settings& settings, int n)
+//============================================================================
+{
+	const RideAnalyzer::Options& options = settings.options;
+	double loop = (n * BENCH_ROOM > BENCH_LOOP) ? n * BENCH_ROOM : BENCH_LOOP;
+	double radius = loop / (2 * 3.14159265358979);
+	std::vector<ControlPoint> points;
+	const int POINTS = 2000;
+	for (int i = 0; i < POINTS; ++i) {
+		double a = i * 2 * 3.14159265358979 / POINTS;
+		points.push_back(ControlPoint(Pnt3f((float)(radius * cos(a)), (float)(20 + 10 * sin(a * 100)),
+											(float)(radius * sin(a)))));
+	}
+	TrackProfile profile;
+	profile.update(points, options.type);
+
+	// a lift everywhere, or trains stopped at a block would stay there
+	TrainManager::Params params;
+	params.physics = options.physics;
+	if (params.physics.minSpeed <= 0)
+		params.physics.minSpeed = 3;
+	params.cartSpacing = options.cartSpacing;
+	params.blockLength = BENCH_BLOCK;
+	TrainManager manager;
+	manager.setTrack(profile, params);
+	for (int i = 0; i < n; ++i)
+		manager.addTrain(manager.length() * i / n, options.startSpeed, 2 + i % 4, (float)(2 + i % 4));
+
+	// a second to settle, then the timing
+	for (int f = 0; f < 60; ++f)
+		manager.step(1.0 / 60);
+	auto start = std::chrono::steady_clock::now();
+	for (int f = 0; f < BENCH_FRAMES; ++f)
+		manager.step(1.0 / 60);
+	double ms = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count() / BENCH_FRAMES;
+
+	int stopped = 0;
+	for (float v : manager.v)
+		stopped += (v == 0);
+	printf("%d trains on a %.1f km loop, %zu blocks\n", n, manager.length() / 1000,
+		   manager.blockCount());
+	printf("%.3f ms a 1/60 s step (%d substeps): %.1f%% of a frame on one thread, "
+		   "%d stopped at the end\n", ms, (int)ceil(1.0 / 60 / params.physics.subStep),
+		   ms / (1000.0 / 60) * 100, stopped);
+	return 0;
+}
+
+//
+// read fname into track, the best of three, in ms (negative if it can't be)
+//
+static double timeRead(const std::string& fname, CTrack& track)
+{
+	double best = -1;
+	for (int k = 0; k < 3; ++k) {
+		auto start = std::chrono::steady_clock::now();
+		const char* error = 0;
+		if (!track.readPoints(fname.c_str(), &error)) {
+			fprintf(stderr, "%s: %s\n", fname.c_str(), error ? error : "can't read it");
+			return -1;
+		}
+		double ms = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count();
+		best = (best < 0 || ms < best) ? ms : best;
+	}
+	return best;
+}
+
+//****************************************************************************
+//
+// * A made up track of n points - a wandering survey line, with all six
+//   numbers on every line - written out as text and binary, then read
+//   back and timed
+//============================================================================
+static int benchRead(long n)
+//============================================================================
+{
+	CTrack track;
+	track.points.clear();
+	track.points.reserve((size_t)n);
+	for (long i = 0; i < n; ++i) {
+		double a = i * 0.001;
+		Pnt3f pos((float)(i * 0.5 + 40 * sin(a)), (float)(20 + 15 * sin(a * 7)),
+				  (float)(300 * cos(a * 0.3)));
+		Pnt3f orient((float)(0.2 * sin(a * 11)), 1, (float)(0.2 * cos(a * 5)));
+		track.points.push_back(ControlPoint(pos, orient));
+	}
+
+	std::error_code ec;
+	std::filesystem::path dir = std::filesystem::temp_directory_path(ec);
+	std::string base = (dir / "RideAnalyzerBench").string();
+	const char* formats[] = { ".txt", ".trk" };
+	int failed = 0;
+	for (const char* format : formats) {
+		std::string fname = base + format;
+		const char* error = 0;
+		if (!track.writePoints(fname.c_str(), &error)) {
+			fprintf(stderr, "%s: %s\n", fname.c_str(), error ? error : "can't write it");
+			return 1;
+		}
+		CTrack back;
+		double ms = timeRead(fname, back);
+		double mb = std::filesystem::file_size(fname, ec) / 1e6;
+		std::filesystem::remove(fname, ec);
+		if (ms < 0 || back.points.size() != track.points.size()) {
+			printf("%s: read back %zu of %zu points\n", format, back.points.size(),
+				   track.points.size());
+			++failed;
+			continue;
+		}
+		printf("%s: %ld points, %.1f MB, read in %.1f ms (%.0f MB/s, %.1f million points/s)\n",
+			   format, n, mb, ms, mb * 1000 / ms, n / ms / 1000);
+	}
+	return failed ? 1 : 0;
+}
+
+//****************************************************************************
+//
+// * Do one file
+//============================================================================
+static void run(Job& job, const Settings& settings)
+//============================================================================
+{
+	CTrack track;
+	job.hasCapacity = false;
+	job.points = 0;
+	job.error = 0;
+	if (!track.readPoints(job.file.c_str(), &job.error)) {
+		job.status = Job::JOB_UNREADABLE;
+		return;
+	}
+	job.points = (unsigned int)track.points.size();
+
+	RideAnalyzer::analyze(track.points, settings.options, job.result);
+	if (!job.result.ok) {
+		job.status = Job::JOB_NO_TRACK;
+		return;
+	}
+	job.status = Job::JOB_OK;
+	if (settings.trains > 0) {
+		capacity(track.points, settings, job.capacity);
+		job.hasCapacity = true;
+	}
+}
+
+// the shortest, longest and average of the laps (all 0 if there weren't any)
+static void lapStats(const std::vector<double>& laps, double& lo, double& mean, double& hi)
+{
+	lo = mean = hi = 0;
+	for (size_t i = 0; i < laps.size(); ++i) {
+		lo = (i == 0 || laps[i] < lo) ? laps[i] : lo;
+		hi = (laps[i] > hi) ? laps[i] : hi;
+		mean += laps[i];
+	}
+	if (!laps.empty())
+		mean /= laps.size();
+}
+
+static double meanSpeed(const RideAnalyzer::Result& r)
+{
+	return (r.time > 0) ? r.distance / r.time : 0;
+}
+
+static const char* statusName(Job::Status s)
+{
+	switch (s) {
+	case Job::JOB_OK:			return "ok";
+	case Job::JOB_UNREADABLE:	return "unreadable";
+	default:					return "no track";
+	}
+}
+
+// a row of the text table - label goes where the distance would
+static void printRow(const RideAnalyzer::Row& r, const char* label = 0)
+{
+	if (label)
+		printf("%9s", label);
+	else
+		printf("%9.2f", r.s);
+	printf(" %8.2f %8.2f %7.2f %7.2f %6.2f %7.2f %7.2f %8.2f\n",
+		   r.vMin, r.vMax, r.gVertMin, r.gVertMax, r.gLat,
+		   r.gLongMin, r.gLongMax, r.jerk);
+}
+
+//****************************************************************************
+//
+// * Text, to read
+//============================================================================
+static void printText(const Job& job, const Settings& settings)
+//============================================================================
+{
+	const RideAnalyzer::Result& result = job.result;
+	if (job.status == Job::JOB_UNREADABLE) {
+		printf("%s: can't read it (%s)\n", job.file.c_str(), job.error ? job.error : "?");
+		return;
+	}
+	if (job.status != Job::JOB_OK) {
+		printf("%s: no track (is the spline type right?)\n", job.file.c_str());
+		return;
+	}
+
+	printf("%s: %u points, %.1f m, %.1f s, %u laps", job.file.c_str(), job.points,
+		   result.length, result.time, (unsigned int)result.lapTimes.size());
+	if (result.stalled)
+		printf(", STALLED at %.1f m", result.stalledAt);
+	printf("\n");
+	if (!result.lapTimes.empty()) {
+		double lo, mean, hi;
+		lapStats(result.lapTimes, lo, mean, hi);
+		printf("  lap %.2f s (%.2f to %.2f)\n", mean, lo, hi);
+	}
+	printf("  speed %.2f m/s on average (%.2f to %.2f)\n",
+		   meanSpeed(result), result.speedMin, result.speedMax);
+	printf("        s     vMin     vMax gVertMn gVertMx  |gLat| gLongMn gLongMx     jerk\n");
+	if (settings.rows)
+		for (const RideAnalyzer::Row& r : result.rows)
+			printRow(r);
+	if (!result.rows.empty())
+		printRow(result.worst, "worst");
+	if (job.hasCapacity)
+		printf("  %d trains, %u blocks: %.0f trains an hour, slowest %.2f m/s, %d stopped at the end\n",
+			   settings.trains, job.capacity.blocks, job.capacity.perHour,
+			   job.capacity.slowest, job.capacity.stopped);
+}
+
+//****************************************************************************
+//
+// * CSV, a line a file
+//============================================================================
+static void printCsvHeader()
+//============================================================================
+{
+	printf("file,status,points,length,time,distance,stalled,stalled_at,laps,"
+		   "lap_min,lap_mean,lap_max,speed_min,speed_mean,speed_max,"
+		   "g_vert_min,g_vert_max,g_lat_max,g_long_min,g_long_max,jerk_max,"
+		   "trains_per_hour\n");
+}
+
+// in quotes, with any quotes in it doubled
+static void printCsvString(const std::string& s)
+{
+	putchar('"');
+	for (char c : s) {
+		if (c == '"')
+			putchar('"');
+		putchar(c);
+	}
+	putchar('"');
+}
+
+static void printCsv(const Job& job)
+{
+	const RideAnalyzer::Result& r = job.result;
+	printCsvString(job.file);
+	printf(",%s", statusName(job.status));
+	if (job.status != Job::JOB_OK) {
+		printf(",%u,,,,,,,,,,,,,,,,,,,\n", job.points);
+		return;
+	}
+	double lo, mean, hi;
+	lapStats(r.lapTimes, lo, mean, hi);
+	printf(",%u,%.6g,%.6g,%.6g,%d,%.6g,%u,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g",
+		   job.points, r.length, r.time, r.distance, r.stalled ? 1 : 0, r.stalledAt,
+		   (unsigned int)r.lapTimes.size(), lo, mean, hi,
+		   r.speedMin, meanSpeed(r), r.speedMax);
+	const RideAnalyzer::Row& w = r.worst;
+	printf(",%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,",
+		   w.gVertMin, w.gVertMax, w.gLat, w.gLongMin, w.gLongMax, w.jerk);
+	if (job.hasCapacity)
+		printf("%.6g", job.capacity.perHour);
+	printf("\n");
+}
+
+//****************************************************************************
+//
+// * JSON, all the files in one document
+//============================================================================
+static void printJsonString(const std::string& s)
+//============================================================================
+{
+	putchar('"');
+	for (unsigned char c : s) {
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+	putchar('"');
+}
+
+static void printJsonRow(const RideAnalyzer::Row& r, bool withS)
+{
+	printf("{");
+	if (withS)
+		printf("\"s\": %.6g, ", r.s);
+	printf("\"vMin\": %.6g, \"vMax\": %.6g, \"gVertMin\": %.6g, \"gVertMax\": %.6g, "
+		   "\"gLat\": %.6g, \"gLongMin\": %.6g, \"gLongMax\": %.6g, \"jerk\": %.6g}",
+		   r.vMin, r.vMax, r.gVertMin, r.gVertMax, r.gLat, r.gLongMin, r.gLongMax, r.jerk);
+}
+
+static void printJson(const Job& job, const Settings& settings)
+{
+	const RideAnalyzer::Result& r = job.result;
+	printf("    {\"file\": ");
+	printJsonString(job.file);
+	printf(", \"status\": \"%s\"", statusName(job.status));
+	if (job.status != Job::JOB_OK) {
+		printf("}");
+		return;
+	}
+	printf(", \"points\": %u, \"length\": %.6g, \"time\": %.6g, \"distance\": %.6g",
+		   job.points, r.length, r.time, r.distance);
+	printf(", \"stalled\": %s", r.stalled ? "true" : "false");
+	if (r.stalled)
+		printf(", \"stalledAt\": %.6g", r.stalledAt);
+
+	printf(",\n     \"lapTimes\": [");
+	for (size_t i = 0; i < r.lapTimes.size(); ++i)
+		printf("%s%.6g", i ? ", " : "", r.lapTimes[i]);
+	printf("],\n     \"speed\": {\"min\": %.6g, \"mean\": %.6g, \"max\": %.6g}",
+		   r.speedMin, meanSpeed(r), r.speedMax);
+	if (!r.rows.empty()) {
+		printf(",\n     \"worst\": ");
+		printJsonRow(r.worst, false);
+	}
+	if (job.hasCapacity)
+		printf(",\n     \"capacity\": {\"trains\": %d, \"blocks\": %u, \"perHour\": %.6g, "
+			   "\"slowest\": %.6g, \"stopped\": %d}",
+			   settings.trains, job.capacity.blocks, job.capacity.perHour,
+			   job.capacity.slowest, job.capacity.stopped);
+	if (settings.rows) {
+		printf(",\n     \"rows\": [");
+		for (size_t i = 0; i < r.rows.size(); ++i) {
+			printf("%s\n       ", i ? "," : "");
+			printJsonRow(r.rows[i], true);
+		}
+		printf("]");
+	}
+	printf("}");
+}
+
+//
+// exits with 1 if any of the files couldn't be read (or had no track),
+// 2 for a bad command line
+//
+int main(int argc, char** argv)
+{
+	Settings settings;
+	RideAnalyzer::Options& options = settings.options;
+	std::vector<Job> jobs;
+
+	for (int i = 1; i < argc; i++) {
+		const char* a = argv[i];
+		bool more = i + 1 < argc;
+		if (!strcmp(a, "--rows"))
+			settings.rows = true;
+		else if (!strcmp(a, "--type") && more)
+			options.type = atoi(argv[++i]);
+		else if (!strcmp(a, "--laps") && more)
+			options.laps = atoi(argv[++i]);
+		else if (!strcmp(a, "--duration") && more)
+			options.duration = atof(argv[++i]);
+		else if (!strcmp(a, "--dt") && more)
+			options.dt = atof(argv[++i]);
+		else if (!strcmp(a, "--speed") && more)
+			options.startSpeed = (float)atof(argv[++i]);
+		else if (!strcmp(a, "--step") && more)
+			options.step = (float)atof(argv[++i]);
+		else if (!strcmp(a, "--carts") && more)
+			options.carts = atoi(argv[++i]);
+		else if (!strcmp(a, "--spacing") && more)
+			options.cartSpacing = (float)atof(argv[++i]);
+		else if (!strcmp(a, "--friction") && more)
+			options.physics.rollingFriction = (float)atof(argv[++i]);
+		else if (!strcmp(a, "--drag") && more)
+			options.physics.drag = (float)atof(argv[++i]);
+		else if (!strcmp(a, "--lift") && more)
+			options.physics.minSpeed = (float)atof(argv[++i]);
+		else if (!strcmp(a, "--trains") && more)
+			settings.trains = atoi(argv[++i]);
+		else if (!strcmp(a, "--block") && more)
+			settings.block = (float)atof(argv[++i]);
+		else if (!strcmp(a, "--jobs") && more)
+			settings.jobs = (unsigned int)atoi(argv[++i]);
+		else if (!strcmp(a, "--bench-trains") && more)
+			settings.benchTrains = atoi(argv[++i]);
+		else if (!strcmp(a, "--bench-read") && more)
+			settings.benchRead = atol(argv[++i]);
+		else if (!strcmp(a, "--format") && more) {
+			const char* f = argv[++i];
+			if (!strcmp(f, "text"))
+				settings.format = FORMAT_TEXT;
+			else if (!strcmp(f, "csv"))
+				settings.format = FORMAT_CSV;
+			else if (!strcmp(f, "json"))
+				settings.format = FORMAT_JSON;
+			else {
+				usage();
+				return 2;
+			}
+		}
+		else if (a[0] == '-') {
+			usage();
+			return 2;
+		}
+		else {
+			jobs.push_back(Job());
+			jobs.back().file = a;
+		}
+	}
+	if (settings.benchTrains > 0)
+		return benchTrains(settings, settings.benchTrains);
+	if (settings.benchRead > 0)
+		return benchRead(settings.benchRead);
+	if (jobs.empty() || options.dt <= 0) {
+		usage();
+		return 2;
+	}
+
+	// the files, and the segments of each, all share the one pool
+	ThreadPool::setSharedSize(settings.jobs);
+	ThreadPool::shared().parallelFor(0, jobs.size(), [&](size_t i) { run(jobs[i], settings); });
+
+	int failed = 0;
+	if (settings.format == FORMAT_CSV)
+		printCsvHeader();
+	if (settings.format == FORMAT_JSON)
+		printf("{\"tracks\": [\n");
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		failed += jobs[i].status != Job::JOB_OK;
+		switch (settings.format) {
+		case FORMAT_TEXT:
+			printText(jobs[i], settings);
+			break;
+		case FORMAT_CSV:
+			printCsv(jobs[i]);
+			break;
+		case FORMAT_JSON:
+			printJson(jobs[i], settings);
+			printf("%s\n", (i + 1 < jobs.size()) ? "," : "");
+			break;
+		}
+	}
+	if (settings.format == FORMAT_JSON)
+		printf("]}\n");
+	return failed ? 1 : 0;
+}
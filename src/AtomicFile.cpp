@@ -0,0 +1,218 @@
+/************************************************************************
+     File:        AtomicFile.cpp
+
+     Comment:     A file written whole, or not at all
+
+						see AtomicFile.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+
+#include "AtomicFile.H"
+
+//****************************************************************************
+//
+// * Constructor - no file
+//============================================================================
+AtomicFile::
+AtomicFile()
+	: end(0), failed(false)
+#ifdef _WIN32
+	, file(INVALID_HANDLE_VALUE)
+#else
+	, fd(-1)
+#endif
+//============================================================================
+{
+}
+
+AtomicFile::
+~AtomicFile()
+{
+	abandon();
+}
+
+bool AtomicFile::
+isOpen() const
+{
+#ifdef _WIN32
+	return file != INVALID_HANDLE_VALUE;
+#else
+	return fd >= 0;
+#endif
+}
+
+//****************************************************************************
+//
+// * Make the temporary file next to where the file goes
+//============================================================================
+bool AtomicFile::
+open(const char* fname)
+//============================================================================
+{
+	abandon();
+	name = fname;
+	temp = name + ".tmp";
+	failed = false;
+	end = 0;
+#ifdef _WIN32
+	file = CreateFileA(temp.c_str(), GENERIC_WRITE, 0, 0, CREATE_ALWAYS,
+					   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+#else
+	fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#endif
+	if (!isOpen())
+		return false;
+	buffer.resize(BUFFER_SIZE);
+	return true;
+}
+
+//****************************************************************************
+//
+// * Bytes on the end - into the buffer, or straight out if there are more
+//   than it holds
+//============================================================================
+bool AtomicFile::
+write(const void* data, size_t size)
+//============================================================================
+{
+	const char* p = (const char*)data;
+	while (size > 0) {
+		char* to = room(1);
+		if (!to)
+			return false;
+		size_t n = buffer.size() - end;
+		n = (size < n) ? size : n;
+		memcpy(to, p, n);
+		used(n);
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * Where the next size bytes can go
+//============================================================================
+char* AtomicFile::
+room(size_t size)
+//============================================================================
+{
+	if (!isOpen() || failed)
+		return 0;
+	if (buffer.size() - end < size) {
+		if (!flush())
+			return 0;
+		if (size > buffer.size())
+			buffer.resize(size);
+	}
+	return &buffer[end];
+}
+
+//****************************************************************************
+//
+// * Write out the buffer - as few writes as the system lets it be
+//============================================================================
+bool AtomicFile::
+flush()
+//============================================================================
+{
+	const char* p = buffer.data();
+	size_t left = end;
+	while (left > 0 && !failed) {
+#ifdef _WIN32
+		DWORD n = 0;
+		DWORD want = (left > 0x40000000) ? 0x40000000 : (DWORD)left;
+		if (!WriteFile(file, p, want, &n, 0) || n == 0)
+			failed = true;
+#else
+		ssize_t n = ::write(fd, p, left);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			failed = true;
+#endif
+		if (!failed) {
+			p += n;
+			left -= n;
+		}
+	}
+	end = 0;
+	return !failed;
+}
+
+//****************************************************************************
+//
+// * All of it written: onto the disk, then over the old file
+//============================================================================
+bool AtomicFile::
+commit()
+//============================================================================
+{
+	if (!isOpen())
+		return false;
+	bool ok = flush();
+#ifdef _WIN32
+	// the data has to be down before the rename, or a crash in between
+	// could leave the new name on an empty file
+	ok = ok && FlushFileBuffers(file);
+	closeFile();
+	ok = ok && MoveFileExA(temp.c_str(), name.c_str(),
+						   MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+	if (!ok)
+		DeleteFileA(temp.c_str());
+#else
+	ok = ok && fsync(fd) == 0;
+	ok = (::close(fd) == 0) && ok;
+	fd = -1;
+	ok = ok && rename(temp.c_str(), name.c_str()) == 0;
+	if (!ok)
+		unlink(temp.c_str());
+#endif
+	std::vector<char>().swap(buffer);
+	return ok;
+}
+
+//****************************************************************************
+//
+// * Give up - the old file stays as it was
+//============================================================================
+void AtomicFile::
+abandon()
+//============================================================================
+{
+	if (!isOpen())
+		return;
+	closeFile();
+#ifdef _WIN32
+	DeleteFileA(temp.c_str());
+#else
+	unlink(temp.c_str());
+#endif
+	std::vector<char>().swap(buffer);
+	end = 0;
+}
+
+void AtomicFile::
+closeFile()
+{
+#ifdef _WIN32
+	CloseHandle(file);
+	file = INVALID_HANDLE_VALUE;
+#else
+	::close(fd);
+	fd = -1;
+#endif
+}
@@ -26,11 +26,14 @@
 #include "TrainWindow.H"
 #include "TrainView.H"
 #include "CallBacks.H"
+#include "CatalogWindow.H"
+#include "MeshExport.H"
 
 #pragma warning(push)
 #pragma warning(disable:4312)
 #pragma warning(disable:4311)
 #include <Fl/Fl_File_Chooser.H>
+#include <FL/fl_ask.H>
 #include <FL/Fl_Box.H>
 #include <Fl/math.h>
 #pragma warning(pop)
@@ -46,8 +49,8 @@ void resetCB(Fl_Widget*, TrainWindow* tw)
 	tw->m_Track.resetPoints();
 	tw->trainView->selectedCube = -1;
 	tw->m_Track.trainU = 0;
-	
-	tw->trainView->currTrainSpeed = tw->trainView->defaultSpeed;
+	tw->trainSim.placeTrain(0);
+	tw->trainSim.resetSpeed();
 	
 	tw->trainView->cartsCount = 5;
 
@@ -64,10 +67,19 @@ void resetCB(Fl_Widget*, TrainWindow* tw)
 //***************************************************************************
 //
 // * any time something changes, you need to force a redraw
+//   (of only what the widget affects)
 //===========================================================================
-void damageCB(Fl_Widget*, TrainWindow* tw)
+void damageCB(Fl_Widget* w, TrainWindow* tw)
 {
-	tw->damageMe();
+	unsigned int what = TrainView::DAMAGE_ALL;
+	if (w == tw->worldCam || w == tw->trainCam || w == tw->topCam)
+		what = TrainView::DAMAGE_CAMERA | TrainView::DAMAGE_LIGHTING;
+	else if (w == tw->splineBrowser || w == tw->arcLength || w == tw->gpuSpline)
+		what = TrainView::DAMAGE_TRACK;
+	// the simulation redraws if these move the train
+	else if (w == tw->speed || w == tw->physics || w == tw->multiThread)
+		what = 0;
+	tw->damageMe(what);
 }
 
 //***************************************************************************
@@ -87,16 +99,17 @@ void addPointCB(Fl_Widget*, TrainWindow* tw)
 	size_t previdx = (newidx + npts -1) % npts;
 	Pnt3f npos = (tw->m_Track.points[previdx].pos + tw->m_Track.points[newidx].pos) * .5f;
 
-	tw->m_Track.points.insert(tw->m_Track.points.begin() + newidx,npos);
+	tw->m_Track.insertPoint(newidx, npos);
 
 	// make it so that the train doesn't move - unless its affected by this control point
 	// it should stay between the same points
 	if (ceil(tw->m_Track.trainU) > ((float)newidx)) {
 		tw->m_Track.trainU += 1;
 		if (tw->m_Track.trainU >= npts) tw->m_Track.trainU -= npts;
+		tw->trainSim.placeTrain(tw->m_Track.trainU);
 	}
 
-	tw->damageMe();
+	tw->damageMe(TrainView::DAMAGE_TRACK);
 }
 
 //***************************************************************************
@@ -108,11 +121,11 @@ void deletePointCB(Fl_Widget*, TrainWindow* tw)
 {
 	if (tw->m_Track.points.size() > 4) {
 		if (tw->trainView->selectedCube >= 0) {
-			tw->m_Track.points.erase(tw->m_Track.points.begin() + tw->trainView->selectedCube);
+			tw->m_Track.deletePoint(tw->trainView->selectedCube);
 		} else
-			tw->m_Track.points.pop_back();
+			tw->m_Track.deletePoint(tw->m_Track.points.size() - 1);
 	}
-	tw->damageMe();
+	tw->damageMe(TrainView::DAMAGE_TRACK);
 }
 //***************************************************************************
 //
@@ -121,7 +134,7 @@ void deletePointCB(Fl_Widget*, TrainWindow* tw)
 void forwCB(Fl_Widget*, TrainWindow* tw)
 {
 	tw->advanceTrain(2);
-	tw->damageMe();
+	tw->damageMe(0);
 }
 //***************************************************************************
 //
@@ -131,31 +144,91 @@ void backCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
 	tw->advanceTrain(-2);
-	tw->damageMe();
+	tw->damageMe(0);
 }
 
 
 
-static unsigned long lastRedraw = 0;
 //***************************************************************************
 //
-// * Callback for idling - if things are sitting, this gets called
-// if the run button is pushed, then we need to make the train go.
-// This is taken from the old "RunButton" demo.
-// another nice problem to have - most likely, we'll be too fast
-// don't draw more than 30 times per second
+// * The run button - the simulation thread picks it up from the settings
+//   (it sleeps while the train is stopped)
+//===========================================================================
+void runButtonCB(Fl_Widget*, TrainWindow* tw)
+//===========================================================================
+{
+	tw->damageMe(0);
+}
+
+//***************************************************************************
+//
+// * The simulation has a new snapshot - this runs in the FlTk thread (see
+//   Fl::awake), the drawing picks the snapshot up
+//===========================================================================
+void simPublishedCB(void* data)
+//===========================================================================
+{
+	TrainWindow* tw = (TrainWindow*)data;
+	tw->simAwakePending = false;
+
+	float speed = tw->trainSim.latest().speed;
+	if (speed != tw->shownSpeed) {
+		tw->shownSpeed = speed;
+		std::string str = ("Current Speed: " + std::to_string(speed));
+		strcpy_s(tw->currentSpeedStr, str.c_str());
+		tw->currentSpeed->label(tw->currentSpeedStr);
+	}
+	tw->trainView->changed(TrainView::DAMAGE_TRAIN);
+}
+
+//***************************************************************************
+//
+// * A track finished loading on the loader's thread (through Fl::awake) -
+//   swap it in, or say why not
 //===========================================================================
-void runButtonCB(TrainWindow* tw)
+void loadFinishedCB(void* data)
 //===========================================================================
 {
-	if (tw->runButton->value()) {	// only advance time if appropriate
-		if (clock() - lastRedraw > CLOCKS_PER_SEC/60) {
-			lastRedraw = clock();
-			tw->advanceTrain();
-			tw->damageMe();
-		}
+	TrainWindow* tw = (TrainWindow*)data;
+	// one from a load that was cancelled or has been taken already
+	if (!tw->trackLoader.ready())
+		return;
+
+	std::string name = tw->trackLoader.file();
+	const char* error = 0;
+	bool ok = tw->trackLoader.take(tw->m_Track, error);
+	tw->showLoading();
+	if (!ok) {
+		fl_alert("%s", error);
+		return;
 	}
-	Sleep(1);
+	tw->trainSim.placeTrain(tw->m_Track.trainU);
+	tw->recorder.load(name.c_str());
+	tw->damageMe();
+}
+
+//***************************************************************************
+//
+// * How far the load has got (an Fl timeout, while there is one)
+//===========================================================================
+void loadProgressCB(void* data)
+//===========================================================================
+{
+	TrainWindow* tw = (TrainWindow*)data;
+	tw->showLoading();
+	if (tw->trackLoader.busy())
+		Fl::repeat_timeout(0.1, loadProgressCB, data);
+}
+
+//***************************************************************************
+//
+// * Stop loading - the track that is there stays
+//===========================================================================
+void cancelLoadCB(Fl_Widget*, TrainWindow* tw)
+//===========================================================================
+{
+	tw->trackLoader.cancel();
+	tw->showLoading();
 }
 
 //***************************************************************************
@@ -166,11 +239,9 @@ void loadCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
 	const char* fname = 
-		fl_file_chooser("Pick a Track File","*.txt","TrackFiles/track.txt");
-	if (fname) {
-		tw->m_Track.readPoints(fname);
-		tw->damageMe();
-	}
+		fl_file_chooser("Pick a Track File","*.{txt,trk,tkz}","TrackFiles/track.txt");
+	if (fname)
+		tw->loadTrack(fname);
 }
 //***************************************************************************
 //
@@ -180,9 +251,44 @@ void saveCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
 	const char* fname = 
-		fl_input("File name for save (should be *.txt)","TrackFiles/");
-	if (fname)
-		tw->m_Track.writePoints(fname);
+		fl_input("File name for save (*.txt, *.trk for binary, *.tkz compact)","TrackFiles/");
+	const char* error = 0;
+	if (fname && !tw->m_Track.writePoints(fname, &error))
+		fl_alert("%s", error);
+}
+//***************************************************************************
+//
+// * Write the rails, ties and carts, as they are drawn now
+//===========================================================================
+void exportCB(Fl_Widget*, TrainWindow* tw)
+//===========================================================================
+{
+	const char* fname = 
+		fl_input("File name for export (*.obj, *.glb)","TrackFiles/");
+	if (!fname)
+		return;
+
+	// the GPU spline doesn't fill the cache, so it may be behind
+	CTrack& track = tw->m_Track;
+	track.cache.update(track.points, tw->splineType(),
+					   tw->arcLength->value() ? tw->trainView->barSpacing : 0);
+
+	MeshExportStats stats;
+	const char* error = 0;
+	if (!exportCoaster(fname, track.points, track.cache, tw->trainView->drawnCarts,
+					   MeshExportOptions(), stats, error))
+		fl_alert("%s", error);
+}
+//***************************************************************************
+//
+// * The tracks in TrackFiles, as a list with pictures
+//===========================================================================
+void catalogCB(Fl_Widget*, TrainWindow* tw)
+//===========================================================================
+{
+	if (!tw->catalogWindow)
+		tw->catalogWindow = new CatalogWindow(tw);
+	tw->catalogWindow->browse("TrackFiles");
 }
 
 //***************************************************************************
@@ -193,13 +299,16 @@ void rollx(TrainWindow* tw, float dir)
 {
 	int s = tw->trainView->selectedCube;
 	if (s >= 0) {
+		tw->m_Track.beginEdit(s);
 		Pnt3f old = tw->m_Track.points[s].orient;
 		float si = sin(((float)M_PI_4) * dir);
 		float co = cos(((float)M_PI_4) * dir);
 		tw->m_Track.points[s].orient.y = co * old.y - si * old.z;
 		tw->m_Track.points[s].orient.z = si * old.y + co * old.z;
+		tw->m_Track.pointChanged(s);
+		tw->m_Track.endEdit();
 	}
-	tw->damageMe();
+	tw->damageMe(TrainView::DAMAGE_TRACK);
 } 
 
 //***************************************************************************
@@ -230,6 +339,7 @@ void rollz(TrainWindow* tw, float dir)
 {
 	int s = tw->trainView->selectedCube;
 	if (s >= 0) {
+		tw->m_Track.beginEdit(s);
 
 		Pnt3f old = tw->m_Track.points[s].orient;
 
@@ -238,9 +348,11 @@ void rollz(TrainWindow* tw, float dir)
 
 		tw->m_Track.points[s].orient.y = co * old.y - si * old.x;
 		tw->m_Track.points[s].orient.x = si * old.y + co * old.x;
+		tw->m_Track.pointChanged(s);
+		tw->m_Track.endEdit();
 	}
 
-	tw->damageMe();
+	tw->damageMe(TrainView::DAMAGE_TRACK);
 }
 
 //***************************************************************************
@@ -275,7 +387,7 @@ void incCartCB(Fl_Widget*, TrainWindow* tw)
 	strcpy_s(tw->currentCartCountStr, str.c_str());
 	tw->CartCount->label(tw->currentCartCountStr);
 	tw->CartCount->redraw_label();
-	tw->damageMe();
+	tw->damageMe(0);
 	tw->widgets->damage(1);
 }
 void decCartCB(Fl_Widget*, TrainWindow* tw)
@@ -288,7 +400,7 @@ void decCartCB(Fl_Widget*, TrainWindow* tw)
 	strcpy_s(tw->currentCartCountStr, str.c_str());
 	tw->CartCount->label(tw->currentCartCountStr);	
 	tw->CartCount->redraw();
-	tw->damageMe();
+	tw->damageMe(0);
 	tw->widgets->damage(1);
 }
 
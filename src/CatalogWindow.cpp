@@ -0,0 +1,281 @@
+/************************************************************************
+     File:        CatalogWindow.cpp
+
+     Comment:     A window to pick a track from a directory of them
+
+						see CatalogWindow.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <stdio.h>
+
+#include "CatalogWindow.H"
+#include "TrainWindow.H"
+
+#pragma warning(push)
+#pragma warning(disable:4312)
+#pragma warning(disable:4311)
+#include <Fl/Fl.H>
+#pragma warning(pop)
+
+//****************************************************************************
+//
+// * The list on the left, the picked track on the right
+//============================================================================
+CatalogWindow::
+CatalogWindow(TrainWindow* tw)
+	: Fl_Double_Window(560, 305, "Tracks"), tw(tw), stop(false), done(0),
+	  finished(false), toRead(0), saveError(0)
+//============================================================================
+{
+	static const int columns[] = { 170, 90, 70, 0 };
+	list = new Fl_Hold_Browser(5, 5, 380, 265);
+	list->column_widths(columns);
+	list->callback((Fl_Callback*)listCB, this);
+
+	picture = new Fl_Box(395 + (160 - PICTURE_SIZE) / 2, 5, PICTURE_SIZE, PICTURE_SIZE);
+	picture->box(FL_DOWN_FRAME);
+	image = new Fl_RGB_Image(pixels, PICTURE_SIZE, PICTURE_SIZE, 3);
+	picture->image(image);
+
+	details = new Fl_Box(395, 140, 160, 130);
+	details->align(FL_ALIGN_LEFT | FL_ALIGN_TOP | FL_ALIGN_INSIDE);
+
+	status = new Fl_Box(5, 275, 380, 25);
+	status->align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+	rescan = new Fl_Button(475, 275, 80, 25, "Rescan");
+	rescan->callback((Fl_Callback*)rescanCB, this);
+
+	end();
+	resizable(list);
+	showPicked();
+}
+
+//****************************************************************************
+//
+// * The worker can't be left running
+//============================================================================
+CatalogWindow::
+~CatalogWindow()
+//============================================================================
+{
+	stopIndexing();
+	picture->image(0);
+	delete image;
+}
+
+//****************************************************************************
+//
+// * What the catalog has first, then bring it up to date
+//============================================================================
+void CatalogWindow::
+browse(const char* dir)
+//============================================================================
+{
+	stopIndexing();
+	const char* error = 0;
+	saveError = 0;
+	if (!catalog.open(dir, error))
+		saveError = error;
+	fill();
+	show();
+	startIndexing();
+	showStatus();
+}
+
+//****************************************************************************
+//
+// * A line for each track: name, points, length, highest point
+//============================================================================
+void CatalogWindow::
+fill()
+//============================================================================
+{
+	std::string picked;
+	if (list->value() > 0 && (size_t)list->value() <= catalog.tracks().size())
+		picked = list->text(list->value());
+	picked = picked.substr(0, picked.find('\t'));
+
+	list->clear();
+	int select = 0;
+	char line[512];
+	for (const TrackSummary& t : catalog.tracks()) {
+		if (t.stale)
+			snprintf(line, sizeof(line), "%s\t...", t.name.c_str());
+		else if (!t.readable)
+			snprintf(line, sizeof(line), "%s\tcan't read it", t.name.c_str());
+		else
+			snprintf(line, sizeof(line), "%s\t%zu points\t%.0f m\t%.0f m high",
+					 t.name.c_str(), t.points, t.length, t.maxHeight);
+		list->add(line);
+		if (t.name == picked)
+			select = list->size();
+	}
+	if (select)
+		list->value(select);
+	showPicked();
+}
+
+//****************************************************************************
+//
+// * The thumbnail, twice the size, and the numbers
+//============================================================================
+void CatalogWindow::
+showPicked()
+//============================================================================
+{
+	const TrackSummary* t = 0;
+	int line = list->value();
+	if (line > 0 && (size_t)line <= catalog.tracks().size())
+		t = &catalog.tracks()[line - 1];
+
+	const int N = TrackCatalog::THUMB_SIZE;
+	bool drawn = t && !t->stale && t->readable && t->thumbnail.size() == (size_t)(N * N);
+	for (int y = 0; y < PICTURE_SIZE; ++y)
+		for (int x = 0; x < PICTURE_SIZE; ++x) {
+			unsigned char level = drawn ? t->thumbnail[(size_t)(y / 2) * N + x / 2] : 0;
+			TrackCatalog::thumbnailColor(level, &pixels[((size_t)y * PICTURE_SIZE + x) * 3]);
+		}
+	image->uncache();
+	picture->redraw();
+
+	char text[512] = "";
+	if (t && t->stale)
+		snprintf(text, sizeof(text), "%s\n\nnot read yet", t->name.c_str());
+	else if (t && !t->readable)
+		snprintf(text, sizeof(text), "%s\n\n%s", t->name.c_str(), t->error.c_str());
+	else if (t)
+		snprintf(text, sizeof(text), "%s\n\n%zu points\n%.1f m long\n%.1f m at the highest\n"
+				 "%.0f by %.0f m", t->name.c_str(), t->points, t->length, t->maxHeight,
+				 t->hi.x - t->lo.x, t->hi.z - t->lo.z);
+	detailStr = text;
+	details->label(detailStr.c_str());
+	details->redraw();
+}
+
+//****************************************************************************
+//
+// * How far the reading has got, or how many there are
+//============================================================================
+void CatalogWindow::
+showStatus()
+//============================================================================
+{
+	char text[256];
+	if (worker.joinable())
+		snprintf(text, sizeof(text), "Reading tracks: %zu of %zu", (size_t)done, toRead);
+	else if (saveError)
+		snprintf(text, sizeof(text), "%zu tracks (%s)", catalog.tracks().size(), saveError);
+	else
+		snprintf(text, sizeof(text), "%zu tracks in %s", catalog.tracks().size(),
+				 catalog.directory().c_str());
+	statusStr = text;
+	status->label(statusStr.c_str());
+	status->redraw();
+}
+
+//****************************************************************************
+//
+// * The stale tracks are read into a copy of the catalog, on the shared
+//   pool - the window's own loops never wait behind them (see ThreadPool.H)
+//============================================================================
+void CatalogWindow::
+startIndexing()
+//============================================================================
+{
+	toRead = catalog.staleCount();
+	if (!toRead)
+		return;
+	fresh = catalog;
+	stop = false;
+	finished = false;
+	done = 0;
+	worker = std::thread([this]() {
+		fresh.reindex(0, &done, &stop);
+		if (!stop)
+			fresh.save(saveError);
+		finished = true;
+		Fl::awake(indexedCB, this);
+	});
+	Fl::add_timeout(0.1, progressCB, this);
+}
+
+//****************************************************************************
+//
+// * Stop reading, throwing away what was read
+//============================================================================
+void CatalogWindow::
+stopIndexing()
+//============================================================================
+{
+	Fl::remove_timeout(progressCB, this);
+	if (!worker.joinable())
+		return;
+	stop = true;
+	worker.join();
+}
+
+//****************************************************************************
+//
+// * Picking a track shows it; a double click loads it
+//============================================================================
+void CatalogWindow::
+listCB(Fl_Widget*, CatalogWindow* cw)
+//============================================================================
+{
+	cw->showPicked();
+	int line = cw->list->value();
+	if (!Fl::event_clicks() || line <= 0)
+		return;
+	const TrackSummary& t = cw->catalog.tracks()[line - 1];
+	if (t.stale || !t.readable)
+		return;
+	cw->tw->loadTrack(cw->catalog.path(line - 1).c_str());
+	cw->hide();
+}
+
+//****************************************************************************
+//
+// * Look at the directory again
+//============================================================================
+void CatalogWindow::
+rescanCB(Fl_Widget*, CatalogWindow* cw)
+//============================================================================
+{
+	cw->browse(cw->catalog.directory().c_str());
+}
+
+//****************************************************************************
+//
+// * The worker is done: show what it read (from Fl::awake, so on the FlTk
+//   thread). one on its way from a worker that was stopped finds nothing
+//============================================================================
+void CatalogWindow::
+indexedCB(void* data)
+//============================================================================
+{
+	CatalogWindow* cw = (CatalogWindow*)data;
+	if (!cw->worker.joinable() || !cw->finished)
+		return;
+	cw->worker.join();
+	Fl::remove_timeout(progressCB, cw);
+	cw->catalog = std::move(cw->fresh);
+	cw->fill();
+	cw->showStatus();
+}
+
+//****************************************************************************
+//
+// * Every tenth of a second while the worker reads
+//============================================================================
+void CatalogWindow::
+progressCB(void* data)
+//============================================================================
+{
+	CatalogWindow* cw = (CatalogWindow*)data;
+	cw->showStatus();
+	if (cw->worker.joinable())
+		Fl::repeat_timeout(0.1, progressCB, cw);
+}
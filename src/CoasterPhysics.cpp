@@ -0,0 +1,151 @@
+/************************************************************************
+     File:        CoasterPhysics.cpp
+
+     Comment:     The train as a rigid chain of carts along the track
+
+						see CoasterPhysics.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+
+#include "CoasterPhysics.H"
+
+//****************************************************************************
+//
+// * Constructor - one cart
+//============================================================================
+CoasterPhysics::
+CoasterPhysics()
+	: masses(1, 1.0f), spacing(0), totalMass(1)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * The carts
+//============================================================================
+void CoasterPhysics::
+setCarts(const std::vector<float>& m, float space)
+//============================================================================
+{
+	masses = m;
+	if (masses.empty())
+		masses.push_back(1);
+	spacing = space;
+	totalMass = 0;
+	for (float mass : masses)
+		totalMass += mass;
+}
+
+//****************************************************************************
+//
+// * Gravity along the slope under every cart, then friction and drag
+//============================================================================
+double CoasterPhysics::
+accel(const TrackProfile& track, double s, double v) const
+//============================================================================
+{
+	double pull = 0;
+	double normal = 0;
+	for (size_t k = 0; k < masses.size(); ++k) {
+		float h, slope;
+		track.sample((float)(s - k * spacing), h, slope);
+		pull -= masses[k] * slope;
+		if (params.rollingFriction > 0) {
+			double c2 = 1.0 - (double)slope * slope;
+			normal += masses[k] * ((c2 > 0) ? sqrt(c2) : 0);
+		}
+	}
+	double a = params.gravity * pull / totalMass;
+
+	// friction against the motion - eased in around 0 so it doesn't
+	// rattle back and forth when the train stops
+	if (params.rollingFriction > 0) {
+		double dir = v / FRICTION_EASE;
+		dir = (dir > 1) ? 1 : ((dir < -1) ? -1 : dir);
+		a -= params.rollingFriction * params.gravity * normal / totalMass * dir;
+	}
+	a -= params.drag * v * fabs(v);
+	return a;
+}
+
+//****************************************************************************
+//
+// * One RK4 step of h seconds, for ds/dt = v, dv/dt = accel
+//============================================================================
+void CoasterPhysics::
+rk4(const TrackProfile& track, Train& t, double h) const
+//============================================================================
+{
+	double s = t.s;
+	double v = t.v;
+
+	double k1s = v;
+	double k1v = accel(track, s, v);
+	double k2s = v + 0.5 * h * k1v;
+	double k2v = accel(track, s + 0.5 * h * k1s, k2s);
+	double k3s = v + 0.5 * h * k2v;
+	double k3v = accel(track, s + 0.5 * h * k2s, k3s);
+	double k4s = v + h * k3v;
+	double k4v = accel(track, s + h * k3s, k4s);
+
+	t.s = s + h / 6 * (k1s + 2 * k2s + 2 * k3s + k4s);
+	t.v = v + h / 6 * (k1v + 2 * k2v + 2 * k3v + k4v);
+}
+
+//****************************************************************************
+//
+// * Cut dt into substeps of at most subStep, all the same length
+//============================================================================
+void CoasterPhysics::
+step(const TrackProfile& track, Train& train, double dt) const
+//============================================================================
+{
+	step(track, &train, 1, dt);
+}
+
+void CoasterPhysics::
+step(const TrackProfile& track, Train* trains, size_t n, double dt) const
+{
+	if (track.empty() || dt <= 0)
+		return;
+	int steps = (int)ceil(dt / params.subStep);
+	double h = dt / steps;
+
+	for (size_t i = 0; i < n; ++i) {
+		Train& t = trains[i];
+		for (int k = 0; k < steps; ++k)
+			rk4(track, t, h);
+
+		// the lift and the brakes
+		if (params.minSpeed > 0 && t.v < params.minSpeed)
+			t.v = params.minSpeed;
+		if (params.maxSpeed > 0 && t.v > params.maxSpeed)
+			t.v = params.maxSpeed;
+
+		// keep s within the loop, so it doesn't lose precision lap
+		// after lap
+		double len = track.length();
+		t.s = fmod(t.s, len);
+		if (t.s < 0)
+			t.s += len;
+	}
+}
+
+//****************************************************************************
+//
+// * Kinetic plus potential
+//============================================================================
+double CoasterPhysics::
+energy(const TrackProfile& track, const Train& t) const
+//============================================================================
+{
+	double e = 0.5 * totalMass * t.v * t.v;
+	for (size_t k = 0; k < masses.size(); ++k)
+		e += masses[k] * params.gravity * track.heightAt((float)(t.s - k * spacing));
+	return e;
+}
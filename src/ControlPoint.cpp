@@ -24,12 +24,16 @@
 
 *************************************************************************/
 
+#ifndef HEADLESS
 #include <windows.h>
 #include <GL/gl.h>
+#endif
 #include <math.h>
 
 #include "ControlPoint.H"
+#ifndef HEADLESS
 #include "Utilities/3dUtils.h"
+#endif
 
 //****************************************************************************
 //
@@ -65,6 +69,7 @@ ControlPoint(const Pnt3f &_pos, const Pnt3f &_orient)
 	orient.normalize();
 }
 
+#ifndef HEADLESS
 //****************************************************************************
 //
 // * Draw the control point
@@ -130,4 +135,5 @@ draw()
 			glVertex3f( size, size , size);
 		glEnd();
 	glPopMatrix();
-}
\ No newline at end of file
+}
+#endif
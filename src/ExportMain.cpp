@@ -0,0 +1,221 @@
+/************************************************************************
+     File:        ExportMain.cpp
+
+     Comment:     The TrackExport program - no window, no OpenGL
+
+						Reads a track file (any the program reads), samples
+						it as TrainView would draw it, puts a train on it,
+						and writes the rails, ties and carts as an OBJ or a
+						binary glTF (see MeshExport.H) - for other programs
+						to render, or to put a park together in. Built with
+						HEADLESS, so it runs anywhere there is a C++
+						compiler, without a display.
+
+						The sampling and the writing are shared out over
+						the cores, a segment of the track at a time.
+						--scaling times each stage with 1 thread, 2, 4
+						and so on up to all of them, to see how well the
+						work spreads.
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "MeshExport.H"
+#include "ThreadPool.H"
+#include "Track.H"
+
+// as TrainView draws them
+static const float TIE_SPACING = 7.5f;
+static const float CART_SPACING = 17;
+static const int CARTS = 5;
+
+static void usage()
+{
+	printf("usage: TrackExport [options] track out.obj|out.glb\n"
+		   "  --type n        spline type: 1 linear, 2 cardinal (default), 3 b-spline\n"
+		   "  --ties d        distance between ties, m (default 7.5; 0 for the\n"
+		   "                  same number on every segment, as without arc length)\n"
+		   "  --train u       where the front cart is, as a place on the track\n"
+		   "                  (default 0)\n"
+		   "  --carts n       carts behind the front one (default 5)\n"
+		   "  --spacing d     distance between carts, m (default 17)\n"
+		   "  --no-rails      leave the rails out\n"
+		   "  --no-ties       leave the ties out\n"
+		   "  --no-train      leave the carts out\n"
+		   "  --chunk n       segments made at once (default 64)\n"
+		   "  --jobs n        threads (default one per core)\n"
+		   "  --scaling       time the sampling, arc length and export with 1, 2,\n"
+		   "                  4 ... threads up to --jobs, and print the speedup\n"
+		   "                  (the file is written at every step)\n");
+}
+
+//
+// the frames of the track, as TrainView makes them (a binary file may have
+// brought them with it - then only what is different is done again)
+//
+static void sample(CTrack& track, int type, float ties, ThreadPool& pool)
+{
+	TrackCache& cache = track.cache;
+	cache.prepare(track.points, type, ties);
+	const std::vector<size_t>& dirty = cache.dirtySegments();
+	pool.parallelFor(0, dirty.size(), [&](size_t i) {
+		cache.rebuildSegment(track.points, dirty[i]);
+	});
+}
+
+static double msSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+//
+// each stage from scratch on a pool of 1, 2, 4 ... threads, up to jobs
+//
+static int scaling(CTrack& track, int type, float ties, const std::vector<float>& carts,
+				   const char* fname, const MeshExportOptions& options, unsigned int jobs)
+{
+	if (jobs == 0)
+		jobs = std::thread::hardware_concurrency();
+	if (jobs == 0)
+		jobs = 1;
+	printf("%zu points, %u threads at most\n", track.points.size(), jobs);
+	printf("threads   sample ms   arc ms   export ms   total ms   speedup\n");
+	double first = 0;
+	for (unsigned int n = 1; ; n = (n * 2 < jobs) ? n * 2 : jobs) {
+		ThreadPool pool(n);
+		auto start = std::chrono::steady_clock::now();
+		track.cache.invalidate();
+		sample(track, type, ties, pool);
+		double sampled = msSince(start);
+
+		start = std::chrono::steady_clock::now();
+		TrackProfile profile;
+		profile.update(track.points, type, &pool);
+		double arc = msSince(start);
+
+		start = std::chrono::steady_clock::now();
+		MeshExportStats stats;
+		const char* error = 0;
+		if (!exportCoaster(fname, track.points, track.cache, carts, options, stats, error, &pool)) {
+			fprintf(stderr, "%s: %s\n", fname, error);
+			return 1;
+		}
+		double exported = msSince(start);
+
+		double total = sampled + arc + exported;
+		if (n == 1)
+			first = total;
+		printf("%7u   %9.1f   %6.1f   %9.1f   %8.1f   %7.2f\n",
+			   n, sampled, arc, exported, total, first / total);
+		if (n == jobs)
+			break;
+	}
+	return 0;
+}
+
+//
+// exits with 1 if the track can't be read or the file written, 2 for a
+// bad command line
+//
+int main(int argc, char** argv)
+{
+	MeshExportOptions options;
+	int type = 2;
+	float ties = TIE_SPACING;
+	float train = 0;
+	int carts = CARTS;
+	float spacing = CART_SPACING;
+	bool noTrain = false;
+	bool timeScaling = false;
+	unsigned int jobs = 0;
+	std::vector<const char*> files;
+
+	for (int i = 1; i < argc; i++) {
+		const char* a = argv[i];
+		bool more = i + 1 < argc;
+		if (!strcmp(a, "--no-rails"))
+			options.rails = false;
+		else if (!strcmp(a, "--no-ties"))
+			options.ties = false;
+		else if (!strcmp(a, "--no-train"))
+			noTrain = true;
+		else if (!strcmp(a, "--scaling"))
+			timeScaling = true;
+		else if (!strcmp(a, "--type") && more)
+			type = atoi(argv[++i]);
+		else if (!strcmp(a, "--ties") && more)
+			ties = (float)atof(argv[++i]);
+		else if (!strcmp(a, "--train") && more)
+			train = (float)atof(argv[++i]);
+		else if (!strcmp(a, "--carts") && more)
+			carts = atoi(argv[++i]);
+		else if (!strcmp(a, "--spacing") && more)
+			spacing = (float)atof(argv[++i]);
+		else if (!strcmp(a, "--chunk") && more)
+			options.chunk = (size_t)atol(argv[++i]);
+		else if (!strcmp(a, "--jobs") && more)
+			jobs = (unsigned int)atoi(argv[++i]);
+		else if (a[0] == '-') {
+			usage();
+			return 2;
+		}
+		else
+			files.push_back(a);
+	}
+	if (files.size() != 2 || type < 1 || type > 3 || ties < 0 || carts < 0 || options.chunk == 0) {
+		usage();
+		return 2;
+	}
+
+	// everything - the sampling, the profile and the writing - goes on
+	// the shared pool
+	ThreadPool::setSharedSize(jobs);
+	ThreadPool& pool = ThreadPool::shared();
+
+	auto start = std::chrono::steady_clock::now();
+	CTrack track;
+	const char* error = 0;
+	if (!track.readPoints(files[0], &error)) {
+		fprintf(stderr, "%s: can't read it (%s)\n", files[0], error);
+		return 1;
+	}
+
+	sample(track, type, ties, pool);
+
+	// the train: the front cart at train, the rest behind it along the
+	// track (as TrainSim::placeCarts puts them)
+	std::vector<float> at;
+	if (!noTrain) {
+		const TrackProfile& profile = track.getProfile(type);
+		float n = (float)track.points.size();
+		float u = train - n * floorf(train / n);
+		double s = profile.arcAt(u);
+		at.push_back(u);
+		for (int c = 1; c <= carts; c++)
+			at.push_back(profile.paramAt((float)(s - c * spacing)));
+	}
+
+	if (timeScaling)
+		return scaling(track, type, ties, at, files[1], options, jobs);
+
+	MeshExportStats stats;
+	if (!exportCoaster(files[1], track.points, track.cache, at, options, stats, error, &pool)) {
+		fprintf(stderr, "%s: %s\n", files[1], error);
+		return 1;
+	}
+
+	double ms = msSince(start);
+	printf("%s: %zu points, %zu vertices, %zu triangles (%zu placed parts) in %.1f ms\n",
+		   files[1], track.points.size(), stats.vertices, stats.triangles, stats.instances, ms);
+	return 0;
+}
@@ -0,0 +1,437 @@
+/************************************************************************
+     File:        GpuTrack.cpp
+
+     Comment:     Draw the track by evaluating the spline on the GPU
+
+						see GpuTrack.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+// we will need OpenGL, and OpenGL needs windows.h (on Windows - the
+// offscreen test builds this elsewhere too)
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GpuTrack.H"
+#include "Spline.H"
+
+//****************************************************************************
+//
+// * The shaders
+//   The control points are read from a storage buffer, the spline weights
+//   come from the basis matrix, exactly as in Spline.cpp: G * M * T
+//============================================================================
+#define TRACK_POINTS_GLSL \
+	"struct TrackPoint { vec4 pos; vec4 orient; };\n" \
+	"layout(std430, binding = 0) readonly buffer Points { TrackPoint points[]; };\n" \
+	"uniform mat4 basis;\n" \
+	"uniform int  pointCount;\n" \
+	"void evalSegment(int i, float u, out vec3 pos, out vec3 dir, out vec3 up)\n" \
+	"{\n" \
+	"	int n = pointCount;\n" \
+	"	int i0 = (i + n - 1) % n;\n" \
+	"	int i2 = (i + 1) % n;\n" \
+	"	int i3 = (i + 2) % n;\n" \
+	"	vec4 w  = basis * vec4(u*u*u, u*u, u, 1.0);\n" \
+	"	vec4 dw = basis * vec4(3.0*u*u, 2.0*u, 1.0, 0.0);\n" \
+	"	pos = w.x*points[i0].pos.xyz + w.y*points[i].pos.xyz + w.z*points[i2].pos.xyz + w.w*points[i3].pos.xyz;\n" \
+	"	dir = dw.x*points[i0].pos.xyz + dw.y*points[i].pos.xyz + dw.z*points[i2].pos.xyz + dw.w*points[i3].pos.xyz;\n" \
+	"	up  = w.x*points[i0].orient.xyz + w.y*points[i].orient.xyz + w.z*points[i2].orient.xyz + w.w*points[i3].orient.xyz;\n" \
+	"}\n" \
+	"void evalTrack(float t, out vec3 pos, out vec3 dir, out vec3 up)\n" \
+	"{\n" \
+	"	t = mod(t, float(pointCount));\n" \
+	"	int i = min(int(floor(t)), pointCount - 1);\n" \
+	"	evalSegment(i, t - float(i), pos, dir, up);\n" \
+	"}\n"
+
+static const char* railVS =
+	"#version 430 compatibility\n"
+	"void main() { gl_Position = vec4(0.0); }\n";
+
+static const char* railTCS =
+	"#version 430 compatibility\n"
+	"layout(vertices = 1) out;\n"
+	"uniform float tessLevel;\n"
+	"void main()\n"
+	"{\n"
+	"	gl_out[gl_InvocationID].gl_Position = vec4(0.0);\n"
+	"	gl_TessLevelOuter[0] = 2.0;			// one isoline per rail\n"
+	"	gl_TessLevelOuter[1] = tessLevel;	// pieces along the segment\n"
+	"}\n";
+
+static const char* railTES =
+	"#version 430 compatibility\n"
+	"layout(isolines, equal_spacing) in;\n"
+	TRACK_POINTS_GLSL
+	"uniform float railOffset;\n"
+	"void main()\n"
+	"{\n"
+	"	vec3 pos, dir, up;\n"
+	// the end of a patch is the end of its own segment, not the start of
+	// the next - they turn different ways where the track has a corner
+	"	evalSegment(gl_PrimitiveID, gl_TessCoord.x, pos, dir, up);\n"
+	"	vec3 side = normalize(cross(dir, up)) * railOffset;\n"
+	"	if (gl_TessCoord.y < 0.25) side = -side;\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * vec4(pos + side, 1.0);\n"
+	"}\n";
+
+static const char* railFS =
+	"#version 430 compatibility\n"
+	"uniform vec4 color;\n"
+	"out vec4 fragColor;\n"
+	"void main() { fragColor = color; }\n";
+
+// the ties: same frame as TrainView::drawBar, lit by the three
+// directional lights the TrainView sets up
+static const char* barVS =
+	"#version 430 compatibility\n"
+	"layout(location = 0) in vec3 vertex;\n"
+	"layout(location = 1) in vec3 normal;\n"
+	"layout(location = 2) in vec3 color;\n"
+	"layout(location = 3) in float param;\n"
+	TRACK_POINTS_GLSL
+	"uniform bool shadow;\n"
+	"out vec4 shade;\n"
+	"void main()\n"
+	"{\n"
+	"	vec3 pos, dir, up;\n"
+	"	evalTrack(param, pos, dir, up);\n"
+	"	vec3 fu = normalize(dir);\n"
+	"	vec3 fw = normalize(cross(fu, up));\n"
+	"	vec3 fv = normalize(cross(fw, fu));\n"
+	"	mat3 frame = mat3(fu, fv, fw);\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * vec4(pos + frame * vertex, 1.0);\n"
+	"	if (shadow) {\n"
+	"		shade = vec4(0.0, 0.0, 0.0, 0.5);\n"
+	"		return;\n"
+	"	}\n"
+	"	vec3 n = normalize(gl_NormalMatrix * (frame * normal));\n"
+	"	vec3 lit = (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb) * color;\n"
+	"	for (int l = 0; l < 3; ++l)\n"
+	"		lit += max(dot(n, normalize(gl_LightSource[l].position.xyz)), 0.0) * gl_LightSource[l].diffuse.rgb * color;\n"
+	"	shade = vec4(lit, 1.0);\n"
+	"}\n";
+
+static const char* barFS =
+	"#version 430 compatibility\n"
+	"in vec4 shade;\n"
+	"out vec4 fragColor;\n"
+	"void main() { fragColor = shade; }\n";
+
+//****************************************************************************
+//
+// * Compile one shader stage - prints the log if it fails
+//============================================================================
+static GLuint compileShader(GLenum stage, const char* source)
+//============================================================================
+{
+	GLuint shader = glCreateShader(stage);
+	glShaderSource(shader, 1, &source, 0);
+	glCompileShader(shader);
+
+	GLint ok = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok) {
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), 0, log);
+		printf("GpuTrack: shader compile failed\n%s\n", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+//****************************************************************************
+//
+// * Link the stages we got (a 0 in the list ends it)
+//============================================================================
+static GLuint linkProgram(const GLuint* shaders)
+//============================================================================
+{
+	GLuint program = glCreateProgram();
+	for (const GLuint* s = shaders; *s; ++s)
+		glAttachShader(program, *s);
+	glLinkProgram(program);
+	for (const GLuint* s = shaders; *s; ++s)
+		glDeleteShader(*s);
+
+	GLint ok = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		char log[1024];
+		glGetProgramInfoLog(program, sizeof(log), 0, log);
+		printf("GpuTrack: program link failed\n%s\n", log);
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+//****************************************************************************
+//
+// * Constructor - nothing is made until init (we need a GL context)
+//============================================================================
+GpuTrack::
+GpuTrack()
+	: railTessLevel(64),
+	  initFailed(false),
+	  railProgram(0), barProgram(0),
+	  emptyVAO(0), barVAO(0),
+	  pointBuffer(0), barMeshBuffer(0), barIndexBuffer(0), barParamBuffer(0),
+	  uploadedType(0), uploadedArcLength(false),
+	  uploadedBarSpacing(0), uploadedDivideLine(0),
+	  pointCount(0), barCount(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Compile the programs and make the buffers
+//============================================================================
+bool GpuTrack::
+init()
+//============================================================================
+{
+	if (ready())
+		return true;
+	if (initFailed)
+		return false;
+
+	// storage buffers are 4.3, tessellation is 4.0
+	initFailed = true;
+	if (!GLAD_GL_VERSION_4_3)
+		return false;
+
+	GLuint rail[] = {
+		compileShader(GL_VERTEX_SHADER, railVS),
+		compileShader(GL_TESS_CONTROL_SHADER, railTCS),
+		compileShader(GL_TESS_EVALUATION_SHADER, railTES),
+		compileShader(GL_FRAGMENT_SHADER, railFS),
+		0 };
+	GLuint bar[] = {
+		compileShader(GL_VERTEX_SHADER, barVS),
+		compileShader(GL_FRAGMENT_SHADER, barFS),
+		0 };
+	if (!rail[0] || !rail[1] || !rail[2] || !rail[3] || !bar[0] || !bar[1])
+		return false;
+
+	GLuint rp = linkProgram(rail);
+	GLuint bp = linkProgram(bar);
+	if (!rp || !bp)
+		return false;
+
+	// the tie box, already in the frame TrainView::drawBar uses:
+	// rotated 90 degrees about Y and dropped by the bar height
+	const float L = 7.5f / 2, H = 0.5f / 2, W = 1.0f / 2;
+	const float white[3] = { 1, 1, 1 };
+	const float red[3] = { 1, 0, 0 };
+	struct Face { float n[3]; float c[4][3]; const float* color; };
+	const Face faces[6] = {
+		{ { 0,-1, 0 }, { {-L,-H,-W}, {-L,-H, W}, { L,-H, W}, { L,-H,-W} }, white },
+		{ {-1, 0, 0 }, { {-L, H,-W}, {-L, H, W}, {-L,-H, W}, {-L,-H,-W} }, white },
+		{ { 1, 0, 0 }, { { L, H,-W}, { L, H, W}, { L,-H, W}, { L,-H,-W} }, white },
+		{ { 0, 0,-1 }, { {-L,-H,-W}, {-L, H,-W}, { L, H,-W}, { L,-H,-W} }, white },
+		{ { 0, 0, 1 }, { {-L,-H, W}, {-L, H, W}, { L, H, W}, { L,-H, W} }, white },
+		{ { 0, 1, 0 }, { {-L, H,-W}, {-L, H, W}, { L, H, W}, { L, H,-W} }, red },
+	};
+	std::vector<float> mesh;
+	std::vector<GLushort> index;
+	for (int f = 0; f < 6; ++f) {
+		GLushort base = (GLushort)(mesh.size() / 9);
+		for (int v = 0; v < 4; ++v) {
+			const float* c = faces[f].c[v];
+			const float* n = faces[f].n;
+			// rotate 90 about Y: (x,y,z) -> (z,y,-x), then drop by the height
+			mesh.push_back(c[2]); mesh.push_back(c[1] - 2 * H); mesh.push_back(-c[0]);
+			mesh.push_back(n[2]); mesh.push_back(n[1]); mesh.push_back(-n[0]);
+			mesh.insert(mesh.end(), faces[f].color, faces[f].color + 3);
+		}
+		const GLushort quad[6] = { 0, 1, 2, 0, 2, 3 };
+		for (int i = 0; i < 6; ++i)
+			index.push_back(base + quad[i]);
+	}
+
+	glGenVertexArrays(1, &emptyVAO);
+	glGenVertexArrays(1, &barVAO);
+	glGenBuffers(1, &pointBuffer);
+	glGenBuffers(1, &barMeshBuffer);
+	glGenBuffers(1, &barIndexBuffer);
+	glGenBuffers(1, &barParamBuffer);
+
+	glBindVertexArray(barVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, barMeshBuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.size() * sizeof(float), mesh.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(6 * sizeof(float)));
+	glBindBuffer(GL_ARRAY_BUFFER, barParamBuffer);
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+	glVertexAttribDivisor(3, 1);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, barIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, index.size() * sizeof(GLushort), index.data(), GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	railProgram = rp;
+	barProgram = bp;
+	initFailed = false;
+	return true;
+}
+
+//****************************************************************************
+//
+// * Bring the GPU copy up to date - the control points are compared with
+//   what was uploaded last time, so a static track costs no upload and no
+//   tie placement
+//============================================================================
+void GpuTrack::
+update(const std::vector<ControlPoint>& points, int type,
+	   bool arcLength, float barSpacing, int divideLine)
+//============================================================================
+{
+	if (!ready())
+		return;
+
+	scratch.resize(points.size() * 8);
+	for (size_t i = 0; i < points.size(); ++i) {
+		float* p = &scratch[i * 8];
+		p[0] = points[i].pos.x;		p[1] = points[i].pos.y;		p[2] = points[i].pos.z;		p[3] = 0;
+		p[4] = points[i].orient.x;	p[5] = points[i].orient.y;	p[6] = points[i].orient.z;	p[7] = 0;
+	}
+
+	bool pointsChanged = (scratch != uploaded);
+	if (pointsChanged) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, pointBuffer);
+		if (scratch.size() == uploaded.size())
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, scratch.size() * sizeof(float), scratch.data());
+		else
+			glBufferData(GL_SHADER_STORAGE_BUFFER, scratch.size() * sizeof(float), scratch.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		uploaded.swap(scratch);
+		pointCount = points.size();
+	}
+
+	if (pointsChanged || type != uploadedType || arcLength != uploadedArcLength ||
+		barSpacing != uploadedBarSpacing || divideLine != uploadedDivideLine) {
+		uploadedType = type;
+		uploadedArcLength = arcLength;
+		uploadedBarSpacing = barSpacing;
+		uploadedDivideLine = divideLine;
+
+		computeBarParams(points);
+		glBindBuffer(GL_ARRAY_BUFFER, barParamBuffer);
+		glBufferData(GL_ARRAY_BUFFER, barParams.size() * sizeof(float), barParams.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		barCount = barParams.size();
+	}
+}
+
+//****************************************************************************
+//
+// * Work out where the ties go - this walks the track exactly like the
+//   CPU path in TrainView::drawStuff, but only runs when the track changes
+//============================================================================
+void GpuTrack::
+computeBarParams(const std::vector<ControlPoint>& points)
+//============================================================================
+{
+	barParams.clear();
+	if (!splineBasis(uploadedType) || uploadedDivideLine <= 0)
+		return;
+
+	// without arc length, ten ties a segment - or one a step, if there
+	// are fewer than ten steps
+	const int tieEvery = std::max(1, uploadedDivideLine / 10);
+	for (size_t i = 0; i < points.size(); ++i) {
+		float t = (float)i;
+		Pnt3f pv;
+		splinePos(points, t, pv, uploadedType);
+		float distSum = 0;
+		for (int j = 0; j < uploadedDivideLine; ++j) {
+			t += 1.0f / uploadedDivideLine;
+			Pnt3f cv;
+			splinePos(points, t, cv, uploadedType);
+			if (uploadedArcLength) {
+				Pnt3f d = cv - pv;
+				distSum += sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+			}
+			if ((!uploadedArcLength && j % tieEvery == 0) ||
+				(uploadedArcLength && distSum >= uploadedBarSpacing)) {
+				distSum = 0;
+				barParams.push_back(t);
+			}
+			pv = cv;
+		}
+	}
+}
+
+//****************************************************************************
+//
+// * Draw both rails - one patch per segment
+//============================================================================
+void GpuTrack::
+drawRails(bool doingShadows)
+//============================================================================
+{
+	const glm::mat4* M = splineBasis(uploadedType);
+	if (!ready() || !M || !pointCount)
+		return;
+
+	glUseProgram(railProgram);
+	glUniformMatrix4fv(glGetUniformLocation(railProgram, "basis"), 1, GL_FALSE, glm::value_ptr(*M));
+	glUniform1i(glGetUniformLocation(railProgram, "pointCount"), (GLint)pointCount);
+	glUniform1f(glGetUniformLocation(railProgram, "tessLevel"), railTessLevel);
+	glUniform1f(glGetUniformLocation(railProgram, "railOffset"), 2.5f);
+	if (doingShadows)
+		glUniform4f(glGetUniformLocation(railProgram, "color"), 0, 0, 0, .5f);
+	else
+		glUniform4f(glGetUniformLocation(railProgram, "color"), 32 / 255.f, 32 / 255.f, 64 / 255.f, 1);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pointBuffer);
+	glBindVertexArray(emptyVAO);
+	glPatchParameteri(GL_PATCH_VERTICES, 1);
+	glLineWidth(5);
+	glDrawArrays(GL_PATCHES, 0, (GLsizei)pointCount);
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
+
+//****************************************************************************
+//
+// * Draw all the ties in one instanced call
+//============================================================================
+void GpuTrack::
+drawBars(bool doingShadows)
+//============================================================================
+{
+	const glm::mat4* M = splineBasis(uploadedType);
+	if (!ready() || !M || !pointCount || !barCount)
+		return;
+
+	glUseProgram(barProgram);
+	glUniformMatrix4fv(glGetUniformLocation(barProgram, "basis"), 1, GL_FALSE, glm::value_ptr(*M));
+	glUniform1i(glGetUniformLocation(barProgram, "pointCount"), (GLint)pointCount);
+	glUniform1i(glGetUniformLocation(barProgram, "shadow"), doingShadows ? 1 : 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pointBuffer);
+	glBindVertexArray(barVAO);
+	glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, (GLsizei)barCount);
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
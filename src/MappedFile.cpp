@@ -0,0 +1,133 @@
+/************************************************************************
+     File:        MappedFile.cpp
+
+     Comment:     A whole file, mapped into memory to read
+
+						see MappedFile.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.H"
+
+// what an empty file points at
+static const char EMPTY[1] = { 0 };
+
+//****************************************************************************
+//
+// * Constructor - nothing mapped
+//============================================================================
+MappedFile::
+MappedFile()
+	: bytes(0), length(0), opened(false)
+#ifdef _WIN32
+	, file(INVALID_HANDLE_VALUE), mapping(0)
+#else
+	, fd(-1)
+#endif
+//============================================================================
+{
+}
+
+MappedFile::
+~MappedFile()
+{
+	close();
+}
+
+//****************************************************************************
+//
+// * Map the whole file
+//============================================================================
+bool MappedFile::
+open(const char* fname)
+//============================================================================
+{
+	close();
+
+#ifdef _WIN32
+	file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+					   FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		close();
+		return false;
+	}
+	length = (size_t)size.QuadPart;
+	if (length > 0) {
+		mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+		if (mapping)
+			bytes = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!bytes) {
+			close();
+			return false;
+		}
+	}
+#else
+	fd = ::open(fname, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close();
+		return false;
+	}
+	length = (size_t)st.st_size;
+	if (length > 0) {
+		void* p = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			close();
+			return false;
+		}
+		madvise(p, length, MADV_SEQUENTIAL);
+		bytes = (const char*)p;
+	}
+#endif
+
+	if (length == 0)
+		bytes = EMPTY;
+	opened = true;
+	return true;
+}
+
+//****************************************************************************
+//
+// * Let go of the file
+//============================================================================
+void MappedFile::
+close()
+//============================================================================
+{
+	bool mapped = bytes && bytes != EMPTY;
+#ifdef _WIN32
+	if (mapped)
+		UnmapViewOfFile(bytes);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	mapping = 0;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (mapped)
+		munmap((void*)bytes, length);
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+	bytes = 0;
+	length = 0;
+	opened = false;
+}
@@ -0,0 +1,1179 @@
+/************************************************************************
+     File:        MeshExport.cpp
+
+     Comment:     The coaster as triangles, for other programs
+
+						see MeshExport.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <charconv>
+#include <string>
+#include <unordered_map>
+
+#include "MeshExport.H"
+#include "AtomicFile.H"
+#include "RailMesh.H"
+#include "Spline.H"
+#include "ThreadPool.H"
+#include "TrackCache.H"
+
+// the sizes TrainView draws with (drawBar, drawCarts and drawWheel)
+static const float BAR_LENGTH = 7.5f;
+static const float BAR_WIDTH = 1;
+static const float BAR_HEIGHT = 0.5f;
+static const float CART_WIDTH = 4.5f;
+static const float CART_HEIGHT = 6;
+static const float CART_LENGTH = 15;
+static const float WHEEL_RADIUS = 1;
+static const float WHEEL_WIDTH = 0.5f;
+static const int WHEEL_SLICES = 64;
+static const int WHEEL_RINGS = 5;		// stacks of the tire, loops of a hub
+
+static const int PROFILE = RailMesh::PROFILE_VERTS;
+static const size_t FRAMES = TrackCache::FRAMES_PER_SEGMENT;
+
+// the most a .glb can be
+static const uint64_t GLB_MAX = 0xFFFFFFFFu;
+
+// the colors things are drawn in
+enum Material {
+	MAT_RAIL,
+	MAT_TIE,
+	MAT_TIE_TOP,
+	MAT_CART,
+	MAT_CART_TOP,
+	MAT_CART_BACK,
+	MAT_TIRE,
+	MAT_HUB,
+	MAT_SPOKE,
+	MATERIALS
+};
+
+static const struct {
+	const char*		name;
+	unsigned char	r, g, b;
+} MATERIAL[MATERIALS] = {
+	{ "rail",		32,  32,  64 },
+	{ "tie",		255, 255, 255 },
+	{ "tie_top",	255, 0,   0 },
+	{ "cart",		255, 255, 255 },
+	{ "cart_top",	0,   255, 0 },
+	{ "cart_back",	255, 0,   0 },
+	{ "tire",		72,  42,  42 },
+	{ "hub",		255, 255, 255 },
+	{ "spoke",		128, 128, 105 },
+};
+
+// a vertex as the glTF takes it: position and normal, one after the other
+struct Vertex {
+	float p[3];
+	float n[3];
+};
+static_assert(sizeof(Vertex) == 6 * sizeof(float), "a vertex is 6 floats");
+
+// a shape made once and put in many places: its vertices, and its
+// triangles by material
+struct Part {
+	std::vector<Vertex>		verts;
+	std::vector<uint32_t>	tris[MATERIALS];
+
+	size_t triangles() const
+	{
+		size_t n = 0;
+		for (int m = 0; m < MATERIALS; ++m)
+			n += tris[m].size() / 3;
+		return n;
+	}
+};
+
+// where a part goes: the place, and where its axes point
+struct Placement {
+	Pnt3f pos;
+	Pnt3f x, y, z;
+};
+
+//****************************************************************************
+//
+// * A stand-in for the bits of GL the drawing code uses - a matrix stack,
+//   quads, the GLU cylinder and disk - that makes a Part instead. So the
+//   shapes below read the same as the code that draws them
+//============================================================================
+class Sketch {
+	public:
+		explicit Sketch(Part& part) : part(part), material(MAT_RAIL)
+		{
+			Matrix m = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } };
+			stack.push_back(m);
+		}
+
+		void push() { stack.push_back(stack.back()); }
+		void pop() { stack.pop_back(); }
+		void translate(float x, float y, float z);
+		// about a unit axis
+		void rotate(float degrees, float x, float y, float z);
+
+		void color(Material m) { material = m; }
+		void normal(float x, float y, float z) { nx = x; ny = y; nz = z; }
+		// every 4 make a quad
+		void vertex(float x, float y, float z);
+
+		// as gluCylinder (along z, from 0 to h) and gluDisk (at z = 0,
+		// facing +z) make them
+		void cylinder(float r, float h, int slices, int stacks);
+		void disk(float r, int slices, int loops);
+
+	private:
+		struct Matrix {
+			float r0[4], r1[4], r2[4];		// rotation, then translation
+		};
+
+		Vertex make(float x, float y, float z, float nx, float ny, float nz) const;
+		void triangle(const Vertex& a, const Vertex& b, const Vertex& c);
+		uint32_t weld(const Vertex& v);
+
+		// the same place with the same normal is the same vertex
+		struct Key {
+			uint32_t bits[6];
+			bool operator==(const Key& k) const { return !memcmp(bits, k.bits, sizeof(bits)); }
+		};
+		struct KeyHash {
+			size_t operator()(const Key& k) const
+			{
+				uint64_t h = 1469598103934665603ull;
+				for (int i = 0; i < 6; ++i)
+					h = (h ^ k.bits[i]) * 1099511628211ull;
+				return (size_t)h;
+			}
+		};
+
+		Part&								part;
+		std::vector<Matrix>					stack;
+		Material							material;
+		float								nx, ny, nz;
+		Vertex								quad[4];
+		int									quadVerts = 0;
+		std::unordered_map<Key, uint32_t, KeyHash>	seen;
+};
+
+void Sketch::
+translate(float x, float y, float z)
+{
+	Matrix& m = stack.back();
+	float* row[3] = { m.r0, m.r1, m.r2 };
+	for (int i = 0; i < 3; ++i)
+		row[i][3] += row[i][0] * x + row[i][1] * y + row[i][2] * z;
+}
+
+void Sketch::
+rotate(float degrees, float x, float y, float z)
+{
+	float a = degrees * 3.14159265358979f / 180;
+	float c = cosf(a), s = sinf(a), t = 1 - c;
+	const float r[3][3] = {
+		{ t * x * x + c,	 t * x * y - s * z, t * x * z + s * y },
+		{ t * x * y + s * z, t * y * y + c,	    t * y * z - s * x },
+		{ t * x * z - s * y, t * y * z + s * x, t * z * z + c }
+	};
+	Matrix& m = stack.back();
+	float* row[3] = { m.r0, m.r1, m.r2 };
+	for (int i = 0; i < 3; ++i) {
+		float old[3] = { row[i][0], row[i][1], row[i][2] };
+		for (int j = 0; j < 3; ++j)
+			row[i][j] = old[0] * r[0][j] + old[1] * r[1][j] + old[2] * r[2][j];
+	}
+}
+
+Vertex Sketch::
+make(float x, float y, float z, float nx, float ny, float nz) const
+{
+	const Matrix& m = stack.back();
+	const float* row[3] = { m.r0, m.r1, m.r2 };
+	Vertex v;
+	for (int i = 0; i < 3; ++i) {
+		v.p[i] = row[i][0] * x + row[i][1] * y + row[i][2] * z + row[i][3];
+		v.n[i] = row[i][0] * nx + row[i][1] * ny + row[i][2] * nz;
+	}
+	// the normals are unit length - only a rounding away from it
+	float l = sqrtf(v.n[0] * v.n[0] + v.n[1] * v.n[1] + v.n[2] * v.n[2]);
+	for (int i = 0; l > 0 && i < 3; ++i)
+		v.n[i] /= l;
+	return v;
+}
+
+void Sketch::
+vertex(float x, float y, float z)
+{
+	quad[quadVerts++] = make(x, y, z, nx, ny, nz);
+	if (quadVerts == 4) {
+		triangle(quad[0], quad[1], quad[2]);
+		triangle(quad[0], quad[2], quad[3]);
+		quadVerts = 0;
+	}
+}
+
+void Sketch::
+cylinder(float r, float h, int slices, int stacks)
+{
+	for (int j = 0; j < stacks; ++j) {
+		float z0 = h * j / stacks, z1 = h * (j + 1) / stacks;
+		for (int i = 0; i < slices; ++i) {
+			// the last slice ends where the first starts, exactly
+			float a0 = 2 * 3.14159265358979f * i / slices;
+			float a1 = 2 * 3.14159265358979f * ((i + 1) % slices) / slices;
+			float s0 = sinf(a0), c0 = cosf(a0), s1 = sinf(a1), c1 = cosf(a1);
+			Vertex a = make(r * s0, r * c0, z0, s0, c0, 0);
+			Vertex b = make(r * s1, r * c1, z0, s1, c1, 0);
+			Vertex c = make(r * s1, r * c1, z1, s1, c1, 0);
+			Vertex d = make(r * s0, r * c0, z1, s0, c0, 0);
+			triangle(a, b, c);
+			triangle(a, c, d);
+		}
+	}
+}
+
+void Sketch::
+disk(float r, int slices, int loops)
+{
+	for (int j = 0; j < loops; ++j) {
+		float r0 = r * j / loops, r1 = r * (j + 1) / loops;
+		for (int i = 0; i < slices; ++i) {
+			float a0 = 2 * 3.14159265358979f * i / slices;
+			float a1 = 2 * 3.14159265358979f * ((i + 1) % slices) / slices;
+			float s0 = sinf(a0), c0 = cosf(a0), s1 = sinf(a1), c1 = cosf(a1);
+			Vertex a = make(r0 * s0, r0 * c0, 0, 0, 0, 1);
+			Vertex b = make(r0 * s1, r0 * c1, 0, 0, 0, 1);
+			Vertex c = make(r1 * s1, r1 * c1, 0, 0, 0, 1);
+			Vertex d = make(r1 * s0, r1 * c0, 0, 0, 0, 1);
+			triangle(a, b, c);
+			triangle(a, c, d);
+		}
+	}
+}
+
+//****************************************************************************
+//
+// * The drawing code doesn't care which way round a quad goes (nothing is
+//   culled) - a file does, so every triangle is turned to face the way
+//   its normals point. One with no area (the middle of a disk) is left out
+//============================================================================
+void Sketch::
+triangle(const Vertex& a, const Vertex& b, const Vertex& c)
+//============================================================================
+{
+	uint32_t ia = weld(a), ib = weld(b), ic = weld(c);
+	if (ia == ib || ib == ic || ia == ic)
+		return;
+	float e1[3], e2[3], n[3];
+	for (int i = 0; i < 3; ++i) {
+		e1[i] = b.p[i] - a.p[i];
+		e2[i] = c.p[i] - a.p[i];
+		n[i] = a.n[i] + b.n[i] + c.n[i];
+	}
+	float f[3] = { e1[1] * e2[2] - e1[2] * e2[1],
+				   e1[2] * e2[0] - e1[0] * e2[2],
+				   e1[0] * e2[1] - e1[1] * e2[0] };
+	std::vector<uint32_t>& tris = part.tris[material];
+	tris.push_back(ia);
+	if (f[0] * n[0] + f[1] * n[1] + f[2] * n[2] >= 0) {
+		tris.push_back(ib);
+		tris.push_back(ic);
+	}
+	else {
+		tris.push_back(ic);
+		tris.push_back(ib);
+	}
+}
+
+uint32_t Sketch::
+weld(const Vertex& v)
+{
+	Key key;
+	memcpy(key.bits, &v, sizeof(key.bits));
+	auto found = seen.find(key);
+	if (found != seen.end())
+		return found->second;
+	uint32_t i = (uint32_t)part.verts.size();
+	part.verts.push_back(v);
+	seen.emplace(key, i);
+	return i;
+}
+
+//****************************************************************************
+//
+// * The tie, as drawBar draws it once the matrix is on the track
+//============================================================================
+static void makeTie(Part& part)
+//============================================================================
+{
+	const float l = BAR_LENGTH / 2, w = BAR_WIDTH / 2, h = BAR_HEIGHT / 2;
+	Sketch s(part);
+	s.rotate(90, 0, 1, 0);
+	s.translate(0, -BAR_HEIGHT, 0);
+
+	s.color(MAT_TIE);
+	s.normal(0, -1, 0);
+	s.vertex(-l, -h, -w); s.vertex(-l, -h, w); s.vertex(l, -h, w); s.vertex(l, -h, -w);
+	s.normal(-1, 0, 0);
+	s.vertex(-l, h, -w); s.vertex(-l, h, w); s.vertex(-l, -h, w); s.vertex(-l, -h, -w);
+	s.normal(1, 0, 0);
+	s.vertex(l, h, -w); s.vertex(l, h, w); s.vertex(l, -h, w); s.vertex(l, -h, -w);
+	s.normal(0, 0, -1);
+	s.vertex(-l, -h, -w); s.vertex(-l, h, -w); s.vertex(l, h, -w); s.vertex(l, -h, -w);
+	s.normal(0, 0, 1);
+	s.vertex(-l, -h, w); s.vertex(-l, h, w); s.vertex(l, h, w); s.vertex(l, -h, w);
+
+	s.color(MAT_TIE_TOP);
+	s.normal(0, 1, 0);
+	s.vertex(-l, h, -w); s.vertex(-l, h, w); s.vertex(l, h, w); s.vertex(l, h, -w);
+}
+
+//****************************************************************************
+//
+// * A wheel and a cart, as drawWheel and drawCarts draw them (the wheels
+//   turned to where they start)
+//============================================================================
+static void spokes(Sketch& s, float z)
+//============================================================================
+{
+	const float r = WHEEL_RADIUS;
+	s.color(MAT_SPOKE);
+	for (int i = 0; i < 4; ++i) {
+		s.rotate(45, 0, 0, 1);
+		s.normal(0, 0, 1);
+		s.vertex(-0.1f, r, z); s.vertex(0.1f, r, z); s.vertex(0.1f, -r, z); s.vertex(-0.1f, -r, z);
+	}
+}
+
+static void wheel(Sketch& s)
+{
+	s.rotate(90, 0, 1, 0);
+	s.color(MAT_TIRE);
+	s.cylinder(WHEEL_RADIUS, WHEEL_WIDTH, WHEEL_SLICES, WHEEL_RINGS);
+
+	s.push();
+	s.translate(0, 0, WHEEL_WIDTH - 0.01f);
+	s.color(MAT_HUB);
+	s.disk(WHEEL_RADIUS, WHEEL_SLICES, WHEEL_RINGS);
+	spokes(s, 0.01f);
+	s.pop();
+
+	s.push();
+	s.color(MAT_HUB);
+	s.disk(WHEEL_RADIUS, WHEEL_SLICES, WHEEL_RINGS);
+	spokes(s, -0.01f);
+	s.pop();
+}
+
+static void makeCart(Part& part)
+{
+	const float x = CART_WIDTH / 2, y = CART_HEIGHT / 2, z = CART_LENGTH / 2;
+	Sketch s(part);
+	s.rotate(90, 0, 1, 0);
+	s.translate(0, y + WHEEL_RADIUS, 0);
+
+	s.color(MAT_CART);
+	s.normal(0, -1, 0);
+	s.vertex(-x, -y, -z); s.vertex(x, -y, -z); s.vertex(x, -y, z); s.vertex(-x, -y, z);
+	s.normal(-1, 0, 0);
+	s.vertex(-x, -y, -z); s.vertex(-x, y, -z); s.vertex(-x, y, z); s.vertex(-x, -y, z);
+	s.normal(1, 0, 0);
+	s.vertex(x, -y, -z); s.vertex(x, y, -z); s.vertex(x, y, z); s.vertex(x, -y, z);
+	s.normal(0, 0, -1);
+	s.vertex(-x, -y, -z); s.vertex(x, -y, -z); s.vertex(x, y, -z); s.vertex(-x, y, -z);
+	s.color(MAT_CART_TOP);
+	s.normal(0, 1, 0);
+	s.vertex(-x, y, -z); s.vertex(x, y, -z); s.vertex(x, y, z); s.vertex(-x, y, z);
+	s.color(MAT_CART_BACK);
+	s.normal(0, 0, 1);
+	s.vertex(-x, -y, z); s.vertex(x, -y, z); s.vertex(x, y, z); s.vertex(-x, y, z);
+
+	// three wheels a side
+	const float along[3] = { z - 2, 0, -z + 2 };
+	const float side[2] = { x, -x - WHEEL_WIDTH };
+	for (int i = 0; i < 2; ++i)
+		for (int j = 0; j < 3; ++j) {
+			s.push();
+			s.translate(side[i], -y, along[j]);
+			wheel(s);
+			s.pop();
+		}
+}
+
+//****************************************************************************
+//
+// * Where a part goes on the track, as drawBar and drawCarts turn the GL
+//   matrix - the side (z) is across the direction and up
+//============================================================================
+static Placement place(const Pnt3f& pos, const Pnt3f& dir, const Pnt3f& up)
+//============================================================================
+{
+	Placement p;
+	p.pos = pos;
+	p.x = dir;
+	p.x.normalize();
+	p.z = p.x * up;
+	// straight up or down: any side will do
+	if (p.z.x * p.z.x + p.z.y * p.z.y + p.z.z * p.z.z < 1e-12f)
+		p.z = p.x * ((fabsf(p.x.x) < 0.9f) ? Pnt3f(1, 0, 0) : Pnt3f(0, 0, 1));
+	p.z.normalize();
+	p.y = p.z * p.x;
+	p.y.normalize();
+	return p;
+}
+
+static Vertex placed(const Placement& at, const Vertex& v)
+{
+	Vertex out;
+	for (int i = 0; i < 3; ++i) {
+		float px = (i == 0) ? at.x.x : (i == 1) ? at.x.y : at.x.z;
+		float py = (i == 0) ? at.y.x : (i == 1) ? at.y.y : at.y.z;
+		float pz = (i == 0) ? at.z.x : (i == 1) ? at.z.y : at.z.z;
+		float o = (i == 0) ? at.pos.x : (i == 1) ? at.pos.y : at.pos.z;
+		out.p[i] = o + px * v.p[0] + py * v.p[1] + pz * v.p[2];
+		out.n[i] = px * v.n[0] + py * v.n[1] + pz * v.n[2];
+	}
+	return out;
+}
+
+// the rotation of a placement, as a unit quaternion (x, y, z, w)
+static void rotationOf(const Placement& at, float q[4])
+{
+	const float m00 = at.x.x, m10 = at.x.y, m20 = at.x.z;
+	const float m01 = at.y.x, m11 = at.y.y, m21 = at.y.z;
+	const float m02 = at.z.x, m12 = at.z.y, m22 = at.z.z;
+	float trace = m00 + m11 + m22;
+	if (trace > 0) {
+		float s = sqrtf(trace + 1) * 2;
+		q[3] = s / 4;
+		q[0] = (m21 - m12) / s;
+		q[1] = (m02 - m20) / s;
+		q[2] = (m10 - m01) / s;
+	}
+	else if (m00 > m11 && m00 > m22) {
+		float s = sqrtf(1 + m00 - m11 - m22) * 2;
+		q[3] = (m21 - m12) / s;
+		q[0] = s / 4;
+		q[1] = (m01 + m10) / s;
+		q[2] = (m02 + m20) / s;
+	}
+	else if (m11 > m22) {
+		float s = sqrtf(1 + m11 - m00 - m22) * 2;
+		q[3] = (m02 - m20) / s;
+		q[0] = (m01 + m10) / s;
+		q[1] = s / 4;
+		q[2] = (m12 + m21) / s;
+	}
+	else {
+		float s = sqrtf(1 + m22 - m00 - m11) * 2;
+		q[3] = (m10 - m01) / s;
+		q[0] = (m02 + m20) / s;
+		q[1] = (m12 + m21) / s;
+		q[2] = s / 4;
+	}
+	float l = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	for (int i = 0; i < 4; ++i)
+		q[i] /= l;
+}
+
+//****************************************************************************
+//
+// * The rails. There is a ring of vertices for each rail at every frame,
+//   numbered along the whole track: frame f of segment s is ring
+//   s * FRAMES + f, and the last frame of a segment is the first of the
+//   next - so it is written once. Segment s writes rings firstRing(s) up
+//   to endRing(s): the first segment its first one too, the last one not
+//   its last (it is ring 0). Every ring a segment's triangles use is
+//   written by then
+//============================================================================
+static size_t firstRing(size_t s)
+//============================================================================
+{
+	return s ? s * FRAMES + 1 : 0;
+}
+
+static size_t endRing(size_t s, size_t segs)
+{
+	return (s + 1 == segs) ? segs * FRAMES : s * FRAMES + FRAMES + 1;
+}
+
+static uint64_t railVertex(size_t ring, int rail, int k)
+{
+	return ((uint64_t)ring * 2 + rail) * PROFILE + k;
+}
+
+// the circle of the cross-section
+struct Profile {
+	float c[PROFILE], s[PROFILE];
+
+	Profile()
+	{
+		// as RailMesh::buildSegment makes it
+		for (int k = 0; k < PROFILE; ++k) {
+			float a = 2.0f * 3.14159265f * k / PROFILE;
+			c[k] = cos(a);
+			s[k] = sin(a);
+		}
+	}
+};
+static const Profile profile;
+
+// the frames and ties of segment s: the cache's, or - for a segment
+// outside its window, on a track longer than TrackCache::WINDOW -
+// sampled here, and only kept as long as this is
+struct Tables {
+	const std::vector<TrackFrame>*	frames;
+	const std::vector<TrackFrame>*	ties;
+	std::vector<TrackFrame>			sampledFrames;
+	std::vector<TrackFrame>			sampledTies;
+
+	Tables(const TrackCache& cache, const std::vector<ControlPoint>& points, size_t s)
+	{
+		if (cache.resident(s)) {
+			frames = &cache.frames(s);
+			ties = &cache.ties(s);
+			return;
+		}
+		cache.sampleSegment(points, s, sampledFrames, sampledTies);
+		frames = &sampledFrames;
+		ties = &sampledTies;
+	}
+};
+
+// the rings segment s writes - the same places RailMesh::buildSegment
+// puts them, with the normals kept as floats
+static void railRings(const TrackCache& cache, const std::vector<ControlPoint>& points,
+					  size_t s, std::vector<Vertex>& out)
+{
+	Tables tables(cache, points, s);
+	const std::vector<TrackFrame>& frames = *tables.frames;
+	size_t first = firstRing(s), end = endRing(s, cache.segmentCount());
+	out.resize((end - first) * 2 * PROFILE);
+	Vertex* v = out.data();
+	for (size_t ring = first; ring < end; ++ring) {
+		const TrackFrame& fr = frames[ring - s * FRAMES];
+		for (int r = 0; r < 2; ++r) {
+			float side = (r == 0) ? -RailMesh::RAIL_OFFSET : RailMesh::RAIL_OFFSET;
+			for (int k = 0; k < PROFILE; ++k, ++v) {
+				Pnt3f n = fr.cross * profile.c[k] + fr.up * profile.s[k];
+				Pnt3f p = fr.pos + fr.cross * side + n * RailMesh::PROFILE_RADIUS;
+				n.normalize();
+				v->p[0] = p.x; v->p[1] = p.y; v->p[2] = p.z;
+				v->n[0] = n.x; v->n[1] = n.y; v->n[2] = n.z;
+			}
+		}
+	}
+}
+
+// and its triangles - two for each side of the profile between frames
+static const size_t RAIL_TRIANGLES = 2 * 2 * PROFILE * FRAMES;
+
+template<class Put>
+static void railTriangles(size_t s, size_t segs, Put put)
+{
+	const size_t rings = segs * FRAMES;
+	for (size_t f = 0; f < FRAMES; ++f) {
+		size_t ring0 = s * FRAMES + f;
+		size_t ring1 = (ring0 + 1) % rings;
+		for (int r = 0; r < 2; ++r)
+			for (int k = 0; k < PROFILE; ++k) {
+				int k1 = (k + 1) % PROFILE;
+				uint64_t a = railVertex(ring0, r, k), b = railVertex(ring0, r, k1);
+				uint64_t c = railVertex(ring1, r, k), d = railVertex(ring1, r, k1);
+				// going round the profile one way and along the track makes
+				// the outside the front
+				put(a, c, b);
+				put(b, c, d);
+			}
+	}
+}
+
+//****************************************************************************
+//
+// * Everything both files need
+//============================================================================
+struct Scene {
+	const TrackCache&		cache;
+	const std::vector<ControlPoint>& points;
+	const MeshExportOptions& options;
+	ThreadPool&				pool;
+	size_t					segs;
+	size_t					railVerts;
+	std::vector<size_t>		tieStart;	// the first tie of each segment, and the count
+	size_t					ties;
+	Part					tie;
+	Part					cart;
+	std::vector<Placement>	carts;
+
+	Scene(const TrackCache& cache, const std::vector<ControlPoint>& points,
+		  const MeshExportOptions& options, ThreadPool& pool)
+		: cache(cache), points(points), options(options), pool(pool), segs(0), railVerts(0),
+		  ties(0) {}
+};
+
+static bool littleEndian()
+{
+	const uint32_t one = 1;
+	return *(const unsigned char*)&one == 1;
+}
+
+//****************************************************************************
+//
+// * Make what each segment writes a chunk at a time (the segments of a
+//   chunk at the same time), and write it out in order - the next chunk
+//   is made while this one is written
+//============================================================================
+template<class Make>
+static bool writeSegments(Scene& scene, AtomicFile& file, Make make, bool words = false)
+//============================================================================
+{
+	size_t chunk = scene.options.chunk ? scene.options.chunk : 1;
+	size_t most = (chunk < scene.segs) ? chunk : scene.segs;
+	std::vector<std::vector<char> > pieces[2] = { std::vector<std::vector<char> >(most),
+												  std::vector<std::vector<char> >(most) };
+	auto makeChunk = [&](size_t from, std::vector<std::vector<char> >& out) {
+		size_t to = (scene.segs - from > chunk) ? from + chunk : scene.segs;
+		scene.pool.parallelFor(from, to, [&](size_t s) {
+			std::vector<char>& piece = out[s - from];
+			piece.clear();
+			make(s, piece);
+			// the binary file is little-endian, whatever the machine
+			if (words && !littleEndian())
+				for (size_t i = 0; i + 4 <= piece.size(); i += 4) {
+					std::swap(piece[i], piece[i + 3]);
+					std::swap(piece[i + 1], piece[i + 2]);
+				}
+		});
+	};
+
+	if (scene.segs)
+		makeChunk(0, pieces[0]);
+	TaskGroup making(scene.pool);
+	for (size_t from = 0, which = 0; from < scene.segs; from += chunk, which ^= 1) {
+		size_t to = (scene.segs - from > chunk) ? from + chunk : scene.segs;
+		if (to < scene.segs)
+			making.run([&, to, which]() { makeChunk(to, pieces[which ^ 1]); });
+		for (size_t s = from; s < to; ++s)
+			if (!file.write(pieces[which][s - from].data(), pieces[which][s - from].size()))
+				return false;
+		making.wait();
+	}
+	return true;
+}
+
+template<class T>
+static void putWords(std::vector<char>& out, const T* data, size_t count)
+{
+	const char* p = (const char*)data;
+	out.insert(out.end(), p, p + count * sizeof(T));
+}
+
+static bool writeWords(AtomicFile& file, const void* data, size_t words)
+{
+	if (littleEndian())
+		return file.write(data, words * 4);
+	std::vector<char> copy((const char*)data, (const char*)data + words * 4);
+	for (size_t i = 0; i < copy.size(); i += 4) {
+		std::swap(copy[i], copy[i + 3]);
+		std::swap(copy[i + 1], copy[i + 2]);
+	}
+	return file.write(copy.data(), copy.size());
+}
+
+//****************************************************************************
+//
+// * OBJ - text, each number in the fewest digits that read back the same
+//============================================================================
+static void putText(std::vector<char>& out, const char* s)
+//============================================================================
+{
+	out.insert(out.end(), s, s + strlen(s));
+}
+
+static void putVertex(std::vector<char>& out, const Vertex& v)
+{
+	char line[128];
+	char* end = line + sizeof(line);
+	char* p = line;
+	*p++ = 'v';
+	for (int i = 0; i < 3; ++i) {
+		*p++ = ' ';
+		p = std::to_chars(p, end, v.p[i]).ptr;
+	}
+	*p++ = '\n';
+	*p++ = 'v';
+	*p++ = 'n';
+	for (int i = 0; i < 3; ++i) {
+		*p++ = ' ';
+		p = std::to_chars(p, end, v.n[i]).ptr;
+	}
+	*p++ = '\n';
+	out.insert(out.end(), line, p);
+}
+
+// vertex and normal i are written together, so a corner is "i//i"
+static void putFace(std::vector<char>& out, uint64_t a, uint64_t b, uint64_t c)
+{
+	char line[160];
+	char* p = line;
+	*p++ = 'f';
+	const uint64_t corner[3] = { a + 1, b + 1, c + 1 };
+	for (int i = 0; i < 3; ++i) {
+		char number[24];
+		size_t n = std::to_chars(number, number + sizeof(number), corner[i]).ptr - number;
+		*p++ = ' ';
+		memcpy(p, number, n);
+		p += n;
+		*p++ = '/';
+		*p++ = '/';
+		memcpy(p, number, n);
+		p += n;
+	}
+	*p++ = '\n';
+	out.insert(out.end(), line, p);
+}
+
+// a part, placed at each of at - first all the vertices, then the
+// triangles a material at a time. base is the number of the first vertex
+static void putParts(std::vector<char>& out, const Part& part, const Placement* at,
+					 size_t count, uint64_t base)
+{
+	for (size_t i = 0; i < count; ++i)
+		for (size_t v = 0; v < part.verts.size(); ++v)
+			putVertex(out, placed(at[i], part.verts[v]));
+	for (int m = 0; m < MATERIALS; ++m) {
+		const std::vector<uint32_t>& tris = part.tris[m];
+		if (tris.empty() || !count)
+			continue;
+		putText(out, "usemtl ");
+		putText(out, MATERIAL[m].name);
+		putText(out, "\n");
+		for (size_t i = 0; i < count; ++i) {
+			uint64_t b = base + i * part.verts.size();
+			for (size_t t = 0; t < tris.size(); t += 3)
+				putFace(out, b + tris[t], b + tris[t + 1], b + tris[t + 2]);
+		}
+	}
+}
+
+static void tiePlacements(const TrackCache& cache, const std::vector<ControlPoint>& points,
+						  size_t s, std::vector<Placement>& out)
+{
+	Tables tables(cache, points, s);
+	const std::vector<TrackFrame>& ties = *tables.ties;
+	out.resize(ties.size());
+	for (size_t i = 0; i < ties.size(); ++i)
+		out[i] = place(ties[i].pos, ties[i].dir, ties[i].up);
+}
+
+static bool writeObj(const char* fname, Scene& scene, MeshExportStats& stats,
+					 const char*& error)
+{
+	// the materials go next to it, under the same name
+	std::string mtl = fname;
+	mtl = mtl.substr(0, mtl.size() - 4) + ".mtl";
+	size_t slash = mtl.find_last_of("/\\");
+	std::string mtlName = (slash == std::string::npos) ? mtl : mtl.substr(slash + 1);
+
+	std::vector<char> text;
+	for (int m = 0; m < MATERIALS; ++m) {
+		char line[160];
+		snprintf(line, sizeof(line), "newmtl %s\nKd %.4f %.4f %.4f\nillum 1\n\n", MATERIAL[m].name,
+				 MATERIAL[m].r / 255.0f, MATERIAL[m].g / 255.0f, MATERIAL[m].b / 255.0f);
+		putText(text, line);
+	}
+	AtomicFile file;
+	if (!file.open(mtl.c_str()) || !file.write(text.data(), text.size()) || !file.commit()) {
+		error = "Can't write the materials (.mtl) file";
+		return false;
+	}
+
+	if (!file.open(fname)) {
+		error = "Can't write the file";
+		return false;
+	}
+	text.clear();
+	char line[200];
+	snprintf(line, sizeof(line), "# a roller coaster: %u segments, %u ties, %u carts\nmtllib %s\n",
+			 (unsigned)scene.segs, (unsigned)scene.ties, (unsigned)scene.carts.size(), mtlName.c_str());
+	putText(text, line);
+	bool ok = file.write(text.data(), text.size());
+
+	const size_t segs = scene.segs;
+	if (ok && scene.options.rails) {
+		ok = file.write("o rails\nusemtl rail\n", 20) &&
+			writeSegments(scene, file, [&](size_t s, std::vector<char>& out) {
+				std::vector<Vertex> rings;
+				railRings(scene.cache, scene.points, s, rings);
+				for (size_t i = 0; i < rings.size(); ++i)
+					putVertex(out, rings[i]);
+				railTriangles(s, segs, [&](uint64_t a, uint64_t b, uint64_t c) {
+					putFace(out, a, b, c);
+				});
+			});
+		stats.vertices += scene.railVerts;
+		stats.triangles += segs * RAIL_TRIANGLES;
+	}
+	if (ok && scene.options.ties) {
+		uint64_t base = scene.railVerts;
+		ok = file.write("o ties\n", 7) &&
+			writeSegments(scene, file, [&](size_t s, std::vector<char>& out) {
+				std::vector<Placement> at;
+				tiePlacements(scene.cache, scene.points, s, at);
+				putParts(out, scene.tie, at.data(), at.size(),
+						 base + scene.tieStart[s] * scene.tie.verts.size());
+			});
+		stats.vertices += scene.ties * scene.tie.verts.size();
+		stats.triangles += scene.ties * scene.tie.triangles();
+	}
+	uint64_t base = stats.vertices;
+	for (size_t c = 0; ok && c < scene.carts.size(); ++c) {
+		text.clear();
+		snprintf(line, sizeof(line), "o cart%u\n", (unsigned)(c + 1));
+		putText(text, line);
+		putParts(text, scene.cart, &scene.carts[c], 1, base);
+		ok = file.write(text.data(), text.size());
+		base += scene.cart.verts.size();
+		stats.vertices += scene.cart.verts.size();
+		stats.triangles += scene.cart.triangles();
+	}
+
+	if (!ok || !file.commit()) {
+		file.abandon();
+		error = "Can't write the file";
+		return false;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * glTF - the JSON says where everything is in the binary chunk, so all
+//   the sizes (and the bounds of the positions, which it has to give) are
+//   worked out first
+//============================================================================
+static void addf(std::string& s, const char* format, ...)
+//============================================================================
+{
+	char buffer[512];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	s += buffer;
+}
+
+// the JSON, an array at a time
+struct Gltf {
+	std::string		views, accessors, meshes, nodes;
+	int				viewCount = 0, accessorCount = 0, meshCount = 0, nodeCount = 0;
+	uint64_t		binSize = 0;
+
+	static void comma(std::string& s) { if (!s.empty()) s += ","; }
+
+	// size bytes of the binary chunk, next after the last
+	int view(uint64_t size, int stride, int target)
+	{
+		comma(views);
+		addf(views, "{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%llu",
+			 (unsigned long long)binSize, (unsigned long long)size);
+		if (stride)
+			addf(views, ",\"byteStride\":%d", stride);
+		if (target)
+			addf(views, ",\"target\":%d", target);
+		views += "}";
+		binSize += size;
+		return viewCount++;
+	}
+
+	int accessor(int view, uint64_t offset, int type, uint64_t count, const char* shape,
+				 const float* min = 0, const float* max = 0)
+	{
+		comma(accessors);
+		addf(accessors, "{\"bufferView\":%d,\"byteOffset\":%llu,\"componentType\":%d,"
+			 "\"count\":%llu,\"type\":\"%s\"", view, (unsigned long long)offset, type,
+			 (unsigned long long)count, shape);
+		if (min)
+			addf(accessors, ",\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]",
+				 min[0], min[1], min[2], max[0], max[1], max[2]);
+		accessors += "}";
+		return accessorCount++;
+	}
+
+	// a part's vertices and triangles: views, accessors and a mesh of a
+	// primitive per material
+	int mesh(const char* name, const Part& part)
+	{
+		float lo[3], hi[3];
+		bounds(part.verts.data(), part.verts.size(), lo, hi);
+		int vv = view(part.verts.size() * sizeof(Vertex), sizeof(Vertex), 34962);
+		int position = accessor(vv, 0, 5126, part.verts.size(), "VEC3", lo, hi);
+		int normal = accessor(vv, 12, 5126, part.verts.size(), "VEC3");
+		int iv = view(part.triangles() * 12, 0, 34963);
+		comma(meshes);
+		addf(meshes, "{\"name\":\"%s\",\"primitives\":[", name);
+		uint64_t offset = 0;
+		bool first = true;
+		for (int m = 0; m < MATERIALS; ++m) {
+			if (part.tris[m].empty())
+				continue;
+			int index = accessor(iv, offset, 5125, part.tris[m].size(), "SCALAR");
+			addf(meshes, "%s{\"attributes\":{\"POSITION\":%d,\"NORMAL\":%d},\"indices\":%d,\"material\":%d}",
+				 first ? "" : ",", position, normal, index, m);
+			offset += part.tris[m].size() * 4;
+			first = false;
+		}
+		meshes += "]}";
+		return meshCount++;
+	}
+
+	static void bounds(const Vertex* v, size_t n, float* lo, float* hi)
+	{
+		for (int i = 0; i < 3; ++i) {
+			lo[i] = n ? v[0].p[i] : 0;
+			hi[i] = lo[i];
+		}
+		for (size_t j = 0; j < n; ++j)
+			for (int i = 0; i < 3; ++i) {
+				lo[i] = (v[j].p[i] < lo[i]) ? v[j].p[i] : lo[i];
+				hi[i] = (v[j].p[i] > hi[i]) ? v[j].p[i] : hi[i];
+			}
+	}
+};
+
+// a part's vertices, then its triangles a material at a time
+static bool writePart(AtomicFile& file, const Part& part)
+{
+	bool ok = writeWords(file, part.verts.data(), part.verts.size() * 6);
+	for (int m = 0; ok && m < MATERIALS; ++m)
+		ok = writeWords(file, part.tris[m].data(), part.tris[m].size());
+	return ok;
+}
+
+static bool writeGlb(const char* fname, Scene& scene, MeshExportStats& stats,
+					 const char*& error)
+{
+	const size_t segs = scene.segs;
+	Gltf gltf;
+	std::string nodes;
+	bool rails = scene.options.rails && segs > 0;
+	bool ties = scene.options.ties && scene.ties > 0;
+	bool carts = !scene.carts.empty();
+
+	if (rails) {
+		// the bounds of the rails - a pass over them first
+		std::vector<float> box(segs * 6);
+		scene.pool.parallelFor(0, segs, [&](size_t s) {
+			std::vector<Vertex> rings;
+			railRings(scene.cache, scene.points, s, rings);
+			Gltf::bounds(rings.data(), rings.size(), &box[s * 6], &box[s * 6 + 3]);
+		}, 16);
+		float lo[3], hi[3];
+		for (int i = 0; i < 3; ++i) {
+			lo[i] = box[i];
+			hi[i] = box[3 + i];
+			for (size_t s = 1; s < segs; ++s) {
+				lo[i] = (box[s * 6 + i] < lo[i]) ? box[s * 6 + i] : lo[i];
+				hi[i] = (box[s * 6 + 3 + i] > hi[i]) ? box[s * 6 + 3 + i] : hi[i];
+			}
+		}
+		int vv = gltf.view((uint64_t)scene.railVerts * sizeof(Vertex), sizeof(Vertex), 34962);
+		int position = gltf.accessor(vv, 0, 5126, scene.railVerts, "VEC3", lo, hi);
+		int normal = gltf.accessor(vv, 12, 5126, scene.railVerts, "VEC3");
+		int iv = gltf.view((uint64_t)segs * RAIL_TRIANGLES * 12, 0, 34963);
+		int index = gltf.accessor(iv, 0, 5125, (uint64_t)segs * RAIL_TRIANGLES * 3, "SCALAR");
+		addf(gltf.meshes, "{\"name\":\"rails\",\"primitives\":[{\"attributes\":{\"POSITION\":%d,"
+			 "\"NORMAL\":%d},\"indices\":%d,\"material\":%d}]}", position, normal, index, MAT_RAIL);
+		Gltf::comma(gltf.nodes);
+		addf(gltf.nodes, "{\"name\":\"rails\",\"mesh\":%d}", gltf.meshCount++);
+		gltf.nodeCount++;
+		stats.vertices += scene.railVerts;
+		stats.triangles += segs * RAIL_TRIANGLES;
+	}
+	if (ties) {
+		int mesh = gltf.mesh("tie", scene.tie);
+		int tv = gltf.view((uint64_t)scene.ties * 12, 0, 0);
+		int translation = gltf.accessor(tv, 0, 5126, scene.ties, "VEC3");
+		int rv = gltf.view((uint64_t)scene.ties * 16, 0, 0);
+		int rotation = gltf.accessor(rv, 0, 5126, scene.ties, "VEC4");
+		Gltf::comma(gltf.nodes);
+		addf(gltf.nodes, "{\"name\":\"ties\",\"mesh\":%d,\"extensions\":{\"EXT_mesh_gpu_instancing\":"
+			 "{\"attributes\":{\"TRANSLATION\":%d,\"ROTATION\":%d}}}}", mesh, translation, rotation);
+		gltf.nodeCount++;
+		stats.vertices += scene.tie.verts.size();
+		stats.triangles += scene.ties * scene.tie.triangles();
+	}
+	if (carts) {
+		int mesh = gltf.mesh("cart", scene.cart);
+		for (size_t c = 0; c < scene.carts.size(); ++c) {
+			float q[4];
+			rotationOf(scene.carts[c], q);
+			const Pnt3f& p = scene.carts[c].pos;
+			Gltf::comma(gltf.nodes);
+			addf(gltf.nodes, "{\"name\":\"cart%u\",\"mesh\":%d,\"translation\":[%.9g,%.9g,%.9g],"
+				 "\"rotation\":[%.9g,%.9g,%.9g,%.9g]}", (unsigned)(c + 1), mesh,
+				 p.x, p.y, p.z, q[0], q[1], q[2], q[3]);
+			gltf.nodeCount++;
+		}
+		stats.vertices += scene.cart.verts.size();
+		stats.triangles += scene.carts.size() * scene.cart.triangles();
+	}
+
+	std::string json = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"RollerCoasters\"}";
+	if (ties)
+		json += ",\"extensionsUsed\":[\"EXT_mesh_gpu_instancing\"]";
+	json += ",\"scene\":0,\"scenes\":[{\"nodes\":[";
+	for (int i = 0; i < gltf.nodeCount; ++i)
+		addf(json, "%s%d", i ? "," : "", i);
+	json += "]}],\"nodes\":[" + gltf.nodes + "]";
+	if (gltf.meshCount)
+		json += ",\"meshes\":[" + gltf.meshes + "]";
+	if (gltf.accessorCount)
+		json += ",\"accessors\":[" + gltf.accessors + "],\"bufferViews\":[" + gltf.views + "]";
+	if (gltf.binSize)
+		addf(json, ",\"buffers\":[{\"byteLength\":%llu}]", (unsigned long long)gltf.binSize);
+	json += ",\"materials\":[";
+	for (int m = 0; m < MATERIALS; ++m) {
+		// the colors are sRGB, the glTF wants them linear
+		float c[3] = { MATERIAL[m].r / 255.0f, MATERIAL[m].g / 255.0f, MATERIAL[m].b / 255.0f };
+		for (int i = 0; i < 3; ++i)
+			c[i] = (c[i] <= 0.04045f) ? c[i] / 12.92f : powf((c[i] + 0.055f) / 1.055f, 2.4f);
+		addf(json, "%s{\"name\":\"%s\",\"pbrMetallicRoughness\":{\"baseColorFactor\":"
+			 "[%.4f,%.4f,%.4f,1],\"metallicFactor\":0,\"roughnessFactor\":0.8}}",
+			 m ? "," : "", MATERIAL[m].name, c[0], c[1], c[2]);
+	}
+	json += "]}";
+	// each chunk is padded to 4 bytes - the JSON with spaces
+	while (json.size() % 4)
+		json += ' ';
+
+	uint64_t total = 12 + 8 + json.size() + (gltf.binSize ? 8 + gltf.binSize : 0);
+	if (total > GLB_MAX) {
+		error = "Too big for a .glb (4 GB at most) - write an .obj";
+		return false;
+	}
+
+	AtomicFile file;
+	if (!file.open(fname)) {
+		error = "Can't write the file";
+		return false;
+	}
+	const uint32_t header[5] = { 0x46546C67, 2, (uint32_t)total,
+								 (uint32_t)json.size(), 0x4E4F534A };
+	bool ok = writeWords(file, header, 5) && file.write(json.data(), json.size());
+	if (ok && gltf.binSize) {
+		const uint32_t bin[2] = { (uint32_t)gltf.binSize, 0x004E4942 };
+		ok = writeWords(file, bin, 2);
+	}
+
+	// the binary chunk, in the order the views were made
+	if (ok && rails)
+		ok = writeSegments(scene, file, [&](size_t s, std::vector<char>& out) {
+				std::vector<Vertex> rings;
+				railRings(scene.cache, scene.points, s, rings);
+				putWords(out, rings.data(), rings.size());
+			}, true) &&
+			writeSegments(scene, file, [&](size_t s, std::vector<char>& out) {
+				std::vector<uint32_t> index;
+				index.reserve(RAIL_TRIANGLES * 3);
+				railTriangles(s, segs, [&](uint64_t a, uint64_t b, uint64_t c) {
+					index.push_back((uint32_t)a);
+					index.push_back((uint32_t)b);
+					index.push_back((uint32_t)c);
+				});
+				putWords(out, index.data(), index.size());
+			}, true);
+	if (ok && ties)
+		ok = writePart(file, scene.tie) &&
+			writeSegments(scene, file, [&](size_t s, std::vector<char>& out) {
+				std::vector<Placement> at;
+				tiePlacements(scene.cache, scene.points, s, at);
+				for (size_t i = 0; i < at.size(); ++i) {
+					const float t[3] = { at[i].pos.x, at[i].pos.y, at[i].pos.z };
+					putWords(out, t, 3);
+				}
+			}, true) &&
+			writeSegments(scene, file, [&](size_t s, std::vector<char>& out) {
+				std::vector<Placement> at;
+				tiePlacements(scene.cache, scene.points, s, at);
+				for (size_t i = 0; i < at.size(); ++i) {
+					float q[4];
+					rotationOf(at[i], q);
+					putWords(out, q, 4);
+				}
+			}, true);
+	if (ok && carts)
+		ok = writePart(file, scene.cart);
+
+	if (!ok || !file.commit()) {
+		file.abandon();
+		error = "Can't write the file";
+		return false;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * Check the cache is something to export, make the parts, and write
+//   whichever file it is
+//============================================================================
+bool
+exportCoaster(const char* fname, const std::vector<ControlPoint>& points,
+			  const TrackCache& cache, const std::vector<float>& carts,
+			  const MeshExportOptions& options, MeshExportStats& stats,
+			  const char*& error, ThreadPool* pool)
+//============================================================================
+{
+	stats = MeshExportStats();
+	size_t len = strlen(fname);
+	bool obj = len > 4 && !strcmp(fname + len - 4, ".obj");
+	bool glb = len > 4 && !strcmp(fname + len - 4, ".glb");
+	if (!obj && !glb) {
+		error = "The file name has to end in .obj or .glb";
+		return false;
+	}
+	if (!cache.clean() || cache.segmentCount() != points.size()) {
+		error = "The track isn't sampled";
+		return false;
+	}
+
+	Scene scene(cache, points, options, pool ? *pool : ThreadPool::shared());
+	scene.segs = cache.segmentCount();
+	for (size_t k = 0; k < cache.windowSize(); ++k)
+		if (cache.frames(cache.windowSegment(k)).size() != FRAMES + 1) {
+			error = "The track isn't sampled";
+			return false;
+		}
+	scene.railVerts = scene.segs * FRAMES * 2 * PROFILE;
+	// the ties of the segments outside the cache's window have to be
+	// sampled to be counted
+	scene.tieStart.assign(scene.segs + 1, 0);
+	scene.pool.parallelFor(0, scene.segs, [&](size_t s) {
+		scene.tieStart[s + 1] = Tables(cache, points, s).ties->size();
+	}, 16);
+	for (size_t s = 0; s < scene.segs; ++s)
+		scene.tieStart[s + 1] += scene.tieStart[s];
+	scene.ties = scene.tieStart[scene.segs];
+
+	makeTie(scene.tie);
+	if (!carts.empty())
+		makeCart(scene.cart);
+	for (size_t c = 0; c < carts.size() && points.size() >= 2; ++c) {
+		Pnt3f pos, dir, up;
+		splinePos(points, carts[c], pos, cache.type());
+		splineDir(points, carts[c], dir, cache.type());
+		splineOrient(points, carts[c], up, cache.type());
+		scene.carts.push_back(place(pos, dir, up));
+	}
+	stats.instances = (options.ties ? scene.ties : 0) + scene.carts.size();
+
+	return obj ? writeObj(fname, scene, stats, error) : writeGlb(fname, scene, stats, error);
+}
@@ -0,0 +1,269 @@
+/************************************************************************
+     File:        PickBuffer.cpp
+
+     Comment:     Picking by drawing object IDs into an offscreen buffer
+
+						see PickBuffer.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <float.h>
+
+// we will need OpenGL, and OpenGL needs windows.h
+#include <windows.h>
+#include <glad/glad.h>
+
+#include "PickBuffer.H"
+
+//****************************************************************************
+//
+// * The ID shader - same transform as the fixed pipeline, writes the ID
+//============================================================================
+static const char* pickVS =
+	"#version 430 compatibility\n"
+	"void main() { gl_Position = ftransform(); }\n";
+
+static const char* pickFS =
+	"#version 430 compatibility\n"
+	"uniform uint id;\n"
+	"layout(location = 0) out uint pickId;\n"
+	"void main() { pickId = id; }\n";
+
+//****************************************************************************
+//
+// * Compile one shader stage - prints the log if it fails
+//============================================================================
+static GLuint compileShader(GLenum stage, const char* source)
+//============================================================================
+{
+	GLuint shader = glCreateShader(stage);
+	glShaderSource(shader, 1, &source, 0);
+	glCompileShader(shader);
+
+	GLint ok = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok) {
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), 0, log);
+		printf("PickBuffer: shader compile failed\n%s\n", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+//****************************************************************************
+//
+// * Constructor - nothing is made until the first pick (we need a context)
+//============================================================================
+PickBuffer::
+PickBuffer()
+	: initFailed(false), program(0), idLocation(-1),
+	  fbo(0), colorBuffer(0), depthBuffer(0), pbo(0),
+	  fboWidth(0), fboHeight(0),
+	  fence(0), readX(0), readY(0), readWidth(0), readHeight(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Make the shader and the read back buffer
+//============================================================================
+bool PickBuffer::
+init()
+//============================================================================
+{
+	if (program)
+		return true;
+	if (initFailed)
+		return false;
+
+	initFailed = true;
+	if (!GLAD_GL_VERSION_4_3)
+		return false;
+
+	GLuint vs = compileShader(GL_VERTEX_SHADER, pickVS);
+	GLuint fs = compileShader(GL_FRAGMENT_SHADER, pickFS);
+	if (!vs || !fs)
+		return false;
+
+	GLuint p = glCreateProgram();
+	glAttachShader(p, vs);
+	glAttachShader(p, fs);
+	glLinkProgram(p);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	GLint ok = 0;
+	glGetProgramiv(p, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		char log[1024];
+		glGetProgramInfoLog(p, sizeof(log), 0, log);
+		printf("PickBuffer: program link failed\n%s\n", log);
+		glDeleteProgram(p);
+		return false;
+	}
+	program = p;
+	idLocation = glGetUniformLocation(program, "id");
+
+	// room for the IDs and the depths of the square
+	glGenBuffers(1, &pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_PACK_BUFFER, 2 * PICK_SIZE * PICK_SIZE * sizeof(GLuint), 0, GL_STREAM_READ);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	initFailed = false;
+	return true;
+}
+
+//****************************************************************************
+//
+// * Bind the ID buffer (made or resized to the window) and the shader
+//============================================================================
+bool PickBuffer::
+begin(int width, int height, int x, int y)
+//============================================================================
+{
+	if (!init() || width <= 0 || height <= 0)
+		return false;
+
+	// a new pick replaces one we never looked at
+	if (fence) {
+		glDeleteSync((GLsync)fence);
+		fence = 0;
+	}
+
+	if (!fbo) {
+		glGenFramebuffers(1, &fbo);
+		glGenRenderbuffers(1, &colorBuffer);
+		glGenRenderbuffers(1, &depthBuffer);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	if (width != fboWidth || height != fboHeight) {
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_R32UI, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		fboWidth = width;
+		fboHeight = height;
+	}
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return false;
+	}
+
+	// only the square around the mouse gets drawn
+	int x0 = x - PICK_SIZE / 2;
+	int y0 = y - PICK_SIZE / 2;
+	int x1 = x0 + PICK_SIZE;
+	int y1 = y0 + PICK_SIZE;
+	if (x0 < 0) x0 = 0;
+	if (y0 < 0) y0 = 0;
+	if (x1 > width) x1 = width;
+	if (y1 > height) y1 = height;
+	if (x1 <= x0 || y1 <= y0) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return false;
+	}
+	readX = x0;
+	readY = y0;
+	readWidth = x1 - x0;
+	readHeight = y1 - y0;
+
+	glViewport(0, 0, width, height);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(readX, readY, readWidth, readHeight);
+
+	const GLuint none = 0;
+	const GLfloat farthest = 1;
+	glClearBufferuiv(GL_COLOR, 0, &none);
+	glClearBufferfv(GL_DEPTH, 0, &farthest);
+	glEnable(GL_DEPTH_TEST);
+
+	glUseProgram(program);
+	return true;
+}
+
+//****************************************************************************
+//
+// * The ID for what gets drawn next
+//============================================================================
+void PickBuffer::
+setId(int kind, int index)
+//============================================================================
+{
+	glUniform1ui(idLocation, ((GLuint)kind << 24) | ((GLuint)index & 0xFFFFFF));
+}
+
+//****************************************************************************
+//
+// * Read the square into the PBO (IDs then depths) and drop a fence
+//============================================================================
+void PickBuffer::
+end()
+//============================================================================
+{
+	glUseProgram(0);
+	glDisable(GL_SCISSOR_TEST);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(readX, readY, readWidth, readHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, (void*)0);
+	glReadPixels(readX, readY, readWidth, readHeight, GL_DEPTH_COMPONENT, GL_FLOAT,
+				 (void*)(PICK_SIZE * PICK_SIZE * sizeof(GLuint)));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	fence = (void*)glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+
+	// back to the window
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+//****************************************************************************
+//
+// * Find the closest ID in the square once the GPU has delivered it
+//============================================================================
+bool PickBuffer::
+resolve(bool wait, Hit& hit)
+//============================================================================
+{
+	hit.kind = PICK_NONE;
+	hit.index = -1;
+	hit.depth = 1;
+	if (!fence)
+		return true;
+
+	GLenum r = glClientWaitSync((GLsync)fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+								wait ? 1000000000ull : 0);
+	if (r == GL_TIMEOUT_EXPIRED && !wait)
+		return false;
+	glDeleteSync((GLsync)fence);
+	fence = 0;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+	const GLuint* ids = (const GLuint*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+		2 * PICK_SIZE * PICK_SIZE * sizeof(GLuint), GL_MAP_READ_BIT);
+	if (ids) {
+		const GLfloat* depths = (const GLfloat*)(ids + PICK_SIZE * PICK_SIZE);
+		float best = FLT_MAX;
+		for (int i = 0; i < readWidth * readHeight; ++i) {
+			if (ids[i] && depths[i] < best) {
+				best = depths[i];
+				hit.kind = (int)(ids[i] >> 24);
+				hit.index = (int)(ids[i] & 0xFFFFFF);
+				hit.depth = depths[i];
+			}
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+}
@@ -0,0 +1,242 @@
+/************************************************************************
+     File:        PointPicker.cpp
+
+     Comment:     Pick control points on the CPU
+
+						see PointPicker.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+#include <float.h>
+
+#include "PointPicker.H"
+
+// the cube ControlPoint::draw makes is 2*size on a side (rotated any
+// which way), with the arrow tip 3*size out along the orientation
+static const float POINT_SIZE = 2.0f;
+static const float CUBE_REACH = POINT_SIZE * 1.7320508f;
+static const float TIP_REACH = POINT_SIZE * 3.0f;
+
+// don't let a huge track make a huge grid - a track of millions of
+// points gets a few of them to a cell instead
+static const double MAX_CELLS = 1 << 22;
+
+//****************************************************************************
+//
+// * Constructor - nothing to pick yet
+//============================================================================
+PointPicker::
+PointPicker()
+//============================================================================
+{
+	dims[0] = dims[1] = dims[2] = 0;
+	cellSize[0] = cellSize[1] = cellSize[2] = 1;
+	for (int a = 0; a < 3; ++a)
+		bounds.lo[a] = bounds.hi[a] = 0;
+}
+
+//****************************************************************************
+//
+// * Boxes, then a grid with about one box per cell (counting sort)
+//============================================================================
+void PointPicker::
+build(const std::vector<ControlPoint>& points)
+//============================================================================
+{
+	size_t n = points.size();
+	boxes.resize(n);
+	cellStart.clear();
+	cellItems.clear();
+	if (n == 0) {
+		dims[0] = dims[1] = dims[2] = 0;
+		return;
+	}
+
+	for (int a = 0; a < 3; ++a) {
+		bounds.lo[a] = FLT_MAX;
+		bounds.hi[a] = -FLT_MAX;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		const Pnt3f& p = points[i].pos;
+		Pnt3f o = points[i].orient;
+		o.normalize();
+		Pnt3f tip = p + o * TIP_REACH;
+		const float c[3] = { p.x, p.y, p.z };
+		const float t[3] = { tip.x, tip.y, tip.z };
+		Box& b = boxes[i];
+		for (int a = 0; a < 3; ++a) {
+			b.lo[a] = fmin(c[a] - CUBE_REACH, t[a]);
+			b.hi[a] = fmax(c[a] + CUBE_REACH, t[a]);
+			bounds.lo[a] = fmin(bounds.lo[a], b.lo[a]);
+			bounds.hi[a] = fmax(bounds.hi[a], b.hi[a]);
+		}
+	}
+
+	// cubic cells, sized so there are about n of them. an axis too thin
+	// for one still gets one, so a flat or long thin track would get
+	// more - the cells grow until there are no more than MAX_CELLS
+	double ext[3];
+	double volume = 1;
+	for (int a = 0; a < 3; ++a) {
+		ext[a] = bounds.hi[a] - bounds.lo[a];
+		volume *= ext[a];
+	}
+	double h = cbrt(volume / n);
+	double d[3];
+	for (;;) {
+		double total = 1;
+		for (int a = 0; a < 3; ++a) {
+			d[a] = fmax(1, ceil(ext[a] / h));
+			total *= d[a];
+		}
+		if (total <= MAX_CELLS)
+			break;
+		h *= 1.25;
+	}
+	for (int a = 0; a < 3; ++a) {
+		dims[a] = (int)d[a];
+		cellSize[a] = (float)(ext[a] / dims[a]);
+	}
+
+	// count the boxes in each cell, then fill
+	size_t cells = (size_t)dims[0] * dims[1] * dims[2];
+	cellStart.assign(cells + 1, 0);
+	for (int pass = 0; pass < 2; ++pass) {
+		if (pass == 1) {
+			for (size_t c = 0; c < cells; ++c)
+				cellStart[c + 1] += cellStart[c];
+			cellItems.resize(cellStart[cells]);
+		}
+		std::vector<unsigned int> fill;
+		if (pass == 1)
+			fill.assign(cellStart.begin(), cellStart.end() - 1);
+
+		for (size_t i = 0; i < n; ++i) {
+			int lo[3], hi[3];
+			for (int a = 0; a < 3; ++a) {
+				lo[a] = (int)((boxes[i].lo[a] - bounds.lo[a]) / cellSize[a]);
+				hi[a] = (int)((boxes[i].hi[a] - bounds.lo[a]) / cellSize[a]);
+				if (lo[a] >= dims[a]) lo[a] = dims[a] - 1;
+				if (hi[a] >= dims[a]) hi[a] = dims[a] - 1;
+			}
+			for (int z = lo[2]; z <= hi[2]; ++z)
+				for (int y = lo[1]; y <= hi[1]; ++y)
+					for (int x = lo[0]; x <= hi[0]; ++x) {
+						size_t c = ((size_t)z * dims[1] + y) * dims[0] + x;
+						if (pass == 0)
+							++cellStart[c + 1];
+						else
+							cellItems[fill[c]++] = (unsigned int)i;
+					}
+		}
+	}
+}
+
+//****************************************************************************
+//
+// * Slab test - where the ray enters and leaves the box
+//============================================================================
+bool PointPicker::
+hitBox(const Box& b, const float o[3], const float inv[3], float& tNear, float& tFar)
+//============================================================================
+{
+	tNear = -FLT_MAX;
+	tFar = FLT_MAX;
+	for (int a = 0; a < 3; ++a) {
+		float t0 = (b.lo[a] - o[a]) * inv[a];
+		float t1 = (b.hi[a] - o[a]) * inv[a];
+		if (t0 > t1) {
+			float s = t0;
+			t0 = t1;
+			t1 = s;
+		}
+		tNear = fmax(tNear, t0);
+		tFar = fmin(tFar, t1);
+	}
+	return tNear <= tFar && tFar >= 0;
+}
+
+//****************************************************************************
+//
+// * Walk the ray through the grid
+//============================================================================
+int PointPicker::
+pick(const Pnt3f& origin, const Pnt3f& dir, float* distance) const
+//============================================================================
+{
+	if (boxes.empty())
+		return -1;
+
+	const float o[3] = { origin.x, origin.y, origin.z };
+	const float d[3] = { dir.x, dir.y, dir.z };
+	float inv[3];
+	for (int a = 0; a < 3; ++a)
+		inv[a] = (fabs(d[a]) > 1e-12f) ? 1.0f / d[a] : ((d[a] < 0) ? -1e30f : 1e30f);
+
+	// where does the ray cross the whole grid?
+	float tEnter, tLeave;
+	if (!hitBox(bounds, o, inv, tEnter, tLeave))
+		return -1;
+	if (tEnter < 0)
+		tEnter = 0;
+
+	// the cell we start in, and how far it is to the next one on each axis
+	int cell[3], step[3];
+	float tNext[3], tDelta[3];
+	for (int a = 0; a < 3; ++a) {
+		float p = o[a] + d[a] * tEnter;
+		int c = (int)floor((p - bounds.lo[a]) / cellSize[a]);
+		cell[a] = (c < 0) ? 0 : ((c >= dims[a]) ? dims[a] - 1 : c);
+
+		if (d[a] > 0) {
+			step[a] = 1;
+			tNext[a] = (bounds.lo[a] + (cell[a] + 1) * cellSize[a] - o[a]) * inv[a];
+			tDelta[a] = cellSize[a] * inv[a];
+		}
+		else if (d[a] < 0) {
+			step[a] = -1;
+			tNext[a] = (bounds.lo[a] + cell[a] * cellSize[a] - o[a]) * inv[a];
+			tDelta[a] = -cellSize[a] * inv[a];
+		}
+		else {
+			step[a] = 0;
+			tNext[a] = FLT_MAX;
+			tDelta[a] = FLT_MAX;
+		}
+	}
+
+	int best = -1;
+	float bestT = FLT_MAX;
+	for (;;) {
+		size_t c = ((size_t)cell[2] * dims[1] + cell[1]) * dims[0] + cell[0];
+		for (unsigned int k = cellStart[c]; k < cellStart[c + 1]; ++k) {
+			unsigned int i = cellItems[k];
+			float tNear, tFar;
+			if (hitBox(boxes[i], o, inv, tNear, tFar)) {
+				float t = (tNear < 0) ? 0 : tNear;
+				if (t < bestT) {
+					bestT = t;
+					best = (int)i;
+				}
+			}
+		}
+
+		// nothing in a later cell can be closer
+		int a = (tNext[0] < tNext[1]) ? ((tNext[0] < tNext[2]) ? 0 : 2)
+									  : ((tNext[1] < tNext[2]) ? 1 : 2);
+		if (bestT <= tNext[a] || tNext[a] > tLeave)
+			break;
+
+		cell[a] += step[a];
+		if (cell[a] < 0 || cell[a] >= dims[a])
+			break;
+		tNext[a] += tDelta[a];
+	}
+
+	if (distance && best >= 0)
+		*distance = bestT;
+	return best;
+}
@@ -0,0 +1,250 @@
+/************************************************************************
+     File:        RailMesh.cpp
+
+     Comment:     Triangle mesh for the rails
+
+						see RailMesh.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+
+// we will need OpenGL, and OpenGL needs windows.h
+#include <windows.h>
+#include <glad/glad.h>
+
+#include "RailMesh.H"
+#include "TrackCache.H"
+
+static const int FRAMES = TrackCache::FRAMES_PER_SEGMENT + 1;
+static const unsigned short RESTART = 0xFFFF;
+
+//****************************************************************************
+//
+// * Pack a unit normal into signed normalized bytes
+//============================================================================
+static void packNormal(RailVertex& v, float x, float y, float z)
+//============================================================================
+{
+	v.nx = (signed char)floor(x * 127.0f + .5f);
+	v.ny = (signed char)floor(y * 127.0f + .5f);
+	v.nz = (signed char)floor(z * 127.0f + .5f);
+	v.pad = 0;
+}
+
+//****************************************************************************
+//
+// * Constructor - the buffers get made on the first update
+//============================================================================
+RailMesh::
+RailMesh()
+	: vao(0), vertexBuffer(0), indexBuffer(0), indexCount(0), capacity(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Two rails, a ring per frame
+//============================================================================
+size_t RailMesh::
+vertsPerSegment()
+//============================================================================
+{
+	return 2 * FRAMES * PROFILE_VERTS;
+}
+
+//****************************************************************************
+//
+// * Sweep the profile along the frames of one segment
+//============================================================================
+void RailMesh::
+buildSegment(const TrackCache& cache, size_t seg, RailVertex* out)
+//============================================================================
+{
+	const std::vector<TrackFrame>& frames = cache.frames(seg);
+
+	// the profile is the same for every ring
+	float pc[PROFILE_VERTS], ps[PROFILE_VERTS];
+	for (int k = 0; k < PROFILE_VERTS; ++k) {
+		float a = 2.0f * 3.14159265f * k / PROFILE_VERTS;
+		pc[k] = cos(a);
+		ps[k] = sin(a);
+	}
+
+	for (int r = 0; r < 2; ++r) {
+		float side = (r == 0) ? -RAIL_OFFSET : RAIL_OFFSET;
+		for (int f = 0; f < FRAMES; ++f) {
+			RailVertex* v = out + (r * FRAMES + f) * PROFILE_VERTS;
+			if (f >= (int)frames.size()) {
+				// nothing to sweep (unknown spline type) - degenerate
+				for (int k = 0; k < PROFILE_VERTS; ++k) {
+					v[k].x = v[k].y = v[k].z = 0;
+					packNormal(v[k], 0, 0, 0);
+				}
+				continue;
+			}
+			const TrackFrame& fr = frames[f];
+			for (int k = 0; k < PROFILE_VERTS; ++k) {
+				Pnt3f n = fr.cross * pc[k] + fr.up * ps[k];
+				Pnt3f p = fr.pos + fr.cross * side + n * PROFILE_RADIUS;
+				v[k].x = p.x;
+				v[k].y = p.y;
+				v[k].z = p.z;
+				packNormal(v[k], n.x, n.y, n.z);
+			}
+		}
+	}
+}
+
+//****************************************************************************
+//
+// * One strip per profile edge per rail, separated by restart indices
+//============================================================================
+void RailMesh::
+buildIndices(std::vector<unsigned short>& out)
+//============================================================================
+{
+	out.clear();
+	for (int r = 0; r < 2; ++r) {
+		for (int k = 0; k < PROFILE_VERTS; ++k) {
+			int k1 = (k + 1) % PROFILE_VERTS;
+			for (int f = 0; f < FRAMES; ++f) {
+				int ring = (r * FRAMES + f) * PROFILE_VERTS;
+				out.push_back((unsigned short)(ring + k1));
+				out.push_back((unsigned short)(ring + k));
+			}
+			out.push_back(RESTART);
+		}
+	}
+}
+
+//****************************************************************************
+//
+// * Bring the GPU copy up to date with the cache - a block per slot of
+//   its window. runs of changed blocks are regenerated and uploaded
+//   together
+//============================================================================
+void RailMesh::
+update(const TrackCache& cache)
+//============================================================================
+{
+	const size_t vps = vertsPerSegment();
+	const size_t nseg = cache.windowSize();
+
+	if (!vao) {
+		std::vector<unsigned short> index;
+		buildIndices(index);
+		indexCount = index.size();
+
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vertexBuffer);
+		glGenBuffers(1, &indexBuffer);
+
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, index.size() * sizeof(unsigned short), index.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(3, GL_FLOAT, sizeof(RailVertex), (void*)0);
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glNormalPointer(GL_BYTE, sizeof(RailVertex), (void*)(3 * sizeof(float)));
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+
+	// a different number of slots. the revisions are never handed out
+	// twice, so what is in the buffer stays good for the slots whose
+	// revision it has - unless the buffer has to grow, when it starts
+	// over. it grows by doubling, so a track loaded a chunk at a time
+	// gets uploaded about twice, not once a chunk - up to the size of
+	// the cache's window, which is as big as it gets
+	if (uploaded.size() != nseg) {
+		if (nseg > capacity) {
+			capacity = (nseg > 2 * capacity) ? nseg : 2 * capacity;
+			capacity = (capacity > TrackCache::WINDOW) ? TrackCache::WINDOW : capacity;
+			glBufferData(GL_ARRAY_BUFFER, capacity * vps * sizeof(RailVertex), 0, GL_DYNAMIC_DRAW);
+			uploaded.assign(nseg, 0);
+		}
+		else
+			uploaded.resize(nseg, 0);
+
+		counts.assign(nseg, (int)indexCount);
+		offsets.assign(nseg, (const void*)0);
+		baseVertex.resize(nseg);
+		for (size_t i = 0; i < nseg; ++i)
+			baseVertex[i] = (int)(i * vps);
+	}
+
+	// a slot whose segment changed, or that has another segment now the
+	// window moved, has another revision
+	auto revision = [&](size_t slot) { return cache.segmentRevision(cache.slotSegment(slot)); };
+	for (size_t i = 0; i < nseg; ) {
+		if (uploaded[i] == revision(i)) {
+			++i;
+			continue;
+		}
+		size_t end = i;
+		while (end < nseg && uploaded[end] != revision(end))
+			++end;
+
+		scratch.resize((end - i) * vps);
+		for (size_t s = i; s < end; ++s) {
+			buildSegment(cache, cache.slotSegment(s), &scratch[(s - i) * vps]);
+			uploaded[s] = revision(s);
+		}
+		glBufferSubData(GL_ARRAY_BUFFER, i * vps * sizeof(RailVertex),
+						scratch.size() * sizeof(RailVertex), scratch.data());
+		i = end;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+//****************************************************************************
+//
+// * Draw every segment of the window with one call
+//============================================================================
+void RailMesh::
+draw(bool doingShadows)
+//============================================================================
+{
+	if (!vao || counts.empty())
+		return;
+
+	if (!doingShadows)
+		glColor3ub(32, 32, 64);
+
+	glBindVertexArray(vao);
+	glEnable(GL_PRIMITIVE_RESTART);
+	glPrimitiveRestartIndex(RESTART);
+	glMultiDrawElementsBaseVertex(GL_TRIANGLE_STRIP, counts.data(), GL_UNSIGNED_SHORT,
+								  offsets.data(), (GLsizei)counts.size(), baseVertex.data());
+	glDisable(GL_PRIMITIVE_RESTART);
+	glBindVertexArray(0);
+}
+
+//****************************************************************************
+//
+// * Draw one segment on its own
+//============================================================================
+void RailMesh::
+drawSegment(const TrackCache& cache, size_t seg)
+//============================================================================
+{
+	if (!vao || !cache.resident(seg) || cache.slot(seg) >= counts.size())
+		return;
+	size_t slot = cache.slot(seg);
+
+	glBindVertexArray(vao);
+	glEnable(GL_PRIMITIVE_RESTART);
+	glPrimitiveRestartIndex(RESTART);
+	glDrawElementsBaseVertex(GL_TRIANGLE_STRIP, counts[slot], GL_UNSIGNED_SHORT,
+							 offsets[slot], baseVertex[slot]);
+	glDisable(GL_PRIMITIVE_RESTART);
+	glBindVertexArray(0);
+}
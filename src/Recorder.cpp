@@ -0,0 +1,448 @@
+/************************************************************************
+     File:        Recorder.cpp
+
+     Comment:     Record a session, and play it back
+
+						see Recorder.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <string.h>
+
+#include "Recorder.H"
+
+#pragma warning(push)
+#pragma warning(disable:4312)
+#pragma warning(disable:4311)
+#include <Fl/Fl.H>
+#include <Fl/Fl_Group.H>
+#include <Fl/Fl_Button.H>
+#include <Fl/Fl_Browser.H>
+#include <Fl/Fl_Valuator.H>
+#pragma warning(pop)
+
+static const unsigned char MAGIC[4] = { 'R', 'C', 'L', 'G' };
+static const unsigned int VERSION = 1;
+
+// write the buffer out once it gets this big
+static const size_t FLUSH_SIZE = 64 * 1024;
+
+//****************************************************************************
+//
+// * Constructor - not recording or playing
+//============================================================================
+Recorder::
+Recorder()
+	: out(0), lastSteps(0), playing(false), at(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Destructor - don't lose the end of the log
+//============================================================================
+Recorder::
+~Recorder()
+//============================================================================
+{
+	close();
+}
+
+//****************************************************************************
+//
+// * Start a log
+//============================================================================
+bool Recorder::
+record(const char* fname)
+//============================================================================
+{
+	close();
+	out = fopen(fname, "wb");
+	if (!out) {
+		printf("Can't write the session log %s\n", fname);
+		return false;
+	}
+	buffer.clear();
+	buffer.insert(buffer.end(), MAGIC, MAGIC + 4);
+	put16(VERSION);
+	put16(0);
+	lastSteps = 0;
+	return true;
+}
+
+//****************************************************************************
+//
+// * Read a whole log in, and check it is one
+//============================================================================
+bool Recorder::
+replay(const char* fname)
+//============================================================================
+{
+	close();
+	FILE* fp = fopen(fname, "rb");
+	if (!fp) {
+		printf("Can't read the session log %s\n", fname);
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	log.resize(size > 0 ? (size_t)size : 0);
+	size_t got = log.empty() ? 0 : fread(&log[0], 1, log.size(), fp);
+	fclose(fp);
+
+	at = 0;
+	if (got != log.size() || log.size() < 8 || memcmp(&log[0], MAGIC, 4) != 0) {
+		printf("%s isn't a session log\n", fname);
+		log.clear();
+		return false;
+	}
+	at = 4;
+	unsigned int version = get16();
+	get16();
+	if (version != VERSION) {
+		printf("%s is a version %u session log, this reads version %u\n",
+			   fname, version, VERSION);
+		log.clear();
+		return false;
+	}
+	playing = true;
+	return true;
+}
+
+//****************************************************************************
+//
+// * Done
+//============================================================================
+void Recorder::
+close()
+//============================================================================
+{
+	if (out) {
+		flush();
+		fclose(out);
+		out = 0;
+	}
+	playing = false;
+	log.clear();
+	at = 0;
+}
+
+//****************************************************************************
+//
+// * Stand in front of the callbacks of the widgets
+//============================================================================
+void Recorder::
+attach(Fl_Group* g, std::initializer_list<Fl_Callback*> skip)
+//============================================================================
+{
+	attachGroup(g, skip);
+}
+
+void Recorder::
+attachGroup(Fl_Group* g, std::initializer_list<Fl_Callback*> skip)
+{
+	for (int i = 0; i < g->children(); ++i) {
+		Fl_Widget* w = g->child(i);
+		if (w->as_group()) {
+			attachGroup(w->as_group(), skip);
+			continue;
+		}
+
+		Fl_Callback* cb = w->callback();
+		if (!cb || cb == Fl_Widget::default_callback)
+			continue;
+		bool skipped = false;
+		for (Fl_Callback* s : skip)
+			skipped = skipped || (cb == s);
+		if (skipped)
+			continue;
+		// the log numbers them with a byte
+		if (hooked.size() == 256) {
+			printf("Only the first 256 widgets can be recorded\n");
+			return;
+		}
+
+		Hooked h;
+		h.widget = w;
+		h.callback = cb;
+		h.data = w->user_data();
+		hooked.push_back(h);
+		w->callback(recordCB, this);
+	}
+}
+
+//****************************************************************************
+//
+// * A hooked widget did its callback - write it down, then pass it on
+//============================================================================
+void Recorder::
+recordCB(Fl_Widget* w, void* v)
+//============================================================================
+{
+	Recorder* r = (Recorder*)v;
+	for (size_t i = 0; i < r->hooked.size(); ++i) {
+		if (r->hooked[i].widget != w)
+			continue;
+
+		if (r->recording()) {
+			double value = 0;
+			if (Fl_Valuator* val = dynamic_cast<Fl_Valuator*>(w))
+				value = val->value();
+			else if (Fl_Browser* b = dynamic_cast<Fl_Browser*>(w))
+				value = b->value();
+			else if (Fl_Button* b = dynamic_cast<Fl_Button*>(w))
+				value = b->value();
+			r->put8(REC_WIDGET);
+			r->put8((unsigned int)i);
+			r->putDouble(value);
+		}
+		r->hooked[i].callback(w, r->hooked[i].data);
+		return;
+	}
+}
+
+//****************************************************************************
+//
+// * Writing
+//============================================================================
+void Recorder::
+event(int e)
+//============================================================================
+{
+	if (!out)
+		return;
+	switch (e) {
+	case FL_PUSH:
+	case FL_RELEASE:
+	case FL_DRAG:
+	case FL_MOUSEWHEEL:
+	case FL_KEYBOARD:
+		break;
+	default:
+		return;
+	}
+	put8(REC_EVENT);
+	put8(e);
+	put16((unsigned int)(Fl::event_x() & 0xffff));
+	put16((unsigned int)(Fl::event_y() & 0xffff));
+	put32((unsigned long)Fl::event_state());
+	put32((unsigned long)Fl::e_keysym);
+	put8(Fl::event_clicks() & 0xff);
+	put8(Fl::event_dy() & 0xff);
+}
+
+void Recorder::
+load(const char* fname)
+{
+	if (!out)
+		return;
+	size_t n = strlen(fname);
+	if (n > 0xffff)
+		n = 0xffff;
+	put8(REC_LOAD);
+	put16((unsigned int)n);
+	buffer.insert(buffer.end(), fname, fname + n);
+}
+
+void Recorder::
+tick(unsigned long steps)
+{
+	if (!out || steps == lastSteps)
+		return;
+	lastSteps = steps;
+	put8(REC_TICK);
+	put32(steps);
+}
+
+void Recorder::
+frame()
+{
+	if (!out)
+		return;
+	put8(REC_FRAME);
+	if (buffer.size() >= FLUSH_SIZE)
+		flush();
+}
+
+//****************************************************************************
+//
+// * Little endian, whatever the machine is
+//============================================================================
+void Recorder::
+put8(unsigned int v)
+//============================================================================
+{
+	buffer.push_back((unsigned char)(v & 0xff));
+}
+
+void Recorder::
+put16(unsigned int v)
+{
+	put8(v);
+	put8(v >> 8);
+}
+
+void Recorder::
+put32(unsigned long v)
+{
+	put16((unsigned int)(v & 0xffff));
+	put16((unsigned int)((v >> 16) & 0xffff));
+}
+
+void Recorder::
+putDouble(double v)
+{
+	unsigned long long bits;
+	memcpy(&bits, &v, sizeof(bits));
+	put32((unsigned long)(bits & 0xffffffffu));
+	put32((unsigned long)(bits >> 32));
+}
+
+void Recorder::
+flush()
+{
+	if (out && !buffer.empty())
+		fwrite(&buffer[0], 1, buffer.size(), out);
+	buffer.clear();
+}
+
+//****************************************************************************
+//
+// * Reading
+//============================================================================
+bool Recorder::
+next(Record& r)
+//============================================================================
+{
+	r.kind = REC_NONE;
+	if (!playing || !get(1))
+		return false;
+
+	unsigned int kind = get8();
+	switch (kind) {
+	case REC_EVENT:
+		if (!get(15))
+			return false;
+		r.event = (int)get8();
+		r.x = (short)get16();
+		r.y = (short)get16();
+		r.state = (int)get32();
+		r.key = (int)get32();
+		r.clicks = (int)get8();
+		r.dy = (signed char)get8();
+		break;
+	case REC_WIDGET:
+		if (!get(9))
+			return false;
+		r.widget = (int)get8();
+		r.value = getDouble();
+		break;
+	case REC_LOAD: {
+		if (!get(2))
+			return false;
+		size_t n = get16();
+		if (!get(n))
+			return false;
+		r.name.assign((const char*)&log[at], n);
+		at += n;
+		break;
+	}
+	case REC_TICK:
+		if (!get(4))
+			return false;
+		r.steps = get32();
+		break;
+	case REC_FRAME:
+		break;
+	default:
+		printf("Bad record %u in the session log\n", kind);
+		return false;
+	}
+	r.kind = (Kind)kind;
+	return true;
+}
+
+// are there n more bytes?
+bool Recorder::
+get(size_t n)
+{
+	return at + n <= log.size();
+}
+
+unsigned int Recorder::
+get8()
+{
+	return log[at++];
+}
+
+unsigned int Recorder::
+get16()
+{
+	unsigned int lo = get8();
+	return lo | (get8() << 8);
+}
+
+unsigned long Recorder::
+get32()
+{
+	unsigned long lo = get16();
+	return lo | ((unsigned long)get16() << 16);
+}
+
+double Recorder::
+getDouble()
+{
+	unsigned long long lo = get32();
+	unsigned long long bits = lo | ((unsigned long long)get32() << 32);
+	double v;
+	memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+//****************************************************************************
+//
+// * Put the event back
+//============================================================================
+void Recorder::
+applyEvent(const Record& r)
+//============================================================================
+{
+	Fl::e_number = r.event;
+	Fl::e_x = r.x;
+	Fl::e_y = r.y;
+	Fl::e_state = r.state;
+	Fl::e_keysym = r.key;
+	Fl::e_clicks = r.clicks;
+	Fl::e_dy = r.dy;
+	Fl::e_dx = 0;
+}
+
+//****************************************************************************
+//
+// * Set the widget, and do its callback
+//============================================================================
+void Recorder::
+applyWidget(const Record& r)
+//============================================================================
+{
+	if (r.widget < 0 || r.widget >= (int)hooked.size()) {
+		printf("The session log has a widget (%d) this program doesn't\n", r.widget);
+		return;
+	}
+	Hooked& h = hooked[r.widget];
+	if (Fl_Valuator* val = dynamic_cast<Fl_Valuator*>(h.widget))
+		val->value(r.value);
+	else if (Fl_Browser* b = dynamic_cast<Fl_Browser*>(h.widget))
+		b->value((int)r.value);
+	else if (Fl_Button* b = dynamic_cast<Fl_Button*>(h.widget)) {
+		if (b->type() == FL_RADIO_BUTTON && r.value != 0)
+			b->setonly();
+		else
+			b->value(r.value != 0);
+	}
+	h.callback(h.widget, h.data);
+}
@@ -0,0 +1,254 @@
+/************************************************************************
+     File:        RideAnalyzer.cpp
+
+     Comment:     What a ride feels like, all the way round
+
+						see RideAnalyzer.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+
+#include "RideAnalyzer.H"
+#include "ThreadPool.H"
+
+// a train that takes longer than this over a lap has stopped
+static const double MAX_LAP_TIME = 3600;
+
+// the push from the seat, in g
+struct Felt {
+	float	vert, lat, lng;
+};
+
+//****************************************************************************
+//
+// * Speed of the train when the front has gone distance d (from the table
+//   made in the first pass), and how fast that changes - false if the
+//   train never got that far
+//============================================================================
+static bool speedAt(const std::vector<float>& speeds, size_t got, float step, double d,
+					float& v, float& dvds)
+//============================================================================
+{
+	double x = d / step;
+	size_t i = (size_t)x;
+	if (x < 0 || i + 1 >= got)
+		return false;
+	float f = (float)(x - i);
+	v = speeds[i] + (speeds[i + 1] - speeds[i]) * f;
+	dvds = (speeds[i + 1] - speeds[i]) / step;
+	return true;
+}
+
+//****************************************************************************
+//
+// * What a rider at s feels when the train goes v and speeds up by
+//   dv/ds along the track
+//============================================================================
+static void feel(const TrackProfile& profile, float g, float s, float v, float dvds, Felt& out)
+//============================================================================
+{
+	TrackProfile::Sample p;
+	profile.sample(s, p);
+	float v2 = v * v;
+	out.vert = (v2 * p.curvV + g * p.upY) / g;
+	out.lat = (v2 * p.curvL + g * p.sideY) / g;
+	out.lng = (v * dvds + g * p.slope) / g;
+}
+
+//****************************************************************************
+//
+// * Make the profile, then analyze it
+//============================================================================
+void RideAnalyzer::
+analyze(const std::vector<ControlPoint>& points, const Options& options, Result& result,
+		ThreadPool* pool)
+//============================================================================
+{
+	TrackProfile profile;
+	profile.update(points, options.type);
+	analyze(profile, options, result, pool);
+}
+
+//****************************************************************************
+//
+// * Run the train round for the speeds, then work the forces out a
+//   segment at a time
+//============================================================================
+void RideAnalyzer::
+analyze(const TrackProfile& profile, const Options& options, Result& result, ThreadPool* pool)
+//============================================================================
+{
+	result.ok = false;
+	result.stalled = false;
+	result.stalledAt = 0;
+	result.length = 0;
+	result.time = 0;
+	result.distance = 0;
+	result.lapTimes.clear();
+	result.speedMin = result.speedMax = 0;
+	result.rows.clear();
+	result.worst = Row();
+	if (profile.empty() || options.step <= 0 || options.dt <= 0 || options.physics.gravity <= 0)
+		return;
+	if (!pool)
+		pool = &ThreadPool::shared();
+
+	double len = profile.length();
+	float step = options.step;
+	int laps = (options.laps > 0) ? options.laps : 1;
+	int carts = (options.carts > 0) ? options.carts : 1;
+	float spacing = options.cartSpacing;
+	float g = options.physics.gravity;
+	size_t nRows = (size_t)ceil(len / step);
+	result.ok = true;
+	result.length = len;
+
+	//*********************************************************************
+	// first pass: the train's speed every step along, as far as the last
+	// cart has to go (and one more step, for the jerk) - or for as long
+	// as it is told to run
+	//*********************************************************************
+	double duration = options.duration;
+	double dt = options.dt;
+	double need = laps * len + (carts - 1) * spacing + step;
+	size_t count = (size_t)(need / step) + 2;
+	std::vector<float> speeds;
+	speeds.reserve((duration > 0) ? 1024 : count);
+	speeds.push_back(options.startSpeed);
+
+	CoasterPhysics physics;
+	physics.setParams(options.physics);
+	physics.setCarts(std::vector<float>(carts, 1.0f), spacing);
+
+	CoasterPhysics::Train train;
+	train.v = options.startSpeed;
+	result.speedMin = result.speedMax = options.startSpeed;
+	double travelled = 0;
+	double time = 0;
+	double lapStart = 0;
+	while ((duration > 0) ? time < duration : speeds.size() < count) {
+		double prevS = train.s;
+		double prevV = train.v;
+		double prevD = travelled;
+		physics.step(profile, train, dt);
+		time += dt;
+
+		double moved = train.s - prevS;
+		if (moved > len / 2)
+			moved -= len;
+		if (moved < -len / 2)
+			moved += len;
+		if (train.v <= 0 || moved <= 0 || (duration <= 0 && time > MAX_LAP_TIME * laps)) {
+			result.stalled = true;
+			result.stalledAt = profile.wrap((float)travelled);
+			break;
+		}
+		travelled += moved;
+		result.speedMin = fminf(result.speedMin, (float)train.v);
+		result.speedMax = fmaxf(result.speedMax, (float)train.v);
+
+		for (size_t k = speeds.size(); k * (double)step <= travelled; ++k) {
+			double f = (k * (double)step - prevD) / moved;
+			speeds.push_back((float)(prevV + (train.v - prevV) * f));
+		}
+
+		// over the start: when, between the two steps
+		double lapEnd = (result.lapTimes.size() + 1) * len;
+		if (travelled >= lapEnd) {
+			double at = time - dt * (travelled - lapEnd) / moved;
+			result.lapTimes.push_back(at - lapStart);
+			lapStart = at;
+		}
+	}
+	size_t got = speeds.size();
+	result.time = time;
+	result.distance = travelled;
+	// every lap the speeds reach into
+	laps = (int)(got * (double)step / len) + 1;
+
+	//*********************************************************************
+	// second pass: every cart, every lap, at every row
+	//*********************************************************************
+	std::vector<Row> rows(nRows);
+	std::vector<char> reached(nRows, 0);
+	size_t nSeg = profile.segmentCount();
+	pool->parallelFor(0, nSeg, [&](size_t seg) {
+		size_t first = (size_t)ceil(profile.segStart[seg] / step);
+		size_t last = (size_t)ceil(profile.segStart[seg + 1] / step);
+		if (last > nRows)
+			last = nRows;
+
+		for (size_t m = first; m < last; ++m) {
+			Row& r = rows[m];
+			float s = (float)(m * (double)step);
+			r.s = s;
+			bool any = false;
+
+			for (int lap = 0; lap < laps; ++lap) {
+				for (int c = 0; c < carts; ++c) {
+					// the front is c carts ahead of this rider
+					double d = lap * len + s + c * spacing;
+					float v, dvds, vNext, dvdsNext;
+					if (!speedAt(speeds, got, step, d, v, dvds) ||
+						!speedAt(speeds, got, step, d + step, vNext, dvdsNext))
+						continue;
+
+					Felt here, there;
+					feel(profile, g, s, v, dvds, here);
+					feel(profile, g, s + step, vNext, dvdsNext, there);
+					float dv = there.vert - here.vert;
+					float dl = there.lat - here.lat;
+					float dn = there.lng - here.lng;
+					float took = 2 * step / (v + vNext);
+					float jerk = sqrtf(dv * dv + dl * dl + dn * dn) / took;
+
+					if (!any) {
+						r.vMin = r.vMax = v;
+						r.gVertMin = r.gVertMax = here.vert;
+						r.gLat = fabsf(here.lat);
+						r.gLongMin = r.gLongMax = here.lng;
+						r.jerk = jerk;
+						any = true;
+						continue;
+					}
+					r.vMin = fminf(r.vMin, v);
+					r.vMax = fmaxf(r.vMax, v);
+					r.gVertMin = fminf(r.gVertMin, here.vert);
+					r.gVertMax = fmaxf(r.gVertMax, here.vert);
+					r.gLat = fmaxf(r.gLat, fabsf(here.lat));
+					r.gLongMin = fminf(r.gLongMin, here.lng);
+					r.gLongMax = fmaxf(r.gLongMax, here.lng);
+					r.jerk = fmaxf(r.jerk, jerk);
+				}
+			}
+			reached[m] = any;
+		}
+	});
+
+	// as far as it got, and the worst of it
+	size_t n = 0;
+	while (n < nRows && reached[n])
+		++n;
+	rows.resize(n);
+	for (size_t m = 0; m < n; ++m) {
+		const Row& r = rows[m];
+		Row& w = result.worst;
+		if (m == 0) {
+			w = r;
+			w.s = 0;
+			continue;
+		}
+		w.vMin = fminf(w.vMin, r.vMin);
+		w.vMax = fmaxf(w.vMax, r.vMax);
+		w.gVertMin = fminf(w.gVertMin, r.gVertMin);
+		w.gVertMax = fmaxf(w.gVertMax, r.gVertMax);
+		w.gLat = fmaxf(w.gLat, r.gLat);
+		w.gLongMin = fminf(w.gLongMin, r.gLongMin);
+		w.gLongMax = fmaxf(w.gLongMax, r.gLongMax);
+		w.jerk = fmaxf(w.jerk, r.jerk);
+	}
+	result.rows.swap(rows);
+}
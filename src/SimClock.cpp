@@ -0,0 +1,58 @@
+/************************************************************************
+     File:        SimClock.cpp
+
+     Comment:     Fixed time step clock for the simulation
+
+						see SimClock.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include "SimClock.H"
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+SimClock::
+SimClock(double s)
+	: step(s), last(std::chrono::steady_clock::now()), accumulator(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Start over from now
+//============================================================================
+void SimClock::
+start()
+//============================================================================
+{
+	last = std::chrono::steady_clock::now();
+	accumulator = 0;
+}
+
+//****************************************************************************
+//
+// * Add the time since the last call, hand out whole steps
+//============================================================================
+int SimClock::
+advance(int maxSteps)
+//============================================================================
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	accumulator += std::chrono::duration<double>(now - last).count();
+	last = now;
+
+	int steps = 0;
+	while (accumulator >= step && steps < maxSteps) {
+		accumulator -= step;
+		++steps;
+	}
+	// too far behind - don't try to catch up
+	if (accumulator >= step)
+		accumulator = 0;
+	return steps;
+}
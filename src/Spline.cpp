@@ -0,0 +1,189 @@
+/************************************************************************
+     File:        Spline.cpp
+
+     Comment:     Spline evaluation for the track
+
+						see Spline.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Spline.H"
+
+//****************************************************************************
+//
+// * The basis matrices (column major - the same layout glm::make_mat4 reads)
+//============================================================================
+static const float LinearMmat[16] =
+{
+	0 ,0 ,0 ,0,
+	0 ,0 ,0 ,0,
+	0 ,-1,1 ,0,
+	0 ,1 ,0 ,0
+};
+static const float CarrientalMmat[16] =
+{
+	-1 / 2.0 ,3 / 2.0 ,-3 / 2.0  ,1 / 2.0,
+	2 / 2.0  ,-5 / 2.0,4 / 2.0   ,-1 / 2.0,
+	-1 / 2.0 ,0 / 2.0 ,1 / 2.0   ,0 / 2.0,
+	0 / 2.0  ,2 / 2.0 ,0 / 2.0   ,0 / 2.0
+};
+static const float B_SplineMmat[16] =
+{
+	-1 / 6.0,3 / 6.0,-3 / 6.0,1 / 6.0,
+	3 / 6.0,-6 / 6.0,3 / 6.0,0 / 6.0,
+	-3 / 6.0,0 / 6.0,3 / 6.0,0 / 6.0,
+	1 / 6.0,4 / 6.0,1 / 6.0,0 / 6.0
+};
+
+static const glm::mat4 LinearM      = glm::make_mat4(LinearMmat);
+static const glm::mat4 CarrientalM  = glm::make_mat4(CarrientalMmat);
+static const glm::mat4 B_SplineM    = glm::make_mat4(B_SplineMmat);
+
+//****************************************************************************
+//
+// * Look up the basis of a spline type
+//============================================================================
+const glm::mat4* splineBasis(int type)
+//============================================================================
+{
+	switch (type) {
+	case SPLINE_LINEAR:		return &LinearM;
+	case SPLINE_CARDINAL:	return &CarrientalM;
+	case SPLINE_BSPLINE:	return &B_SplineM;
+	}
+	return 0;
+}
+
+//****************************************************************************
+//
+// * Find the segment for t and the 4 control points around it
+//   returns false if there is nothing to evaluate
+//============================================================================
+static bool splineWindow(const std::vector<ControlPoint>& points, float t,
+						 const ControlPoint* p[4], float& percent)
+//============================================================================
+{
+	size_t n = points.size();
+	if (n == 0)
+		return false;
+
+	while (t < 0)
+		t += n;
+	while (t >= n)
+		t -= n;
+
+	int i = (int)floor(t);
+	percent = t - i;
+
+	p[0] = &points[(i == 0) ? n - 1 : i - 1];
+	p[1] = &points[i];
+	p[2] = &points[(i + 1) % n];
+	p[3] = &points[(i + 2) % n];
+	return true;
+}
+
+//****************************************************************************
+//
+// * Position on the track
+//============================================================================
+void splinePos(const std::vector<ControlPoint>& points, float t, Pnt3f& pos, int type)
+//============================================================================
+{
+	const glm::mat4* M = splineBasis(type);
+	const ControlPoint* p[4];
+	float percent;
+	if (!M || !splineWindow(points, t, p, percent))
+		return;
+
+	glm::vec4 w = (*M) * glm::vec4(percent*percent*percent, percent*percent, percent, 1);
+	pos = w.x * p[0]->pos + w.y * p[1]->pos + w.z * p[2]->pos + w.w * p[3]->pos;
+}
+
+//****************************************************************************
+//
+// * Direction of travel (unit length)
+//============================================================================
+void splineDir(const std::vector<ControlPoint>& points, float t, Pnt3f& dir, int type)
+//============================================================================
+{
+	const glm::mat4* M = splineBasis(type);
+	const ControlPoint* p[4];
+	float percent;
+	if (!M || !splineWindow(points, t, p, percent))
+		return;
+
+	glm::vec4 w = (*M) * glm::vec4(3 * percent*percent, 2 * percent, 1, 0);
+	dir = w.x * p[0]->pos + w.y * p[1]->pos + w.z * p[2]->pos + w.w * p[3]->pos;
+	dir.normalize();
+}
+
+//****************************************************************************
+//
+// * Up vector of the track (unit length)
+//============================================================================
+void splineOrient(const std::vector<ControlPoint>& points, float t, Pnt3f& up, int type)
+//============================================================================
+{
+	const glm::mat4* M = splineBasis(type);
+	const ControlPoint* p[4];
+	float percent;
+	if (!M || !splineWindow(points, t, p, percent))
+		return;
+
+	glm::vec4 w = (*M) * glm::vec4(percent*percent*percent, percent*percent, percent, 1);
+	up = w.x * p[0]->orient + w.y * p[1]->orient + w.z * p[2]->orient + w.w * p[3]->orient;
+	up.normalize();
+}
+
+//****************************************************************************
+//
+// * Power basis coefficients of one segment
+//============================================================================
+bool splineCoeffs(const std::vector<ControlPoint>& points, size_t i, int type, SplineCoeffs& c)
+//============================================================================
+{
+	const glm::mat4* M = splineBasis(type);
+	const ControlPoint* p[4];
+	float percent;
+	if (!M || !splineWindow(points, (float)i, p, percent))
+		return false;
+
+	glm::mat4x3 G, O;
+	for (int k = 0; k < 4; ++k) {
+		G[k] = glm::vec3(p[k]->pos.x, p[k]->pos.y, p[k]->pos.z);
+		O[k] = glm::vec3(p[k]->orient.x, p[k]->orient.y, p[k]->orient.z);
+	}
+	c.pos = G * (*M);
+	c.orient = O * (*M);
+	return true;
+}
+
+//****************************************************************************
+//
+// * Evaluate a segment from its coefficients
+//============================================================================
+void splineEval(const SplineCoeffs& c, float u, Pnt3f* pos, Pnt3f* dir, Pnt3f* up)
+//============================================================================
+{
+	glm::vec4 T(u*u*u, u*u, u, 1);
+	if (pos) {
+		glm::vec3 q = c.pos * T;
+		*pos = Pnt3f(q.x, q.y, q.z);
+	}
+	if (dir) {
+		glm::vec3 q = c.pos * glm::vec4(3 * u*u, 2 * u, 1, 0);
+		*dir = Pnt3f(q.x, q.y, q.z);
+		dir->normalize();
+	}
+	if (up) {
+		glm::vec3 q = c.orient * T;
+		*up = Pnt3f(q.x, q.y, q.z);
+		up->normalize();
+	}
+}
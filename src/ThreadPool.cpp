@@ -0,0 +1,309 @@
+/************************************************************************
+     File:        ThreadPool.cpp
+
+     Comment:     A few threads to split work over
+
+						see ThreadPool.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include "ThreadPool.H"
+
+// a task, and the group waiting for it. whoever sets taken first runs it
+// - a worker that got it from a queue, or the group's wait
+struct ThreadPool::Task {
+	std::function<void()>	fn;
+	TaskGroup*				group;
+	std::atomic<bool>		taken;
+
+	Task(std::function<void()> fn, TaskGroup* group)
+		: fn(std::move(fn)), group(group), taken(false) {}
+
+	// false if somebody else has it
+	bool run()
+	{
+		if (taken.exchange(true))
+			return false;
+		fn();
+		group->finished();
+		return true;
+	}
+};
+
+// the pool a worker is in, and which one it is - so what it starts goes
+// on its own queue
+static thread_local ThreadPool* ownPool = 0;
+static thread_local size_t ownIndex = 0;
+
+// for the shared pool
+static std::atomic<unsigned int> sharedSize(0);
+static std::atomic<bool> sharedMade(false);
+
+static unsigned int makeShared()
+{
+	sharedMade = true;
+	return sharedSize;
+}
+
+//****************************************************************************
+//
+// * Constructor - start the threads
+//============================================================================
+ThreadPool::
+ThreadPool(unsigned int threads)
+	: queued(0), quit(false)
+//============================================================================
+{
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	for (unsigned int i = 0; i < threads; ++i)
+		queues.push_back(std::unique_ptr<Queue>(new Queue));
+	for (unsigned int i = 1; i < threads; ++i)
+		workers.push_back(std::thread(&ThreadPool::work, this, (size_t)(i - 1)));
+}
+
+//****************************************************************************
+//
+// * Destructor - stop the threads, once the queues are empty
+//============================================================================
+ThreadPool::
+~ThreadPool()
+//============================================================================
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread& t : workers)
+		t.join();
+}
+
+//****************************************************************************
+//
+// * The pool everybody can use
+//============================================================================
+ThreadPool& ThreadPool::
+shared()
+//============================================================================
+{
+	static ThreadPool pool(makeShared());
+	return pool;
+}
+
+//****************************************************************************
+//
+// * Before anybody uses it
+//============================================================================
+bool ThreadPool::
+setSharedSize(unsigned int threads)
+//============================================================================
+{
+	if (sharedMade)
+		return false;
+	sharedSize = threads;
+	return true;
+}
+
+//****************************************************************************
+//
+// * Run a loop on all the threads, and wait for it: the caller and a
+//   helper for each other thread take blocks until there are none left
+//============================================================================
+void ThreadPool::
+parallelFor(size_t begin, size_t end, const std::function<void(size_t)>& fn, size_t grain)
+//============================================================================
+{
+	if (begin >= end)
+		return;
+	if (grain == 0)
+		grain = 1;
+
+	// not worth waking anybody up for
+	size_t blocks = (end - begin + grain - 1) / grain;
+	if (workers.empty() || blocks == 1) {
+		for (size_t i = begin; i < end; ++i)
+			fn(i);
+		return;
+	}
+
+	std::atomic<size_t> next(begin);
+	auto runBlocks = [&]() {
+		for (;;) {
+			size_t first = next.fetch_add(grain);
+			if (first >= end)
+				return;
+			size_t last = (end - first > grain) ? first + grain : end;
+			for (size_t i = first; i < last; ++i)
+				fn(i);
+		}
+	};
+
+	TaskGroup helpers(*this);
+	size_t count = (workers.size() < blocks - 1) ? workers.size() : blocks - 1;
+	for (size_t h = 0; h < count; ++h)
+		helpers.run(runBlocks);
+	runBlocks();
+	// helpers nobody got to find nothing left - the rest finish their
+	// last blocks
+	helpers.wait();
+}
+
+//****************************************************************************
+//
+// * On the end of the caller's queue if it is one of ours, otherwise on
+//   the queue for outsiders - then wake a thread for it
+//============================================================================
+void ThreadPool::
+push(const std::shared_ptr<Task>& task)
+//============================================================================
+{
+	size_t index = (ownPool == this) ? ownIndex : workers.size();
+	{
+		Queue& q = *queues[index];
+		std::lock_guard<std::mutex> guard(q.lock);
+		q.tasks.push_back(task);
+		++queued;
+	}
+	// a worker about to sleep either sees queued, or is asleep in time
+	// to be woken
+	{
+		std::lock_guard<std::mutex> guard(lock);
+	}
+	wake.notify_one();
+}
+
+//****************************************************************************
+//
+// * The newest of our own, or the oldest of anybody else's (the outsiders'
+//   queue is one of them) - starting with the next one along, so the
+//   workers don't all steal from the same one
+//============================================================================
+bool ThreadPool::
+take(size_t index, std::shared_ptr<Task>& task)
+//============================================================================
+{
+	{
+		Queue& q = *queues[index];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+			--queued;
+			return true;
+		}
+	}
+	size_t n = queues.size();
+	for (size_t k = 1; k < n; ++k) {
+		Queue& q = *queues[(index + k) % n];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+			--queued;
+			return true;
+		}
+	}
+	return false;
+}
+
+//****************************************************************************
+//
+// * A worker: do tasks while there are any, sleep when there aren't
+//============================================================================
+void ThreadPool::
+work(size_t index)
+//============================================================================
+{
+	ownPool = this;
+	ownIndex = index;
+	for (;;) {
+		std::shared_ptr<Task> task;
+		if (take(index, task)) {
+			// one a wait already ran is just dropped
+			task->run();
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(lock);
+		wake.wait(guard, [this] { return quit || queued > 0; });
+		if (quit && queued == 0)
+			return;
+	}
+}
+
+//****************************************************************************
+//
+// * Constructor - no tasks yet
+//============================================================================
+TaskGroup::
+TaskGroup(ThreadPool& pool)
+	: pool(pool), pending(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Destructor - the tasks point at us, so they have to be done
+//============================================================================
+TaskGroup::
+~TaskGroup()
+//============================================================================
+{
+	wait();
+}
+
+//****************************************************************************
+//
+// * Queue a task - or just do it, if the pool has no threads of its own
+//============================================================================
+void TaskGroup::
+run(std::function<void()> fn)
+//============================================================================
+{
+	if (pool.workers.empty()) {
+		fn();
+		return;
+	}
+	std::shared_ptr<ThreadPool::Task> task =
+		std::make_shared<ThreadPool::Task>(std::move(fn), this);
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		++pending;
+	}
+	tasks.push_back(task);
+	pool.push(task);
+}
+
+//****************************************************************************
+//
+// * Do the tasks nobody has started, then wait for the ones that did
+//============================================================================
+void TaskGroup::
+wait()
+//============================================================================
+{
+	for (const std::shared_ptr<ThreadPool::Task>& task : tasks)
+		task->run();
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [this] { return pending == 0; });
+	tasks.clear();
+}
+
+//****************************************************************************
+//
+// * One of ours is done - told with the lock held, so the group can't go
+//   (its wait can't return) before this is finished with it
+//============================================================================
+void TaskGroup::
+finished()
+//============================================================================
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (--pending == 0)
+		done.notify_all();
+}
@@ -24,16 +24,40 @@
 
 *************************************************************************/
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <charconv>
+
 #include "Track.H"
+#include "AtomicFile.H"
+#include "MappedFile.H"
+#include "TrackArchive.H"
+#include "TrackFile.H"
+#include "TrackJournal.H"
+#include "TrackReader.H"
+
+// how many edits can be undone
+static const size_t MAX_UNDO = 256;
+
+// the longest line writePoints makes: 6 floats of at most 15 characters
+// ("-1.17549435e-38"), the spaces and the newline - with room to spare
+static const size_t POINT_LINE_MAX = 128;
 
-#include <FL/fl_ask.h>
+// hand back why something didn't work (to whoever asked)
+static bool fail(const char** error, const char* why)
+{
+	if (error)
+		*error = why;
+	return false;
+}
 
 //****************************************************************************
 //
 // * Constructor
 //============================================================================
 CTrack::
-CTrack() : trainU(0)
+CTrack() : revision(0), journal(0), trainU(0), editOpen(false), profileRevision(0), profileType(0)
 //============================================================================
 {
 	resetPoints();
@@ -47,12 +71,14 @@ void CTrack::
 resetPoints()
 //============================================================================
 {
+	reader.close();
 
 	points.clear();
 	points.push_back(ControlPoint(Pnt3f(50,5,0)));
 	points.push_back(ControlPoint(Pnt3f(0,5,50)));
 	points.push_back(ControlPoint(Pnt3f(-50,5,0)));
 	points.push_back(ControlPoint(Pnt3f(0,5,-50)));
+	pointsChanged();
 
 	// we had better put the train back at the start of the track...
 	trainU = 0.0;
@@ -60,119 +86,468 @@ resetPoints()
 
 //****************************************************************************
 //
-// * Handy utility to break a string into a list of words
+// * The text format is simple
+//   first line: an integer with the number of control points
+//	  other lines: one line per control point
+//   either 3 (X,Y,Z) numbers on the line, or 6 numbers (X,Y,Z, orientation)
+//
+//   The numbers are parsed where they are in the file - nothing is
+//   copied, and nothing is allocated but the points
 //============================================================================
-void breakString(char* str, std::vector<const char*>& words) 
+static bool readText(const char* p, const char* end, vector<ControlPoint>& points,
+					 const char** error)
 //============================================================================
 {
-	// start with no words
-	words.clear();
+	// first line = number of points
+	const char* eol = (const char*)memchr(p, '\n', end - p);
+	eol = eol ? eol : end;
+	while (p < eol && *p <= ' ')
+		p++;
+	unsigned long long npts = 0;
+	if (std::from_chars(p, eol, npts).ec != std::errc())
+		npts = 0;
+	p = (eol < end) ? eol + 1 : end;
 
-	// scan through the string, starting at the beginning
-	char* p = str;
+	if (npts < 4)
+		return fail(error, "Illegal Number of Points Specified in File");
 
-	// stop when we hit the end of the string
-	while(*p) {
-		// skip over leading whitespace - stop at the first character or end of string
-		while (*p && *p<=' ') p++;
+	// every point takes a line of at least "0 0 0" - don't believe a
+	// count the file is too small to hold
+	size_t fits = (size_t)(end - p) / 6 + 1;
+	points.clear();
+	points.reserve((npts < fits) ? (size_t)npts : fits);
 
-		// now we're pointing at the first thing after the spaces
-		// make sure its not a comment, and that we're not at the end of the string
-		// (that's actually the same thing)
-		if (! (*p) || *p == '#')
-		break;
+	// get lines until EOF or we have enough points
+	while (points.size() < npts && p < end) {
+		eol = (const char*)memchr(p, '\n', end - p);
+		eol = eol ? eol : end;
 
-		// so we're pointing at a word! add it to the word list
-		words.push_back(p);
+		float v[6];
+		int words = trackLineNumbers(p, eol, v, 6);
+		points.push_back(trackLinePoint(v, words));
+		p = (eol < end) ? eol + 1 : end;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * Read a track - text, the binary format (see TrackFile.H), which
+//   can bring the tables made from the points along with them, or the
+//   compact one (TrackArchive.H)
+//
+//   The file is mapped rather than read
+//============================================================================
+bool CTrack::
+readPoints(const char* filename, const char** error)
+//============================================================================
+{
+	MappedFile file;
+	if (!file.open(filename))
+		return fail(error, "Can't Open File!");
 
-		// now find the end of the word
-		while(*p > ' ') p++;	// stop at space or end of string
+	// none of the readers touch points (or the tables) unless they can
+	// read the whole file - so nothing here is forgotten until then
+	const char* why = 0;
+	if (isTrackFile(file.data(), file.size())) {
+		TrackFileContents got;
+		if (!readTrackFile(file.data(), file.size(), points, &profile, &cache, got, why))
+			return fail(error, why);
+		// the frames that came with it are the cache now; the history
+		// goes as it does for any new points
+		forgetEdits();
+		if (!got.frames)
+			cache.invalidate();
+		if (got.profile) {
+			profileRevision = revision;
+			profileType = profile.type();
+		}
+		if (journal)
+			journal->replaced(points);
+	}
+	else if (isTrackArchive(file.data(), file.size())) {
+		if (!readTrackArchive(file.data(), file.size(), points, why))
+			return fail(error, why);
+		pointsChanged();
+	}
+	else {
+		if (!readText(file.data(), file.data() + file.size(), points, error))
+			return false;
+		pointsChanged();
+	}
+	// a load that was going a chunk at a time is overtaken
+	reader.close();
+	trainU = 0;
+	return true;
+}
 
-		// if its ethe end of the string, we're done
-		if (! *p) break;
+//****************************************************************************
+//
+// * The points, whatever the format - the tables of a binary file stay
+//   where they are
+//============================================================================
+bool CTrack::
+readPointsOnly(const char* filename, vector<ControlPoint>& points, const char** error)
+//============================================================================
+{
+	MappedFile file;
+	if (!file.open(filename))
+		return fail(error, "Can't Open File!");
 
-		// otherwise, turn this space into and end of string (to end the word)
-		// and keep going
-		*p = 0;
-		p++;
+	const char* why = 0;
+	if (isTrackFile(file.data(), file.size())) {
+		TrackFileContents got;
+		if (!readTrackFile(file.data(), file.size(), points, 0, 0, got, why))
+			return fail(error, why);
+		return true;
 	}
+	if (isTrackArchive(file.data(), file.size())) {
+		if (!readTrackArchive(file.data(), file.size(), points, why))
+			return fail(error, why);
+		return true;
+	}
+	return readText(file.data(), file.data() + file.size(), points, error);
 }
 
 //****************************************************************************
 //
-// * The file format is simple
-//   first line: an integer with the number of control points
-//	  other lines: one line per control point
-//   either 3 (X,Y,Z) numbers on the line, or 6 numbers (X,Y,Z, orientation)
+// * Start reading a track a chunk at a time - the first chunk is read
+//   here, so there is a track to show straight away
 //============================================================================
-void CTrack::
-readPoints(const char* filename)
+bool CTrack::
+beginLoad(const char* filename, const char** error)
 //============================================================================
 {
-	FILE* fp = fopen(filename,"r");
-	if (!fp) {
-		fl_alert("Can't Open File!\n");
-	} 
-	else {
-		char buf[512];
-
-		// first line = number of points
-		fgets(buf,512,fp);
-		size_t npts = (size_t) atoi(buf);
-
-		if( (npts<4) || (npts>65535)) {
-			fl_alert("Illegal Number of Points Specified in File");
-		} else {
-			points.clear();
-			// get lines until EOF or we have enough points
-			while( (points.size() < npts) && fgets(buf,512,fp) ) {
-				Pnt3f pos,orient;
-				vector<const char*> words;
-				breakString(buf,words);
-				if (words.size() >= 3) {
-					pos.x = (float) strtod(words[0],0);
-					pos.y = (float) strtod(words[1],0);
-					pos.z = (float) strtod(words[2],0);
-				} else {
-					pos.x=0;
-					pos.y=0;
-					pos.z=0;
-				}
-				if (words.size() >= 6) {
-					orient.x = (float) strtod(words[3],0);
-					orient.y = (float) strtod(words[4],0);
-					orient.z = (float) strtod(words[5],0);
-				} else {
-					orient.x = 0;
-					orient.y = 1;
-					orient.z = 0;
-				}
-				orient.normalize();
-				points.push_back(ControlPoint(pos,orient));
-			}
-		}
-		fclose(fp);
+	if (!reader.open(filename))
+		return fail(error, reader.error());
+	// the tables are what makes a binary file quick - take them
+	if (reader.hasTables()) {
+		reader.close();
+		return readPoints(filename, error);
 	}
+
+	vector<ControlPoint> first;
+	while (reader.read(first) && first.size() < 4)
+		;
+	if (reader.error() || first.empty()) {
+		const char* why = reader.error() ? reader.error() : "Illegal Number of Points Specified in File";
+		reader.close();
+		return fail(error, why);
+	}
+	points.swap(first);
+	pointsChanged();
+	trainU = 0;
+	if (reader.done())
+		reader.close();
+	return true;
+}
+
+//****************************************************************************
+//
+// * The next chunk onto the end - false once the whole file is in
+//============================================================================
+bool CTrack::
+loadMore(size_t count, const char** error)
+//============================================================================
+{
+	if (error)
+		*error = 0;
+	if (!reader.isOpen())
+		return false;
+	size_t from = points.size();
+	reader.read(points, count);
+	if (points.size() > from)
+		pointsAdded(from);
+	if (reader.done()) {
+		if (reader.error())
+			fail(error, reader.error());
+		reader.close();
+	}
+	return reader.isOpen();
+}
+
+float CTrack::
+loadProgress() const
+{
+	if (!reader.isOpen() || reader.expected() == 0)
+		return 1;
+	return (float)reader.delivered() / reader.expected();
+}
+
+//****************************************************************************
+//
+// * One point in or out - the journal only needs to hear about the one
+//============================================================================
+void CTrack::
+insertPoint(size_t i, const ControlPoint& p)
+//============================================================================
+{
+	points.insert(points.begin() + i, p);
+	forgetTables();
+	if (journal)
+		journal->inserted(i, p);
+}
+
+void CTrack::
+deletePoint(size_t i)
+{
+	points.erase(points.begin() + i);
+	forgetTables();
+	if (journal)
+		journal->deleted(i);
+}
+
+//****************************************************************************
+//
+// * a point was moved or rolled - only the samples next to it are stale
+//============================================================================
+void CTrack::
+pointChanged(size_t i)
+//============================================================================
+{
+	cache.pointChanged(i);
+	++revision;
+	if (journal)
+		journal->set(i, points[i]);
+}
+
+//****************************************************************************
+//
+// * points were added or removed - the segments have all shifted
+//============================================================================
+void CTrack::
+pointsChanged()
+//============================================================================
+{
+	forgetTables();
+	if (journal)
+		journal->replaced(points);
+}
+
+void CTrack::
+forgetTables()
+{
+	cache.invalidate();
+	forgetEdits();
+}
+
+void CTrack::
+forgetEdits()
+{
+	++revision;
+
+	// the indices in the history don't mean anything any more
+	undoList.clear();
+	redoList.clear();
+	editOpen = false;
+}
+
+//****************************************************************************
+//
+// * points were added on the end - the ones that were there stay where
+//   they were, so only the segments around the join go stale
+//============================================================================
+void CTrack::
+pointsAdded(size_t from)
+//============================================================================
+{
+	cache.pointsAdded(from);
+	++revision;
+	if (journal)
+		for (size_t i = from; i < points.size(); ++i)
+			journal->inserted(i, points[i]);
+}
+
+//****************************************************************************
+//
+// * Swap in a whole track from somewhere else - its tables come with it,
+//   so nothing is built again
+//============================================================================
+void CTrack::
+takeTrack(CTrack& from)
+//============================================================================
+{
+	reader.close();
+	from.reader.close();
+	points.swap(from.points);
+	std::swap(cache, from.cache);
+	std::swap(profile, from.profile);
+
+	// a new revision, so everything built from the old points goes; the
+	// profile only if it was up to date over there
+	bool profileCurrent = from.profileRevision == from.revision;
+	++revision;
+	++from.revision;
+	profileRevision = profileCurrent ? revision : revision - 1;
+	from.profileRevision = from.revision - 1;
+	std::swap(profileType, from.profileType);
+
+	undoList.clear();
+	redoList.clear();
+	editOpen = false;
+	from.undoList.clear();
+	from.redoList.clear();
+	from.editOpen = false;
+
 	trainU = 0;
+	if (journal)
+		journal->replaced(points);
+}
+
+//****************************************************************************
+//
+// * The profile, up to date with the points
+//============================================================================
+const TrackProfile& CTrack::
+getProfile(int type)
+//============================================================================
+{
+	if (profile.empty() || revision != profileRevision || type != profileType) {
+		profile.update(points, type);
+		profileRevision = revision;
+		profileType = type;
+	}
+	return profile;
 }
 
 //****************************************************************************
 //
-// * write the control points to our simple format
+// * Start an edit of point i - remember how it was
 //============================================================================
 void CTrack::
-writePoints(const char* filename)
-//============================================================================
-{
-	FILE* fp = fopen(filename,"w");
-	if (!fp) {
-		fl_alert("Can't open file for writing");
-	} else {
-		fprintf(fp,"%d\n",points.size());
-		for(size_t i=0; i<points.size(); ++i)
-			fprintf(fp,"%g %g %g %g %g %g\n",
-				points[i].pos.x, points[i].pos.y, points[i].pos.z, 
-				points[i].orient.x, points[i].orient.y, points[i].orient.z);
-		fclose(fp);
+beginEdit(size_t i)
+//============================================================================
+{
+	if (editOpen)
+		endEdit();
+	if (i >= points.size())
+		return;
+	openEdit.index = i;
+	openEdit.before = points[i];
+	editOpen = true;
+}
+
+//****************************************************************************
+//
+// * The edit is done - it goes on the history as one step (if it did
+//   anything)
+//============================================================================
+void CTrack::
+endEdit()
+//============================================================================
+{
+	if (!editOpen)
+		return;
+	editOpen = false;
+
+	const ControlPoint& b = openEdit.before;
+	const ControlPoint& a = points[openEdit.index];
+	if (a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.pos.z == b.pos.z &&
+		a.orient.x == b.orient.x && a.orient.y == b.orient.y && a.orient.z == b.orient.z)
+		return;
+
+	openEdit.after = a;
+	undoList.push_back(openEdit);
+	if (undoList.size() > MAX_UNDO)
+		undoList.erase(undoList.begin());
+	redoList.clear();
+}
+
+//****************************************************************************
+//
+// * Step back (or forward again) through the history
+//============================================================================
+bool CTrack::
+undo()
+//============================================================================
+{
+	endEdit();
+	if (undoList.empty())
+		return false;
+	PointEdit e = undoList.back();
+	undoList.pop_back();
+	applyEdit(e.index, e.before);
+	redoList.push_back(e);
+	return true;
+}
+
+bool CTrack::
+redo()
+{
+	endEdit();
+	if (redoList.empty())
+		return false;
+	PointEdit e = redoList.back();
+	redoList.pop_back();
+	applyEdit(e.index, e.after);
+	undoList.push_back(e);
+	return true;
+}
+
+void CTrack::
+applyEdit(size_t index, const ControlPoint& to)
+{
+	if (index >= points.size())
+		return;
+	points[index] = to;
+	pointChanged(index);
+}
+
+//****************************************************************************
+//
+// * write the control points to our simple format - or, for a name
+//   ending in .trk, the binary one, with whatever tables are up to date,
+//   and for .tkz the compact one (see TrackArchive.H)
+//
+//   Each number is written with as few digits as read back to exactly the
+//   same float, made straight in the output buffer, and the file only
+//   takes the place of the old one once all of it is written (see
+//   AtomicFile.H)
+//============================================================================
+bool CTrack::
+writePoints(const char* filename, const char** error)
+//============================================================================
+{
+	size_t len = strlen(filename);
+	if (len > 4 && !strcmp(filename + len - 4, ".trk")) {
+		if (!writeTrackFile(filename, points, &profile, &cache))
+			return fail(error, "Can't write the file");
+		return true;
+	}
+	// the compact one, as accurate as it is by default
+	if (len > 4 && !strcmp(filename + len - 4, ".tkz")) {
+		const char* why = 0;
+		if (!writeTrackArchive(filename, points, TrackArchiveOptions(), why))
+			return fail(error, why);
+		return true;
+	}
+
+	AtomicFile out;
+	if (!out.open(filename))
+		return fail(error, "Can't open file for writing");
+
+	char* b = out.room(POINT_LINE_MAX);
+	if (b) {
+		char* e = std::to_chars(b, b + POINT_LINE_MAX - 1, points.size()).ptr;
+		*e++ = '\n';
+		out.used(e - b);
+	}
+	for (size_t i = 0; i < points.size(); ++i) {
+		b = out.room(POINT_LINE_MAX);
+		if (!b)
+			break;
+		const float v[6] = { points[i].pos.x, points[i].pos.y, points[i].pos.z,
+							 points[i].orient.x, points[i].orient.y, points[i].orient.z };
+		char* e = b;
+		for (int k = 0; k < 6; ++k) {
+			if (k)
+				*e++ = ' ';
+			e = std::to_chars(e, b + POINT_LINE_MAX - 1, v[k]).ptr;
+		}
+		*e++ = '\n';
+		out.used(e - b);
 	}
+	if (!out.commit())
+		return fail(error, "Can't write the file");
+	return true;
 }
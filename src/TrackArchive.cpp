@@ -0,0 +1,536 @@
+/************************************************************************
+     File:        TrackArchive.cpp
+
+     Comment:     The compact track file, for keeping lots of tracks
+
+						see TrackArchive.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TrackArchive.H"
+#include "AtomicFile.H"
+#include "TrackFile.H"
+
+static const unsigned int METHOD_RAW = 0;
+static const unsigned int METHOD_RANS = 1;
+
+// a position is at most 2^31 steps out, so a difference zigzags to 33
+// bits - 5 bytes - and one on the orientation grid to 3
+static const size_t MAX_POINT_BYTES = 3 * 5 + 2 * 3;
+static const int64_t MAX_STEPS = 0x7FFFFFFF;
+static const uint64_t MAX_ZIGZAG = (uint64_t)1 << 35;
+
+const size_t TrackArchiveDecoder::MAX_BLOCK_SIZE =
+	TrackArchiveDecoder::BLOCK_HEADER_SIZE + TrackArchiveDecoder::BLOCK_POINTS * MAX_POINT_BYTES;
+
+// rANS: the byte counts are scaled to add up to 2^12, and the state is
+// kept between 2^23 and 2^31
+static const int SCALE_BITS = 12;
+static const uint32_t SCALE = 1u << SCALE_BITS;
+static const uint32_t RANS_LOW = 1u << 23;
+
+//****************************************************************************
+//
+// * Little-endian numbers, and the 7 bits a byte ones
+//============================================================================
+static void put32(std::vector<unsigned char>& b, uint32_t x)
+{
+	for (int i = 0; i < 4; ++i)
+		b.push_back((unsigned char)(x >> (8 * i)));
+}
+
+static uint32_t get32(const unsigned char* p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void putVarint(std::vector<unsigned char>& b, uint64_t x)
+{
+	while (x >= 0x80) {
+		b.push_back((unsigned char)(x | 0x80));
+		x >>= 7;
+	}
+	b.push_back((unsigned char)x);
+}
+
+// false if it runs off the end (or goes on too long)
+static bool getVarint(const unsigned char*& p, const unsigned char* end, uint64_t& x)
+{
+	x = 0;
+	for (int shift = 0; shift < 64 && p < end; shift += 7) {
+		unsigned char c = *p++;
+		x |= (uint64_t)(c & 0x7F) << shift;
+		if (!(c & 0x80))
+			return true;
+	}
+	return false;
+}
+
+// 0, -1, 1, -2 ... to 0, 1, 2, 3 ...
+static uint64_t zigzag(int64_t x)
+{
+	return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+}
+
+static int64_t unzigzag(uint64_t x)
+{
+	return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+}
+
+//****************************************************************************
+//
+// * Orientations on the octahedron |x| + |y| + |z| = 1, with the half
+//   below z = 0 folded out over the corners - the square that makes is
+//   the grid
+//============================================================================
+static float signOf(float f)
+{
+	return (f < 0) ? -1.0f : 1.0f;
+}
+
+static void octEncode(const Pnt3f& o, int maxN, int32_t& u, int32_t& v)
+{
+	float l1 = fabsf(o.x) + fabsf(o.y) + fabsf(o.z);
+	float px = 0, py = 1;
+	if (l1 > 0) {
+		px = o.x / l1;
+		py = o.y / l1;
+		if (o.z < 0) {
+			float fx = (1 - fabsf(py)) * signOf(px);
+			py = (1 - fabsf(px)) * signOf(py);
+			px = fx;
+		}
+	}
+	u = (int32_t)lroundf(px * maxN);
+	v = (int32_t)lroundf(py * maxN);
+}
+
+static Pnt3f octDecode(int32_t u, int32_t v, int maxN)
+{
+	float px = (float)u / maxN;
+	float py = (float)v / maxN;
+	float z = 1 - fabsf(px) - fabsf(py);
+	if (z < 0) {
+		float fx = (1 - fabsf(py)) * signOf(px);
+		py = (1 - fabsf(px)) * signOf(py);
+		px = fx;
+	}
+	Pnt3f o(px, py, z);
+	o.normalize();
+	return o;
+}
+
+//****************************************************************************
+//
+// * Entropy code raw into out: which bytes there are (a bit each), their
+//   counts, the final state, then what the coder put out. false if that
+//   isn't smaller than raw
+//============================================================================
+static bool ransEncode(const std::vector<unsigned char>& raw, std::vector<unsigned char>& out)
+//============================================================================
+{
+	if (raw.empty())
+		return false;
+
+	// the counts, scaled to add up to SCALE - every byte that is there
+	// needs at least 1, and the most common one makes up the difference
+	uint32_t count[256] = { 0 };
+	for (size_t i = 0; i < raw.size(); ++i)
+		++count[raw[i]];
+	uint32_t freq[256];
+	uint32_t sum = 0;
+	int most = 0;
+	for (int s = 0; s < 256; ++s) {
+		freq[s] = 0;
+		if (count[s]) {
+			freq[s] = (uint32_t)((uint64_t)count[s] * SCALE / raw.size());
+			if (freq[s] == 0)
+				freq[s] = 1;
+		}
+		sum += freq[s];
+		if (freq[s] > freq[most])
+			most = s;
+	}
+	while (sum > SCALE) {
+		// too many bumped up to 1 - take them off the biggest
+		int big = 0;
+		for (int s = 1; s < 256; ++s)
+			if (freq[s] > freq[big])
+				big = s;
+		uint32_t take = sum - SCALE;
+		if (take > freq[big] - 1)
+			take = freq[big] - 1;
+		freq[big] -= take;
+		sum -= take;
+	}
+	freq[most] += SCALE - sum;
+
+	uint32_t start[256];
+	uint32_t at = 0;
+	out.assign(32, 0);
+	for (int s = 0; s < 256; ++s) {
+		start[s] = at;
+		at += freq[s];
+		if (freq[s]) {
+			out[s >> 3] |= (unsigned char)(1 << (s & 7));
+			putVarint(out, freq[s]);
+		}
+	}
+
+	// the coder works from the last byte back, and what it puts out is
+	// read the other way round
+	std::vector<unsigned char> rev;
+	rev.reserve(raw.size());
+	uint32_t x = RANS_LOW;
+	for (size_t i = raw.size(); i-- > 0;) {
+		uint32_t f = freq[raw[i]];
+		uint32_t xMax = ((RANS_LOW >> SCALE_BITS) << 8) * f;
+		while (x >= xMax) {
+			rev.push_back((unsigned char)x);
+			x >>= 8;
+		}
+		x = ((x / f) << SCALE_BITS) + (x % f) + start[raw[i]];
+	}
+	for (int k = 3; k >= 0; --k)
+		rev.push_back((unsigned char)(x >> (8 * k)));
+	out.insert(out.end(), rev.rbegin(), rev.rend());
+	return out.size() < raw.size();
+}
+
+//****************************************************************************
+//
+// * Decode size bytes into raw - false if what is there doesn't decode to
+//   exactly that
+//============================================================================
+static bool ransDecode(const unsigned char* p, const unsigned char* end,
+					   unsigned char* raw, size_t size)
+//============================================================================
+{
+	if (end - p < 32)
+		return false;
+	const unsigned char* present = p;
+	p += 32;
+
+	uint32_t freq[256];
+	uint32_t start[256];
+	unsigned char symbol[SCALE];
+	uint32_t at = 0;
+	for (int s = 0; s < 256; ++s) {
+		freq[s] = start[s] = 0;
+		if (!(present[s >> 3] & (1 << (s & 7))))
+			continue;
+		uint64_t f;
+		if (!getVarint(p, end, f) || f == 0 || f > SCALE - at)
+			return false;
+		freq[s] = (uint32_t)f;
+		start[s] = at;
+		memset(symbol + at, s, freq[s]);
+		at += freq[s];
+	}
+	if (at != SCALE || end - p < 4)
+		return false;
+
+	uint32_t x = get32(p);
+	p += 4;
+	for (size_t i = 0; i < size; ++i) {
+		uint32_t slot = x & (SCALE - 1);
+		unsigned char s = symbol[slot];
+		raw[i] = s;
+		x = freq[s] * (x >> SCALE_BITS) + slot - start[s];
+		while (x < RANS_LOW) {
+			if (p == end)
+				return false;
+			x = (x << 8) | *p++;
+		}
+	}
+	// back where the coder started, with everything used
+	return x == RANS_LOW && p == end;
+}
+
+//****************************************************************************
+//
+// * Going by the first bytes
+//============================================================================
+bool
+isTrackArchive(const char* data, size_t size)
+//============================================================================
+{
+	return size >= 4 && !memcmp(data, "RCTZ", 4);
+}
+
+//****************************************************************************
+//
+// * Write the archive: the header, then a block at a time
+//============================================================================
+bool
+writeTrackArchive(const char* fname, const std::vector<ControlPoint>& points,
+				  const TrackArchiveOptions& options, const char*& error)
+//============================================================================
+{
+	if (!(options.maxError > 0) || !isfinite(options.maxError) ||
+		options.normalBits < 4 || options.normalBits > 16) {
+		error = "The archive settings don't make sense";
+		return false;
+	}
+	float step = 2 * options.maxError;
+	int maxN = (1 << (options.normalBits - 1)) - 1;
+
+	AtomicFile out;
+	if (!out.open(fname)) {
+		error = "Can't open file for writing";
+		return false;
+	}
+
+	std::vector<unsigned char> head;
+	head.push_back('R');
+	head.push_back('C');
+	head.push_back('T');
+	head.push_back('Z');
+	put32(head, TRACK_ARCHIVE_VERSION);
+	put32(head, (uint32_t)points.size());
+	put32(head, (uint32_t)((uint64_t)points.size() >> 32));
+	uint32_t stepBits;
+	memcpy(&stepBits, &step, 4);
+	put32(head, stepBits);
+	put32(head, options.normalBits);
+	put32(head, (uint32_t)TrackArchiveDecoder::BLOCK_POINTS);
+	put32(head, 0);
+	bool ok = out.write(head.data(), head.size());
+
+	std::vector<unsigned char> raw;
+	std::vector<unsigned char> coded;
+	std::vector<unsigned char> blockHead;
+	int64_t q[3] = { 0, 0, 0 };
+	int64_t dq[3] = { 0, 0, 0 };
+	int32_t n[2] = { 0, 0 };
+	for (size_t first = 0; ok && first < points.size(); first += TrackArchiveDecoder::BLOCK_POINTS) {
+		size_t last = first + TrackArchiveDecoder::BLOCK_POINTS;
+		last = (last < points.size()) ? last : points.size();
+
+		raw.clear();
+		for (size_t i = first; i < last; ++i) {
+			const float p[3] = { points[i].pos.x, points[i].pos.y, points[i].pos.z };
+			for (int k = 0; k < 3; ++k) {
+				double steps = floor((double)p[k] / step + 0.5);
+				if (!(fabs(steps) <= MAX_STEPS)) {
+					error = "A point is too far out to keep that accurately";
+					out.abandon();
+					return false;
+				}
+				putVarint(raw, zigzag((int64_t)steps - (2 * q[k] - dq[k])));
+				dq[k] = q[k];
+				q[k] = (int64_t)steps;
+			}
+			int32_t u, v;
+			octEncode(points[i].orient, maxN, u, v);
+			putVarint(raw, zigzag(u - n[0]));
+			putVarint(raw, zigzag(v - n[1]));
+			n[0] = u;
+			n[1] = v;
+		}
+
+		bool useRans = options.entropy && ransEncode(raw, coded);
+		const std::vector<unsigned char>& stored = useRans ? coded : raw;
+		blockHead.clear();
+		put32(blockHead, (uint32_t)(last - first));
+		put32(blockHead, useRans ? METHOD_RANS : METHOD_RAW);
+		put32(blockHead, (uint32_t)raw.size());
+		put32(blockHead, (uint32_t)stored.size());
+		put32(blockHead, trackFileCrc(0, stored.data(), stored.size()));
+		ok = out.write(blockHead.data(), blockHead.size()) &&
+			 out.write(stored.data(), stored.size());
+	}
+
+	if (!ok || !out.commit()) {
+		error = "Can't write the file";
+		return false;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * Read a whole archive - into a new array, so a damaged one leaves the
+//   points as they were
+//============================================================================
+bool
+readTrackArchive(const char* data, size_t size, std::vector<ControlPoint>& points,
+				 const char*& error)
+//============================================================================
+{
+	TrackArchiveDecoder decoder;
+	if (size < TrackArchiveDecoder::HEADER_SIZE) {
+		error = "Track File is Damaged";
+		return false;
+	}
+	if (!decoder.begin(data, error))
+		return false;
+
+	// don't believe a count the file is too small to hold
+	uint64_t fits = (uint64_t)(size / TrackArchiveDecoder::BLOCK_HEADER_SIZE) *
+					TrackArchiveDecoder::BLOCK_POINTS;
+	std::vector<ControlPoint> got;
+	got.reserve((size_t)((decoder.expected() < fits) ? decoder.expected() : fits));
+
+	size_t at = TrackArchiveDecoder::HEADER_SIZE;
+	while (decoder.delivered() < decoder.expected()) {
+		size_t n;
+		size_t bytes = (size - at >= TrackArchiveDecoder::BLOCK_HEADER_SIZE) ?
+					   decoder.blockSize(data + at, n) : 0;
+		if (bytes == 0 || bytes > size - at) {
+			error = "Track File is Damaged";
+			return false;
+		}
+		if (!decoder.block(data + at, got, error))
+			return false;
+		at += bytes;
+	}
+	points.swap(got);
+	return true;
+}
+
+//****************************************************************************
+//
+// * Constructor - nothing to decode yet
+//============================================================================
+TrackArchiveDecoder::
+TrackArchiveDecoder()
+	: step(0), maxN(0), total(0), decoded(0)
+//============================================================================
+{
+	q[0] = q[1] = q[2] = 0;
+	p0[0] = p0[1] = p0[2] = 0;
+	n[0] = n[1] = 0;
+}
+
+//****************************************************************************
+//
+// * The file header
+//============================================================================
+bool TrackArchiveDecoder::
+begin(const char* header, const char*& error)
+//============================================================================
+{
+	const unsigned char* h = (const unsigned char*)header;
+	if (!isTrackArchive(header, HEADER_SIZE)) {
+		error = "Not a Track Archive";
+		return false;
+	}
+	if (get32(h + 4) > TRACK_ARCHIVE_VERSION) {
+		error = "Track File is from a Newer Version";
+		return false;
+	}
+	uint32_t stepBits = get32(h + 16);
+	memcpy(&step, &stepBits, 4);
+	uint32_t bits = get32(h + 20);
+	if (!(step > 0) || !isfinite(step) || bits < 4 || bits > 16 ||
+		get32(h + 24) != BLOCK_POINTS) {
+		error = "Track File is Damaged";
+		return false;
+	}
+	maxN = (1 << (bits - 1)) - 1;
+	total = get32(h + 8) | (uint64_t)get32(h + 12) << 32;
+	decoded = 0;
+	q[0] = q[1] = q[2] = 0;
+	p0[0] = p0[1] = p0[2] = 0;
+	n[0] = n[1] = 0;
+	return true;
+}
+
+//****************************************************************************
+//
+// * How big the next block is - checked against what a block can be, so
+//   nobody reads megabytes looking for the end of a damaged one
+//============================================================================
+size_t TrackArchiveDecoder::
+blockSize(const char* p, size_t& points) const
+//============================================================================
+{
+	const unsigned char* h = (const unsigned char*)p;
+	points = get32(h);
+	uint32_t method = get32(h + 4);
+	uint32_t rawSize = get32(h + 8);
+	uint32_t stored = get32(h + 12);
+	if (points == 0 || points > BLOCK_POINTS || points > total - decoded ||
+		method > METHOD_RANS || rawSize > points * MAX_POINT_BYTES ||
+		stored > BLOCK_POINTS * MAX_POINT_BYTES || (method == METHOD_RAW && stored != rawSize))
+		return 0;
+	return BLOCK_HEADER_SIZE + stored;
+}
+
+//****************************************************************************
+//
+// * Decode a block straight onto the end of out
+//============================================================================
+bool TrackArchiveDecoder::
+block(const char* p, std::vector<ControlPoint>& out, const char*& error)
+//============================================================================
+{
+	error = "Track File is Damaged";
+	size_t points;
+	size_t size = blockSize(p, points);
+	if (size == 0)
+		return false;
+	const unsigned char* h = (const unsigned char*)p;
+	const unsigned char* data = h + BLOCK_HEADER_SIZE;
+	size_t stored = size - BLOCK_HEADER_SIZE;
+	size_t rawSize = get32(h + 8);
+	if (trackFileCrc(0, data, stored) != get32(h + 16))
+		return false;
+
+	const unsigned char* r = data;
+	if (get32(h + 4) == METHOD_RANS) {
+		scratch.resize(rawSize);
+		if (!ransDecode(data, data + stored, scratch.data(), rawSize))
+			return false;
+		r = scratch.data();
+	}
+	const unsigned char* end = r + rawSize;
+
+	size_t before = out.size();
+	int64_t nq[3] = { q[0], q[1], q[2] };
+	int64_t np[3] = { p0[0], p0[1], p0[2] };
+	int64_t nn[2] = { n[0], n[1] };
+	bool ok = true;
+	for (size_t i = 0; ok && i < points; ++i) {
+		// no difference can be bigger than the writer could make
+		uint64_t d[5];
+		for (int k = 0; ok && k < 5; ++k)
+			ok = getVarint(r, end, d[k]) && d[k] < MAX_ZIGZAG;
+		if (!ok)
+			break;
+		ControlPoint c;
+		for (int k = 0; k < 3; ++k) {
+			int64_t next = 2 * nq[k] - np[k] + unzigzag(d[k]);
+			np[k] = nq[k];
+			nq[k] = next;
+		}
+		c.pos = Pnt3f((float)(nq[0] * (double)step), (float)(nq[1] * (double)step),
+					  (float)(nq[2] * (double)step));
+		nn[0] += unzigzag(d[3]);
+		nn[1] += unzigzag(d[4]);
+		ok = llabs(nn[0]) <= maxN && llabs(nn[1]) <= maxN;
+		c.orient = octDecode((int32_t)nn[0], (int32_t)nn[1], maxN);
+		out.push_back(c);
+	}
+	if (!ok || r != end) {
+		out.resize(before);
+		return false;
+	}
+
+	for (int k = 0; k < 3; ++k) {
+		q[k] = nq[k];
+		p0[k] = np[k];
+	}
+	n[0] = (int32_t)nn[0];
+	n[1] = (int32_t)nn[1];
+	decoded += points;
+	error = 0;
+	return true;
+}
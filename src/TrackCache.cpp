@@ -0,0 +1,395 @@
+/************************************************************************
+     File:        TrackCache.cpp
+
+     Comment:     Cached frame table of the track
+
+						see TrackCache.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+#include <atomic>
+
+#include "TrackCache.H"
+
+// the revision the next segment built gets, in any cache (they are built on
+// more than one thread - see TrackLoader.H)
+static std::atomic<unsigned int> nextRevision(1);
+
+// a slot not handed out yet
+static const size_t NO_SLOT = (size_t)-1;
+
+//****************************************************************************
+//
+// * Constructor - starts out empty
+//============================================================================
+TrackCache::
+TrackCache()
+	: count(0), first(0), focus(0), cachedType(0), cachedTieSpacing(0), allDirty(true),
+	  addedFrom(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Segment i uses the points i-1 .. i+2, so point i shows up in the
+//   segments i-2 .. i+1
+//============================================================================
+void TrackCache::
+pointChanged(size_t i)
+//============================================================================
+{
+	size_t n = count;
+	if (n == 0 || i >= n) {
+		allDirty = true;
+		return;
+	}
+	for (size_t k = 0; k < 4; ++k)
+		markDirty((i + n + k - 2) % n);
+}
+
+void TrackCache::
+markDirty(size_t seg)
+{
+	if (resident(seg))
+		slots[slot(seg)].dirty = true;
+}
+
+//****************************************************************************
+//
+// * Throw it all away
+//============================================================================
+void TrackCache::
+invalidate()
+//============================================================================
+{
+	allDirty = true;
+	addedFrom = 0;
+}
+
+//****************************************************************************
+//
+// * Segments n-2 and n-1 ran on round to points 0 and 1, and segment 0
+//   started from point n-1 - now they have the new points instead.
+//   remember only the first add until prepare, the segments after it are
+//   all new anyway
+//============================================================================
+void TrackCache::
+pointsAdded(size_t from)
+//============================================================================
+{
+	if (allDirty || addedFrom)
+		return;
+	if (from < 3 || from != count) {
+		allDirty = true;
+		return;
+	}
+	addedFrom = from;
+}
+
+//****************************************************************************
+//
+// * Size the table, put the window where it has to be and collect the
+//   dirty segments
+//============================================================================
+void TrackCache::
+prepare(const std::vector<ControlPoint>& points, int type, float tieSpacing)
+//============================================================================
+{
+	size_t n = points.size();
+	size_t added = 0;
+	if (addedFrom && addedFrom == count && n > addedFrom &&
+		type == cachedType && tieSpacing == cachedTieSpacing)
+		added = addedFrom;
+	else if (n != count || type != cachedType || tieSpacing != cachedTieSpacing) {
+		cachedType = type;
+		cachedTieSpacing = tieSpacing;
+		allDirty = true;
+	}
+
+	size_t oldCount = count;
+	count = n;
+	placeWindow(oldCount);
+	if (added) {
+		// the new segments came into the window dirty - these ran on round
+		// to the start before
+		markDirty(0);
+		markDirty(added - 2);
+		markDirty(added - 1);
+	}
+
+	dirty.clear();
+	for (size_t k = 0; k < order.size(); ++k) {
+		Segment& s = slots[order[k]];
+		if (allDirty || s.dirty) {
+			// hand out the revision here so rebuildSegment doesn't have to
+			// share a counter between threads
+			s.revision = nextRevision++;
+			s.dirty = false;
+			dirty.push_back(s.seg);
+		}
+	}
+	allDirty = false;
+	addedFrom = 0;
+}
+
+//****************************************************************************
+//
+// * Where the window starts: where it is, as long as the focus is well
+//   inside it, otherwise a little behind the focus (the train goes
+//   forward more than back)
+//============================================================================
+size_t TrackCache::
+windowFor(size_t seg) const
+//============================================================================
+{
+	if (count <= WINDOW)
+		return 0;
+	seg %= count;
+	size_t off = (seg + count - first % count) % count;
+	if (order.size() == WINDOW && off >= MARGIN / 2 && off < WINDOW - MARGIN)
+		return first % count;
+	return (seg + count - MARGIN) % count;
+}
+
+bool TrackCache::
+setFocus(size_t seg)
+{
+	focus = seg;
+	return count > WINDOW && windowFor(seg) != first;
+}
+
+//****************************************************************************
+//
+// * Move the window. The segments that were in it and still are keep
+//   their slots (and tables); the ones that come in take the slots of the
+//   ones that went, and are dirty. If everything is dirty anyway, the
+//   slots are just handed out again in order
+//============================================================================
+void TrackCache::
+placeWindow(size_t oldCount)
+//============================================================================
+{
+	size_t size = (count < WINDOW) ? count : WINDOW;
+	size_t start = windowFor(focus);
+	if (!allDirty && start == first && size == order.size() && count == oldCount)
+		return;
+
+	std::vector<size_t> was;
+	was.swap(order);
+	size_t oldFirst = first;
+	first = start;
+	order.assign(size, NO_SLOT);
+
+	if (allDirty) {
+		slots.resize(size);
+		// a track that got shorter gives back what it doesn't need
+		slots.shrink_to_fit();
+		for (size_t k = 0; k < size; ++k) {
+			order[k] = k;
+			slots[k].seg = windowSegment(k);
+			slots[k].dirty = true;
+		}
+		return;
+	}
+
+	// the same number of segments or more (points added on the end), so
+	// the window is the same size or bigger
+	std::vector<bool> taken(size, false);
+	for (size_t k = 0; k < size; ++k) {
+		size_t seg = windowSegment(k);
+		if (seg >= oldCount)
+			continue;
+		size_t pos = (seg + oldCount - oldFirst) % oldCount;
+		if (pos < was.size()) {
+			order[k] = was[pos];
+			taken[was[pos]] = true;
+		}
+	}
+	slots.resize(size);
+	size_t free = 0;
+	for (size_t k = 0; k < size; ++k) {
+		if (order[k] != NO_SLOT)
+			continue;
+		while (taken[free])
+			++free;
+		taken[free] = true;
+		order[k] = free;
+		Segment& s = slots[free];
+		s.seg = windowSegment(k);
+		s.frames.clear();
+		s.ties.clear();
+		s.length = 0;
+		s.revision = 0;
+		s.dirty = true;
+	}
+}
+
+//****************************************************************************
+//
+// * Is a segment in the window, and its tables
+//============================================================================
+bool TrackCache::
+resident(size_t seg) const
+//============================================================================
+{
+	return seg < count && (seg + count - first) % count < order.size();
+}
+
+const TrackCache::Segment& TrackCache::
+segment(size_t seg) const
+{
+	static const Segment none = Segment();
+	return resident(seg) ? slots[slot(seg)] : none;
+}
+
+//****************************************************************************
+//
+// * Resample one segment of the window
+//============================================================================
+void TrackCache::
+rebuildSegment(const std::vector<ControlPoint>& points, size_t seg)
+//============================================================================
+{
+	if (resident(seg))
+		sample(points, seg, slots[slot(seg)]);
+}
+
+void TrackCache::
+sampleSegment(const std::vector<ControlPoint>& points, size_t seg,
+			  std::vector<TrackFrame>& frames, std::vector<TrackFrame>& ties) const
+{
+	// sampled into what frames and ties had room for
+	Segment s;
+	s.frames.swap(frames);
+	s.ties.swap(ties);
+	sample(points, seg, s);
+	frames.swap(s.frames);
+	ties.swap(s.ties);
+}
+
+//****************************************************************************
+//
+// * Walk one segment in small steps, the same way the train does, keeping
+//   every few steps as a frame and dropping ties along the way
+//============================================================================
+void TrackCache::
+sample(const std::vector<ControlPoint>& points, size_t seg, Segment& s) const
+//============================================================================
+{
+	s.frames.clear();
+	s.ties.clear();
+	s.length = 0;
+	if (!splineCoeffs(points, seg, cachedType, s.coeffs))
+		return;
+
+	s.frames.reserve(FRAMES_PER_SEGMENT + 1);
+	const int frameEvery = STEPS_PER_SEGMENT / FRAMES_PER_SEGMENT;
+
+	TrackFrame f;
+	f.dist = 0;
+	splineEval(s.coeffs, 0, &f.pos, &f.dir, &f.up);
+	f.cross = f.dir * f.up;
+	f.cross.normalize();
+	s.frames.push_back(f);
+
+	Pnt3f pv = f.pos;
+	float distSum = 0;
+	for (int j = 0; j < STEPS_PER_SEGMENT; ++j) {
+		float u = (float)(j + 1) / STEPS_PER_SEGMENT;
+		Pnt3f cv;
+		splineEval(s.coeffs, u, &cv, 0, 0);
+		Pnt3f d = cv - pv;
+		float step = sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+		s.length += step;
+		distSum += step;
+
+		bool frame = ((j + 1) % frameEvery == 0);
+		bool tie = (cachedTieSpacing <= 0) ? (j % (STEPS_PER_SEGMENT / 10) == 0)
+										   : (distSum >= cachedTieSpacing);
+		if (frame || tie) {
+			f.pos = cv;
+			f.dist = s.length;
+			splineEval(s.coeffs, u, 0, &f.dir, &f.up);
+			f.cross = f.dir * f.up;
+			f.cross.normalize();
+			if (frame)
+				s.frames.push_back(f);
+			if (tie) {
+				distSum = 0;
+				s.ties.push_back(f);
+			}
+		}
+		pv = cv;
+	}
+}
+
+//****************************************************************************
+//
+// * Do it all in one go
+//============================================================================
+size_t TrackCache::
+update(const std::vector<ControlPoint>& points, int type, float tieSpacing)
+//============================================================================
+{
+	prepare(points, type, tieSpacing);
+	for (size_t i = 0; i < dirty.size(); ++i)
+		rebuildSegment(points, dirty[i]);
+	return dirty.size();
+}
+
+//****************************************************************************
+//
+// * Is every segment up to date
+//============================================================================
+bool TrackCache::
+clean() const
+//============================================================================
+{
+	if (allDirty || addedFrom)
+		return false;
+	for (size_t i = 0; i < slots.size(); ++i)
+		if (slots[i].dirty)
+			return false;
+	return true;
+}
+
+//****************************************************************************
+//
+// * Take a table made somewhere else - only the segments in the window
+//   are kept, the others are passed over
+//============================================================================
+void TrackCache::
+restore(size_t segs, int type, float tieSpacing)
+//============================================================================
+{
+	size_t oldCount = count;
+	count = segs;
+	cachedType = type;
+	cachedTieSpacing = tieSpacing;
+	allDirty = true;
+	placeWindow(oldCount);
+	allDirty = false;
+	addedFrom = 0;
+	dirty.clear();
+	for (size_t i = 0; i < slots.size(); ++i)
+		slots[i].dirty = false;
+}
+
+void TrackCache::
+restoreSegment(size_t seg, const SplineCoeffs& c, float length,
+			   const TrackFrame* frames, const TrackFrame* ties, size_t nTies)
+{
+	if (!resident(seg))
+		return;
+	Segment& s = slots[slot(seg)];
+	s.coeffs = c;
+	s.length = length;
+	s.frames.assign(frames, frames + FRAMES_PER_SEGMENT + 1);
+	s.ties.assign(ties, ties + nTies);
+	s.revision = nextRevision++;
+	s.dirty = false;
+}
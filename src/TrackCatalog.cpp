@@ -0,0 +1,482 @@
+/************************************************************************
+     File:        TrackCatalog.cpp
+
+     Comment:     What is in a directory of tracks
+
+						see TrackCatalog.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <ctype.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+
+#include "TrackCatalog.H"
+#include "AtomicFile.H"
+#include "MappedFile.H"
+#include "Spline.H"
+#include "ThreadPool.H"
+#include "Track.H"
+#include "TrackFile.H"
+
+namespace fs = std::filesystem;
+
+const char* const TrackCatalog::INDEX_NAME = "catalog.idx";
+
+// "RCTI", then the version and the thumbnail size - an index made with
+// other thumbnails is thrown away
+static const unsigned char INDEX_MAGIC[4] = { 'R', 'C', 'T', 'I' };
+static const unsigned int INDEX_VERSION = 1;
+static const size_t INDEX_HEADER_SIZE = 4 + 4 + 4 + 8;
+
+// how every track is sampled for the catalog - the length along a
+// hundred straight pieces a segment is within a tenth of a percent of
+// what the cache gets with a thousand
+static const int CATALOG_TYPE = 2;
+static const int CATALOG_STEPS = 100;
+
+static const size_t THUMB_BYTES = TrackCatalog::THUMB_SIZE * TrackCatalog::THUMB_SIZE;
+// pixels left empty around the track in a thumbnail
+static const int THUMB_MARGIN = 2;
+
+//****************************************************************************
+//
+// * Little-endian numbers
+//============================================================================
+static void put32(std::vector<unsigned char>& b, uint32_t x)
+{
+	for (int i = 0; i < 4; ++i)
+		b.push_back((unsigned char)(x >> (8 * i)));
+}
+
+static void put64(std::vector<unsigned char>& b, uint64_t x)
+{
+	put32(b, (uint32_t)x);
+	put32(b, (uint32_t)(x >> 32));
+}
+
+static void putFloat(std::vector<unsigned char>& b, float f)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, 4);
+	put32(b, bits);
+}
+
+static uint32_t get32(const unsigned char* p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get64(const unsigned char* p)
+{
+	return get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+static float getFloat(const unsigned char* p)
+{
+	uint32_t bits = get32(p);
+	float f;
+	memcpy(&f, &bits, 4);
+	return f;
+}
+
+//****************************************************************************
+//
+// * The files the program can load
+//============================================================================
+static bool isTrackFile(const fs::path& p)
+{
+	std::string ext = p.extension().string();
+	for (size_t i = 0; i < ext.size(); ++i)
+		ext[i] = (char)tolower((unsigned char)ext[i]);
+	return ext == ".txt" || ext == ".trk" || ext == ".tkz";
+}
+
+//****************************************************************************
+//
+// * Empty, and stale
+//============================================================================
+TrackSummary::
+TrackSummary()
+	: size(0), time(0), stale(true), readable(false), points(0),
+	  length(0), maxHeight(0)
+{
+}
+
+//****************************************************************************
+//
+// * Constructor - no directory yet
+//============================================================================
+TrackCatalog::
+TrackCatalog()
+{
+}
+
+//****************************************************************************
+//
+// * Read the index, then list the directory: what the index has for a
+//   file of the same size and time stays, everything else is stale
+//============================================================================
+bool TrackCatalog::
+open(const char* dirName, const char*& error)
+//============================================================================
+{
+	dir = dirName;
+	entries.clear();
+
+	std::vector<TrackSummary> indexed;
+	readIndex(indexed);
+	std::unordered_map<std::string, size_t> byName;
+	for (size_t i = 0; i < indexed.size(); ++i)
+		byName[indexed[i].name] = i;
+
+	std::error_code ec;
+	fs::directory_iterator it(fs::u8path(dir), ec);
+	if (ec) {
+		error = "Can't list the directory";
+		return false;
+	}
+	for (; it != fs::directory_iterator(); it.increment(ec)) {
+		if (ec) {
+			error = "Can't list the directory";
+			entries.clear();
+			return false;
+		}
+		const fs::directory_entry& e = *it;
+		std::error_code fileError;
+		if (!e.is_regular_file(fileError) || !isTrackFile(e.path()))
+			continue;
+		TrackSummary t;
+		t.name = e.path().filename().u8string();
+		t.size = (uint64_t)e.file_size(fileError);
+		t.time = (int64_t)e.last_write_time(fileError).time_since_epoch().count();
+		if (fileError)
+			continue;
+
+		auto found = byName.find(t.name);
+		if (found != byName.end()) {
+			TrackSummary& old = indexed[found->second];
+			if (old.size == t.size && old.time == t.time) {
+				entries.push_back(std::move(old));
+				continue;
+			}
+		}
+		entries.push_back(std::move(t));
+	}
+
+	std::sort(entries.begin(), entries.end(),
+			  [](const TrackSummary& a, const TrackSummary& b) { return a.name < b.name; });
+	return true;
+}
+
+//****************************************************************************
+//
+// * The stale tracks, a track to a thread at a time
+//============================================================================
+size_t TrackCatalog::
+reindex(ThreadPool* pool, std::atomic<size_t>* done, const std::atomic<bool>* stop)
+//============================================================================
+{
+	std::vector<size_t> todo;
+	for (size_t i = 0; i < entries.size(); ++i)
+		if (entries[i].stale)
+			todo.push_back(i);
+
+	std::atomic<size_t> read(0);
+	if (!pool)
+		pool = &ThreadPool::shared();
+	pool->parallelFor(0, todo.size(), [&](size_t i) {
+		if (stop && *stop)
+			return;
+		TrackSummary& t = entries[todo[i]];
+		summarize(path(todo[i]).c_str(), t);
+		++read;
+		if (done)
+			++*done;
+	});
+	return read;
+}
+
+//****************************************************************************
+//
+// * Everything about one track
+//============================================================================
+void TrackCatalog::
+summarize(const char* fname, TrackSummary& t)
+//============================================================================
+{
+	t.stale = false;
+	t.readable = false;
+	t.error.clear();
+	t.points = 0;
+	t.lo = t.hi = Pnt3f(0, 0, 0);
+	t.length = t.maxHeight = 0;
+	t.thumbnail.assign(THUMB_BYTES, 0);
+
+	// the points only - a binary file's tables, like the cache, would
+	// take gigabytes for a big track, and several tracks are read at once
+	std::vector<ControlPoint> points;
+	const char* error = 0;
+	if (!CTrack::readPointsOnly(fname, points, &error)) {
+		t.error = error ? error : "Can't read it";
+		return;
+	}
+	t.readable = true;
+	t.points = points.size();
+
+	// straight from the spline, not through the cache, for the same
+	// reason. first the box and the length
+	std::vector<float> lengths(points.size());
+	bool first = true;
+	double length = 0;
+	SplineCoeffs c;
+	for (size_t s = 0; s < points.size(); ++s) {
+		if (!splineCoeffs(points, s, CATALOG_TYPE, c))
+			continue;
+		Pnt3f prev;
+		float segment = 0;
+		for (int k = 0; k <= CATALOG_STEPS; ++k) {
+			Pnt3f p;
+			splineEval(c, (float)k / CATALOG_STEPS, &p, 0, 0);
+			if (first) {
+				t.lo = t.hi = p;
+				first = false;
+			}
+			t.lo.x = std::min(t.lo.x, p.x);
+			t.lo.y = std::min(t.lo.y, p.y);
+			t.lo.z = std::min(t.lo.z, p.z);
+			t.hi.x = std::max(t.hi.x, p.x);
+			t.hi.y = std::max(t.hi.y, p.y);
+			t.hi.z = std::max(t.hi.z, p.z);
+			if (k) {
+				Pnt3f d = p - prev;
+				segment += sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+			}
+			prev = p;
+		}
+		lengths[s] = segment;
+		length += segment;
+	}
+	t.length = (float)length;
+	t.maxHeight = t.hi.y;
+	if (first)
+		return;
+
+	// then the picture: looking down, x across and z down the page, the
+	// longer side filling it. lines between points along the track -
+	// only as many as the segment covers pixels - and where two parts of
+	// the track cross, the higher one is seen
+	const int N = THUMB_SIZE;
+	float w = t.hi.x - t.lo.x;
+	float d = t.hi.z - t.lo.z;
+	float extent = std::max(std::max(w, d), 1e-6f);
+	float scale = (N - 1 - 2 * THUMB_MARGIN) / extent;
+	float offX = THUMB_MARGIN + 0.5f * ((N - 1 - 2 * THUMB_MARGIN) - w * scale);
+	float offZ = THUMB_MARGIN + 0.5f * ((N - 1 - 2 * THUMB_MARGIN) - d * scale);
+	float rise = t.hi.y - t.lo.y;
+
+	auto level = [&](float y) {
+		if (rise <= 0)
+			return 128.0f;
+		return 1 + 254 * (y - t.lo.y) / rise;
+	};
+	auto plot = [&](int x, int z, unsigned char l) {
+		if (x < 0 || z < 0 || x >= N || z >= N)
+			return;
+		unsigned char& p = t.thumbnail[(size_t)z * N + x];
+		if (l > p)
+			p = l;
+	};
+
+	for (size_t s = 0; s < points.size(); ++s) {
+		if (!splineCoeffs(points, s, CATALOG_TYPE, c))
+			continue;
+		int steps = std::min(CATALOG_STEPS, (int)ceilf(lengths[s] * scale) + 1);
+		Pnt3f a;
+		splineEval(c, 0, &a, 0, 0);
+		for (int k = 1; k <= steps; ++k) {
+			Pnt3f b;
+			splineEval(c, (float)k / steps, &b, 0, 0);
+			float ax = offX + (a.x - t.lo.x) * scale, az = offZ + (a.z - t.lo.z) * scale;
+			float bx = offX + (b.x - t.lo.x) * scale, bz = offZ + (b.z - t.lo.z) * scale;
+			float la = level(a.y), lb = level(b.y);
+			int pixels = (int)ceilf(std::max(fabsf(bx - ax), fabsf(bz - az)));
+			for (int i = 0; i <= pixels; ++i) {
+				float u = pixels ? (float)i / pixels : 0;
+				plot((int)(ax + u * (bx - ax) + 0.5f), (int)(az + u * (bz - az) + 0.5f),
+					 (unsigned char)(la + u * (lb - la) + 0.5f));
+			}
+			a = b;
+		}
+	}
+}
+
+//****************************************************************************
+//
+// * Low track blue, high track red
+//============================================================================
+void TrackCatalog::
+thumbnailColor(unsigned char l, unsigned char rgb[3])
+//============================================================================
+{
+	if (l == 0) {
+		rgb[0] = rgb[1] = rgb[2] = 32;
+		return;
+	}
+	float u = (l - 1) / 254.0f;
+	rgb[0] = (unsigned char)(64 + 191 * u);
+	rgb[1] = (unsigned char)(96 + 96 * (1 - fabsf(2 * u - 1)));
+	rgb[2] = (unsigned char)(255 - 191 * u);
+}
+
+//****************************************************************************
+//
+// * How many still have to be read
+//============================================================================
+size_t TrackCatalog::
+staleCount() const
+//============================================================================
+{
+	size_t n = 0;
+	for (const TrackSummary& t : entries)
+		n += t.stale;
+	return n;
+}
+
+//****************************************************************************
+//
+// * Where a track is
+//============================================================================
+std::string TrackCatalog::
+path(size_t i) const
+//============================================================================
+{
+	return (fs::u8path(dir) / fs::u8path(entries[i].name)).u8string();
+}
+
+//****************************************************************************
+//
+// * The index is a header, the tracks, and a checksum of all of it
+//
+//   a track: the name (its length, then the bytes), size, time, points,
+//   whether it could be read, then either the box, length, height and
+//   thumbnail or the reason it couldn't
+//============================================================================
+bool TrackCatalog::
+save(const char*& error) const
+//============================================================================
+{
+	std::vector<unsigned char> b;
+	b.insert(b.end(), INDEX_MAGIC, INDEX_MAGIC + 4);
+	put32(b, INDEX_VERSION);
+	put32(b, THUMB_SIZE);
+	put64(b, entries.size() - staleCount());
+
+	for (const TrackSummary& t : entries) {
+		if (t.stale)
+			continue;
+		put32(b, (uint32_t)t.name.size());
+		b.insert(b.end(), t.name.begin(), t.name.end());
+		put64(b, t.size);
+		put64(b, (uint64_t)t.time);
+		put64(b, t.points);
+		b.push_back(t.readable);
+		if (t.readable) {
+			const float f[8] = { t.lo.x, t.lo.y, t.lo.z, t.hi.x, t.hi.y, t.hi.z,
+								 t.length, t.maxHeight };
+			for (int i = 0; i < 8; ++i)
+				putFloat(b, f[i]);
+			b.insert(b.end(), t.thumbnail.begin(), t.thumbnail.end());
+		}
+		else {
+			put32(b, (uint32_t)t.error.size());
+			b.insert(b.end(), t.error.begin(), t.error.end());
+		}
+	}
+	put32(b, trackFileCrc(0, b.data(), b.size()));
+
+	std::string fname = (fs::u8path(dir) / INDEX_NAME).u8string();
+	AtomicFile file;
+	if (!file.open(fname.c_str()) || !file.write(b.data(), b.size()) || !file.commit()) {
+		error = "Can't write the catalog";
+		return false;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * Everything in the index, or nothing if any of it is wrong
+//============================================================================
+bool TrackCatalog::
+readIndex(std::vector<TrackSummary>& indexed) const
+//============================================================================
+{
+	indexed.clear();
+	std::string fname = (fs::u8path(dir) / INDEX_NAME).u8string();
+	MappedFile file;
+	if (!file.open(fname.c_str()) || file.size() < INDEX_HEADER_SIZE + 4)
+		return false;
+
+	const unsigned char* p = (const unsigned char*)file.data();
+	size_t size = file.size() - 4;
+	if (memcmp(p, INDEX_MAGIC, 4) || get32(p + 4) != INDEX_VERSION ||
+		get32(p + 8) != THUMB_SIZE || get32(p + size) != trackFileCrc(0, p, size))
+		return false;
+
+	std::vector<TrackSummary> read;
+	uint64_t count = get64(p + 12);
+	size_t at = INDEX_HEADER_SIZE;
+	auto has = [&](size_t n) { return n <= size - at; };
+	for (uint64_t i = 0; i < count; ++i) {
+		TrackSummary t;
+		if (!has(4))
+			return false;
+		size_t n = get32(p + at);
+		at += 4;
+		if (!has(n + 8 + 8 + 8 + 1))
+			return false;
+		t.name.assign((const char*)p + at, n);
+		at += n;
+		t.size = get64(p + at);
+		t.time = (int64_t)get64(p + at + 8);
+		t.points = (size_t)get64(p + at + 16);
+		t.readable = p[at + 24] != 0;
+		at += 25;
+		t.stale = false;
+		if (t.readable) {
+			if (!has(8 * 4 + THUMB_BYTES))
+				return false;
+			float f[8];
+			for (int k = 0; k < 8; ++k)
+				f[k] = getFloat(p + at + 4 * k);
+			t.lo = Pnt3f(f[0], f[1], f[2]);
+			t.hi = Pnt3f(f[3], f[4], f[5]);
+			t.length = f[6];
+			t.maxHeight = f[7];
+			at += 8 * 4;
+			t.thumbnail.assign(p + at, p + at + THUMB_BYTES);
+			at += THUMB_BYTES;
+		}
+		else {
+			if (!has(4))
+				return false;
+			n = get32(p + at);
+			at += 4;
+			if (!has(n))
+				return false;
+			t.error.assign((const char*)p + at, n);
+			at += n;
+		}
+		read.push_back(std::move(t));
+	}
+	if (at != size)
+		return false;
+	indexed.swap(read);
+	return true;
+}
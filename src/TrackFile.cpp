@@ -0,0 +1,535 @@
+/************************************************************************
+     File:        TrackFile.cpp
+
+     Comment:     The binary track file
+
+						see TrackFile.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "TrackFile.H"
+#include "AtomicFile.H"
+#include "Spline.H"
+#include "TrackCache.H"
+#include "TrackProfile.H"
+
+// the arrays go to and from the file as runs of 4 byte words
+static_assert(sizeof(ControlPoint) == 6 * sizeof(float), "a point is 6 floats");
+static_assert(sizeof(TrackFrame) == 13 * sizeof(float), "a frame is 13 floats");
+static_assert(sizeof(SplineCoeffs) == 24 * sizeof(float), "a segment is 24 floats");
+
+static const size_t HEADER_SIZE = 32;
+static const size_t ENTRY_SIZE = 32;
+static const size_t POINT_WORDS = 6;
+static const size_t FRAME_WORDS = 13;
+static const size_t COEFF_WORDS = 24;
+
+// the tags are the 4 letters, read as a little-endian number
+static const uint32_t TAG_POINTS = 'P' | 'N' << 8 | 'T' << 16 | 'S' << 24;
+static const uint32_t TAG_COEFFS = 'C' | 'O' << 8 | 'E' << 16 | 'F' << 24;
+static const uint32_t TAG_ARCS   = 'A' | 'R' << 8 | 'C' << 16 | 'L' << 24;
+static const uint32_t TAG_FRAMES = 'F' | 'R' << 8 | 'A' << 16 | 'M' << 24;
+
+static bool littleEndian()
+{
+	const uint32_t one = 1;
+	return *(const unsigned char*)&one == 1;
+}
+
+static void swapWords(void* p, size_t words)
+{
+	unsigned char* b = (unsigned char*)p;
+	for (size_t i = 0; i < words; ++i, b += 4) {
+		unsigned char t0 = b[0], t1 = b[1];
+		b[0] = b[3];
+		b[1] = b[2];
+		b[2] = t1;
+		b[3] = t0;
+	}
+}
+
+//****************************************************************************
+//
+// * CRC-32 (the one zip uses), 8 bytes at a time from 8 tables - the
+//   files run to hundreds of megabytes, and a byte at a time would take
+//   longer than reading them
+//============================================================================
+uint32_t
+trackFileCrc(uint32_t crc, const void* data, size_t size)
+//============================================================================
+{
+	struct Tables {
+		uint32_t entry[8][256];
+		Tables() {
+			for (uint32_t i = 0; i < 256; ++i) {
+				uint32_t c = i;
+				for (int k = 0; k < 8; ++k)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				entry[0][i] = c;
+			}
+			// entry[k][i]: byte i followed by k zero bytes
+			for (uint32_t i = 0; i < 256; ++i)
+				for (int k = 1; k < 8; ++k)
+					entry[k][i] = entry[0][entry[k - 1][i] & 0xFF] ^ (entry[k - 1][i] >> 8);
+		}
+	};
+	static const Tables table;
+	const uint32_t (*t)[256] = table.entry;
+
+	const unsigned char* p = (const unsigned char*)data;
+	uint32_t c = crc ^ 0xFFFFFFFFu;
+	for (; size >= 8; size -= 8, p += 8) {
+		uint32_t lo = c ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+		uint32_t hi = p[4] | p[5] << 8 | p[6] << 16 | (uint32_t)p[7] << 24;
+		c = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+			t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+	}
+	for (; size > 0; --size, ++p)
+		c = t[0][(c ^ *p) & 0xFF] ^ (c >> 8);
+	return c ^ 0xFFFFFFFFu;
+}
+
+//****************************************************************************
+//
+// * A section being written - little-endian, whatever the machine
+//============================================================================
+struct Out {
+	std::vector<char> bytes;
+
+	void u32(uint32_t x) {
+		for (int i = 0; i < 4; ++i)
+			bytes.push_back((char)(x >> (8 * i)));
+	}
+	void u64(uint64_t x) {
+		u32((uint32_t)x);
+		u32((uint32_t)(x >> 32));
+	}
+	void f32(float f) {
+		uint32_t x;
+		memcpy(&x, &f, 4);
+		u32(x);
+	}
+	// an array of floats (or anything made of them)
+	void words(const void* p, size_t n) {
+		size_t at = bytes.size();
+		bytes.resize(at + 4 * n);
+		if (n == 0)
+			return;
+		memcpy(&bytes[at], p, 4 * n);
+		if (!littleEndian())
+			swapWords(&bytes[at], n);
+	}
+};
+
+//****************************************************************************
+//
+// * A section being read: runs out (ok goes false) instead of reading past
+//   the end
+//============================================================================
+struct In {
+	const unsigned char* p;
+	const unsigned char* end;
+	bool ok;
+
+	In(const char* data, size_t size)
+		: p((const unsigned char*)data), end((const unsigned char*)data + size), ok(true) {}
+
+	bool need(size_t n) {
+		if (ok && (size_t)(end - p) < n)
+			ok = false;
+		return ok;
+	}
+	uint32_t u32() {
+		if (!need(4))
+			return 0;
+		uint32_t x = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+		p += 4;
+		return x;
+	}
+	uint64_t u64() {
+		uint64_t lo = u32();
+		return lo | (uint64_t)u32() << 32;
+	}
+	float f32() {
+		uint32_t x = u32();
+		float f;
+		memcpy(&f, &x, 4);
+		return f;
+	}
+	// n floats: straight out of the file if they can be used as they are,
+	// otherwise through scratch
+	const float* words(size_t n, std::vector<float>& scratch) {
+		if (n > (size_t)(end - p) / 4) {
+			ok = false;
+			return 0;
+		}
+		const float* out;
+		if (littleEndian() && ((uintptr_t)p & 3) == 0)
+			out = (const float*)p;
+		else {
+			scratch.resize(n);
+			if (n)
+				memcpy(&scratch[0], p, 4 * n);
+			if (!littleEndian())
+				swapWords(scratch.data(), n);
+			out = scratch.data();
+		}
+		p += 4 * n;
+		return out;
+	}
+};
+
+//****************************************************************************
+//
+// * The sections worked out from the points all start the same way: the
+//   checksum of the points they were made from, the spline type, and how
+//   many segments
+//============================================================================
+static void derivedHeader(Out& out, uint32_t pointsCrc, int type, size_t segs)
+//============================================================================
+{
+	out.u32(pointsCrc);
+	out.u32((uint32_t)type);
+	out.u32((uint32_t)segs);
+}
+
+static bool derivedHeader(In& in, uint32_t pointsCrc, size_t segs, int& type)
+{
+	uint32_t crc = in.u32();
+	type = (int)in.u32();
+	uint32_t n = in.u32();
+	return in.ok && crc == pointsCrc && n == segs && splineBasis(type);
+}
+
+//****************************************************************************
+//
+// * Write the file: the sections first (to know their sizes and
+//   checksums), then the header and directory, then the sections
+//============================================================================
+bool
+writeTrackFile(const char* fname, const std::vector<ControlPoint>& points,
+			   const TrackProfile* profile, const TrackCache* cache)
+//============================================================================
+{
+	size_t n = points.size();
+	std::vector<uint32_t> tags;
+	std::vector<Out> sections;
+
+	tags.push_back(TAG_POINTS);
+	sections.push_back(Out());
+	sections.back().words(points.data(), n * POINT_WORDS);
+	uint32_t pointsCrc = trackFileCrc(0, sections.back().bytes.data(), sections.back().bytes.size());
+
+	// the tables only if they are of these points
+	if (profile && !profile->empty() && profile->segmentCount() == n &&
+		profile->builtFrom().size() == n &&
+		!memcmp(profile->builtFrom().data(), points.data(), n * sizeof(ControlPoint))) {
+		tags.push_back(TAG_ARCS);
+		sections.push_back(Out());
+		Out& o = sections.back();
+		size_t count = n * TrackProfile::SAMPLES;
+		derivedHeader(o, pointsCrc, profile->type(), n);
+		o.u32(TrackProfile::SAMPLES);
+		o.words(profile->segLength.data(), n);
+		o.words(profile->u.data(), count);
+		o.words(profile->height.data(), count);
+		o.words(profile->curvV.data(), count);
+		o.words(profile->curvL.data(), count);
+		o.words(profile->upY.data(), count);
+		o.words(profile->sideY.data(), count);
+		o.words(profile->bank.data(), count);
+	}
+
+	// a cache that only keeps a window of a longer track has empty
+	// frames outside it, and no tables are written for it then
+	bool framesOk = cache && cache->clean() && cache->segmentCount() == n && n > 0;
+	for (size_t i = 0; framesOk && i < n; ++i)
+		framesOk = cache->frames(i).size() == TrackCache::FRAMES_PER_SEGMENT + 1;
+	if (framesOk) {
+		tags.push_back(TAG_COEFFS);
+		sections.push_back(Out());
+		Out& c = sections.back();
+		derivedHeader(c, pointsCrc, cache->type(), n);
+		for (size_t i = 0; i < n; ++i)
+			c.words(&cache->coeffs(i), COEFF_WORDS);
+
+		tags.push_back(TAG_FRAMES);
+		sections.push_back(Out());
+		Out& f = sections.back();
+		derivedHeader(f, pointsCrc, cache->type(), n);
+		f.u32(TrackCache::FRAMES_PER_SEGMENT + 1);
+		f.f32(cache->tieSpacing());
+		for (size_t i = 0; i < n; ++i)
+			f.f32(cache->segmentLength(i));
+		for (size_t i = 0; i < n; ++i)
+			f.u32((uint32_t)cache->ties(i).size());
+		for (size_t i = 0; i < n; ++i)
+			f.words(cache->frames(i).data(), cache->frames(i).size() * FRAME_WORDS);
+		for (size_t i = 0; i < n; ++i)
+			f.words(cache->ties(i).data(), cache->ties(i).size() * FRAME_WORDS);
+	}
+
+	// where everything goes
+	Out head;
+	size_t count = sections.size();
+	head.bytes.push_back('R');
+	head.bytes.push_back('C');
+	head.bytes.push_back('T');
+	head.bytes.push_back('K');
+	head.u32(TRACK_FILE_VERSION);
+	head.u32((uint32_t)count);
+	head.u32(0);
+	head.u64(n);
+	head.u64(0);
+	uint64_t at = HEADER_SIZE + count * ENTRY_SIZE;
+	std::vector<uint64_t> pad(count);
+	for (size_t i = 0; i < count; ++i) {
+		const std::vector<char>& b = sections[i].bytes;
+		head.u32(tags[i]);
+		head.u32(trackFileCrc(0, b.data(), b.size()));
+		head.u64(at);
+		head.u64(b.size());
+		head.u64(0);
+		pad[i] = (8 - b.size() % 8) % 8;
+		at += b.size() + pad[i];
+	}
+
+	// all of it, or the old file stays
+	AtomicFile out;
+	if (!out.open(fname))
+		return false;
+	static const char zeros[8] = { 0 };
+	bool ok = out.write(head.bytes.data(), head.bytes.size());
+	for (size_t i = 0; ok && i < count; ++i) {
+		const std::vector<char>& b = sections[i].bytes;
+		ok = out.write(b.data(), b.size()) && out.write(zeros, (size_t)pad[i]);
+	}
+	return ok && out.commit();
+}
+
+//****************************************************************************
+//
+// * Find the points without reading them
+//============================================================================
+bool
+findTrackPoints(FILE* fp, TrackFilePoints& where, const char*& error)
+//============================================================================
+{
+	char head[HEADER_SIZE];
+	if (fread(head, 1, HEADER_SIZE, fp) != HEADER_SIZE || !isTrackFile(head, HEADER_SIZE)) {
+		error = "Not a Track File";
+		return false;
+	}
+	In h(head + 4, HEADER_SIZE - 4);
+	uint32_t version = h.u32();
+	uint32_t count = h.u32();
+	h.u32();
+	uint64_t n = h.u64();
+	if (version > TRACK_FILE_VERSION) {
+		error = "Track File is from a Newer Version";
+		return false;
+	}
+	if (n < 4 || n > (uint64_t)-1 / (POINT_WORDS * 4)) {
+		error = "Illegal Number of Points Specified in File";
+		return false;
+	}
+
+	std::vector<char> dir((size_t)count * ENTRY_SIZE);
+	if (count > 0xFFFF || fread(dir.data(), 1, dir.size(), fp) != dir.size()) {
+		error = "Track File is Damaged";
+		return false;
+	}
+	In in(dir.data(), dir.size());
+	bool found = false;
+	where.tables = false;
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t tag = in.u32();
+		uint32_t crc = in.u32();
+		uint64_t at = in.u64();
+		uint64_t len = in.u64();
+		in.u64();
+		if (tag == TAG_POINTS && !found) {
+			found = len == n * POINT_WORDS * 4;
+			where.offset = at;
+			where.count = n;
+			where.crc = crc;
+		}
+		if (tag == TAG_ARCS || tag == TAG_COEFFS || tag == TAG_FRAMES)
+			where.tables = true;
+	}
+	if (!found) {
+		error = "Track File is Damaged";
+		return false;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * Ours or not
+//============================================================================
+bool
+isTrackFile(const char* data, size_t size)
+//============================================================================
+{
+	return size >= HEADER_SIZE && !memcmp(data, "RCTK", 4);
+}
+
+//****************************************************************************
+//
+// * Read the file: the points, then whichever tables are good
+//============================================================================
+bool
+readTrackFile(const char* data, size_t size, std::vector<ControlPoint>& points,
+			  TrackProfile* profile, TrackCache* cache, TrackFileContents& got,
+			  const char*& error)
+//============================================================================
+{
+	got.profile = got.frames = got.coeffs = false;
+	if (!isTrackFile(data, size)) {
+		error = "Not a Track File";
+		return false;
+	}
+
+	In head(data + 4, HEADER_SIZE - 4);
+	uint32_t version = head.u32();
+	uint32_t count = head.u32();
+	head.u32();
+	uint64_t n = head.u64();
+	if (version > TRACK_FILE_VERSION) {
+		error = "Track File is from a Newer Version";
+		return false;
+	}
+	if (n < 4 || n > size / (POINT_WORDS * 4)) {
+		error = "Illegal Number of Points Specified in File";
+		return false;
+	}
+
+	// the sections that are all there and add up
+	In dir(data + HEADER_SIZE, size - HEADER_SIZE);
+	const char* body[4] = { 0, 0, 0, 0 };
+	size_t length[4] = { 0, 0, 0, 0 };
+	uint32_t check[4] = { 0, 0, 0, 0 };
+	const uint32_t known[4] = { TAG_POINTS, TAG_ARCS, TAG_COEFFS, TAG_FRAMES };
+	// the tables nobody asked for aren't even looked at (checking them
+	// would bring the whole file in)
+	const bool wanted[4] = { true, profile != 0, cache != 0, cache != 0 };
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t tag = dir.u32();
+		uint32_t crc = dir.u32();
+		uint64_t at = dir.u64();
+		uint64_t len = dir.u64();
+		dir.u64();
+		if (!dir.ok)
+			break;
+		int k = 0;
+		while (k < 4 && tag != known[k])
+			++k;
+		if (k == 4 || !wanted[k] || body[k])
+			continue;
+		if (at > size || len > size - at || trackFileCrc(0, data + at, (size_t)len) != crc)
+			continue;
+		body[k] = data + at;
+		length[k] = (size_t)len;
+		check[k] = crc;
+	}
+	if (!body[0] || length[0] != n * POINT_WORDS * 4) {
+		error = "Track File is Damaged";
+		return false;
+	}
+	uint32_t pointsCrc = check[0];
+
+	std::vector<float> scratch;
+	In pts(body[0], length[0]);
+	const float* p = pts.words((size_t)n * POINT_WORDS, scratch);
+	points.resize((size_t)n);
+	memcpy((void*)points.data(), p, length[0]);
+
+	//*********************************************************************
+	// the arc length tables
+	//*********************************************************************
+	int type;
+	size_t segs = points.size();
+	size_t samples = segs * TrackProfile::SAMPLES;
+	if (profile && body[1]) {
+		In in(body[1], length[1]);
+		if (derivedHeader(in, pointsCrc, segs, type) && in.u32() == TrackProfile::SAMPLES) {
+			std::vector<float>* arrays[8] = { &profile->segLength, &profile->u, &profile->height,
+											  &profile->curvV, &profile->curvL, &profile->upY,
+											  &profile->sideY, &profile->bank };
+			for (int k = 0; k < 8 && in.ok; ++k) {
+				size_t len = k ? samples : segs;
+				const float* a = in.words(len, scratch);
+				if (a)
+					arrays[k]->assign(a, a + len);
+			}
+			got.profile = in.ok && profile->restore(points, type);
+			if (!got.profile)
+				profile->clear();
+		}
+	}
+
+	//*********************************************************************
+	// the frame tables, and the coefficients if they came too (otherwise
+	// they are cheap enough to work out)
+	//*********************************************************************
+	if (cache && body[3]) {
+		In in(body[3], length[3]);
+		const size_t frames = TrackCache::FRAMES_PER_SEGMENT + 1;
+		float spacing = 0;
+		std::vector<float> lengths;
+		std::vector<uint32_t> ties(segs);
+		size_t allTies = 0;
+		bool ok = derivedHeader(in, pointsCrc, segs, type) && in.u32() == frames;
+		if (ok) {
+			spacing = in.f32();
+			const float* l = in.words(segs, scratch);
+			if (l)
+				lengths.assign(l, l + segs);
+			for (size_t i = 0; i < segs; ++i) {
+				ties[i] = in.u32();
+				allTies += ties[i];
+			}
+			ok = in.ok && allTies <= (size_t)(in.end - in.p) / (4 * FRAME_WORDS);
+		}
+
+		const SplineCoeffs* coeffs = 0;
+		std::vector<float> coeffScratch;
+		if (ok && body[2]) {
+			In c(body[2], length[2]);
+			int coeffType;
+			if (derivedHeader(c, pointsCrc, segs, coeffType) && coeffType == type)
+				coeffs = (const SplineCoeffs*)c.words(segs * COEFF_WORDS, coeffScratch);
+		}
+
+		std::vector<float> frameScratch, tieScratch;
+		const TrackFrame* f = 0;
+		const TrackFrame* t = 0;
+		if (ok) {
+			f = (const TrackFrame*)in.words(segs * frames * FRAME_WORDS, frameScratch);
+			t = (const TrackFrame*)in.words(allTies * FRAME_WORDS, tieScratch);
+			ok = in.ok;
+		}
+		if (ok) {
+			cache->restore(segs, type, spacing);
+			for (size_t i = 0; i < segs; ++i) {
+				SplineCoeffs sc;
+				if (coeffs)
+					sc = coeffs[i];
+				else
+					splineCoeffs(points, i, type, sc);
+				cache->restoreSegment(i, sc, lengths[i], f + i * frames, t, ties[i]);
+				t += ties[i];
+			}
+			got.frames = true;
+			got.coeffs = coeffs != 0;
+		}
+	}
+	return true;
+}
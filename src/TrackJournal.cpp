@@ -0,0 +1,524 @@
+/************************************************************************
+     File:        TrackJournal.cpp
+
+     Comment:     Autosave: a log of the edits to the track
+
+						see TrackJournal.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+
+#include "TrackJournal.H"
+#include "AtomicFile.H"
+#include "MappedFile.H"
+#include "TrackFile.H"
+
+static const unsigned int JOURNAL_VERSION = 1;
+static const size_t HEADER_SIZE = 8;
+static const size_t RECORD_HEADER_SIZE = 8;
+
+// the kinds of record
+static const unsigned char SNAPSHOT = 1;
+static const unsigned char SET = 2;
+static const unsigned char INSERT = 3;
+static const unsigned char DELETE = 4;
+
+static const size_t POINT_SIZE = 6 * 4;
+static const size_t INDEX_SIZE = 8;
+
+// the edits aren't compacted away before there are this many bytes of
+// them, however small the track
+static const size_t COMPACT_MIN = 64 * 1024;
+
+//****************************************************************************
+//
+// * Little-endian numbers, and points
+//============================================================================
+static void put32(std::vector<unsigned char>& b, uint32_t x)
+{
+	for (int i = 0; i < 4; ++i)
+		b.push_back((unsigned char)(x >> (8 * i)));
+}
+
+static void put64(std::vector<unsigned char>& b, uint64_t x)
+{
+	put32(b, (uint32_t)x);
+	put32(b, (uint32_t)(x >> 32));
+}
+
+static uint32_t get32(const unsigned char* p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get64(const unsigned char* p)
+{
+	return get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+static void putPoint(std::vector<unsigned char>& b, const ControlPoint& p)
+{
+	const float f[6] = { p.pos.x, p.pos.y, p.pos.z,
+						 p.orient.x, p.orient.y, p.orient.z };
+	for (int i = 0; i < 6; ++i) {
+		uint32_t bits;
+		memcpy(&bits, &f[i], 4);
+		put32(b, bits);
+	}
+}
+
+static ControlPoint getPoint(const unsigned char* p)
+{
+	float f[6];
+	for (int i = 0; i < 6; ++i) {
+		uint32_t bits = get32(p + 4 * i);
+		memcpy(&f[i], &bits, 4);
+	}
+	// as it was - the constructor would normalize the orientation
+	ControlPoint cp;
+	cp.pos = Pnt3f(f[0], f[1], f[2]);
+	cp.orient = Pnt3f(f[3], f[4], f[5]);
+	return cp;
+}
+
+//****************************************************************************
+//
+// * A record goes in two steps: begin leaves room for its size and
+//   checksum, end fills them in
+//============================================================================
+static size_t beginRecord(std::vector<unsigned char>& b, unsigned char kind)
+{
+	size_t start = b.size();
+	put64(b, 0);
+	b.push_back(kind);
+	return start;
+}
+
+static void endRecord(std::vector<unsigned char>& b, size_t start)
+{
+	const unsigned char* payload = &b[start + RECORD_HEADER_SIZE];
+	size_t size = b.size() - start - RECORD_HEADER_SIZE;
+	uint32_t crc = trackFileCrc(0, payload, size);
+	for (int i = 0; i < 4; ++i) {
+		b[start + i] = (unsigned char)(size >> (8 * i));
+		b[start + 4 + i] = (unsigned char)(crc >> (8 * i));
+	}
+}
+
+//****************************************************************************
+//
+// * Onto the disk, not just out of the program
+//============================================================================
+static bool syncFile(FILE* fp)
+{
+	if (fflush(fp) != 0)
+		return false;
+#ifdef _WIN32
+	return _commit(_fileno(fp)) == 0;
+#else
+	return fsync(fileno(fp)) == 0;
+#endif
+}
+
+//****************************************************************************
+//
+// * Constructor - not started
+//============================================================================
+TrackJournal::
+TrackJournal()
+	: replacePending(false), quit(false), hurry(false),
+	  queuedCount(0), writtenCount(0),
+	  log(0), snapshotBytes(0), editBytes(0), damaged(false)
+//============================================================================
+{
+}
+
+TrackJournal::
+~TrackJournal()
+{
+	stop(false);
+}
+
+//****************************************************************************
+//
+// * The first snapshot is written here, so that a journal that can't be
+//   written is found out straight away
+//============================================================================
+bool TrackJournal::
+start(const char* fname, const std::vector<ControlPoint>& track)
+//============================================================================
+{
+	stop(false);
+	name = fname;
+	points = track;
+	if (!compact()) {
+		std::vector<ControlPoint>().swap(points);
+		return false;
+	}
+	queue.clear();
+	std::vector<ControlPoint>().swap(replacement);
+	replacePending = quit = hurry = false;
+	queuedCount = writtenCount = 0;
+	thread = std::thread(&TrackJournal::run, this);
+	return true;
+}
+
+//****************************************************************************
+//
+// * The thread writes out what is queued before it goes
+//============================================================================
+void TrackJournal::
+stop(bool discard)
+//============================================================================
+{
+	if (!thread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_one();
+	thread.join();
+
+	if (log)
+		fclose(log);
+	log = 0;
+	if (discard)
+		remove(name.c_str());
+	std::vector<ControlPoint>().swap(points);
+	std::vector<unsigned char>().swap(out);
+}
+
+//****************************************************************************
+//
+// * The edits. A move of the point the last edit moved takes its place -
+//   only where the point ends up matters
+//============================================================================
+void TrackJournal::
+set(size_t i, const ControlPoint& p)
+//============================================================================
+{
+	if (!thread.joinable())
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!queue.empty() && queue.back().kind == SET && queue.back().index == i)
+		queue.back().point = p;
+	else {
+		Edit edit = { SET, i, p };
+		queue.push_back(edit);
+	}
+	++queuedCount;
+	wake.notify_one();
+}
+
+void TrackJournal::
+inserted(size_t i, const ControlPoint& p)
+{
+	if (!thread.joinable())
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	Edit edit = { INSERT, i, p };
+	queue.push_back(edit);
+	++queuedCount;
+	wake.notify_one();
+}
+
+void TrackJournal::
+deleted(size_t i)
+{
+	if (!thread.joinable())
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	Edit edit = { DELETE, i, ControlPoint() };
+	queue.push_back(edit);
+	++queuedCount;
+	wake.notify_one();
+}
+
+//****************************************************************************
+//
+// * A whole new track: what was queued before it doesn't matter any more.
+//   The copy is made before the lock is taken (and the one it replaces
+//   freed after), so the writing thread is never held up by it
+//============================================================================
+void TrackJournal::
+replaced(const std::vector<ControlPoint>& track)
+//============================================================================
+{
+	if (!thread.joinable())
+		return;
+	std::vector<ControlPoint> copy(track);
+	std::lock_guard<std::mutex> lock(mutex);
+	queue.clear();
+	replacement.swap(copy);
+	replacePending = true;
+	++queuedCount;
+	wake.notify_one();
+}
+
+//****************************************************************************
+//
+// * Wait for the thread to catch up - without waiting out LATENCY_MS
+//============================================================================
+void TrackJournal::
+flush()
+//============================================================================
+{
+	if (!thread.joinable())
+		return;
+	std::unique_lock<std::mutex> lock(mutex);
+	unsigned long long target = queuedCount;
+	if (writtenCount >= target)
+		return;
+	hurry = true;
+	wake.notify_one();
+	written.wait(lock, [&] { return writtenCount >= target; });
+}
+
+//****************************************************************************
+//
+// * The writing thread: waits for edits, lets them gather for a while, and
+//   writes them out a batch at a time
+//============================================================================
+void TrackJournal::
+run()
+//============================================================================
+{
+	std::vector<Edit> edits;
+	std::vector<ControlPoint> track;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wake.wait(lock, [this] { return quit || hurry || replacePending || !queue.empty(); });
+		if (!quit && !hurry)
+			wake.wait_for(lock, std::chrono::milliseconds(LATENCY_MS),
+						  [this] { return quit || hurry; });
+
+		edits.swap(queue);
+		bool replace = replacePending;
+		if (replace)
+			track.swap(replacement);
+		replacePending = false;
+		unsigned long long batch = queuedCount;
+		lock.unlock();
+
+		// a new track is written as a snapshot, and so is the copy if the
+		// edits have grown bigger than it, or the file was left damaged
+		bool ok = true;
+		if (replace) {
+			points.swap(track);
+			std::vector<ControlPoint>().swap(track);
+		}
+		if (replace || damaged) {
+			for (size_t i = 0; i < edits.size(); ++i)
+				apply(edits[i], 0);
+			ok = compact();
+		}
+		else if (!edits.empty()) {
+			out.clear();
+			for (size_t i = 0; i < edits.size(); ++i)
+				apply(edits[i], &out);
+			ok = append();
+			if (ok && editBytes > snapshotBytes && editBytes > COMPACT_MIN)
+				ok = compact();
+		}
+		edits.clear();
+		if (!ok) {
+			// the copy still has the edits - the next batch tries again
+			// with a new file
+			if (!damaged)
+				fprintf(stderr, "Can't write the autosave journal %s\n", name.c_str());
+			damaged = true;
+		}
+
+		lock.lock();
+		writtenCount = batch;
+		if (writtenCount >= queuedCount)
+			hurry = false;
+		written.notify_all();
+		if (quit && queue.empty() && !replacePending)
+			break;
+	}
+}
+
+//****************************************************************************
+//
+// * One edit, on the copy. One that doesn't fit (it can't happen, unless
+//   whoever made it got it wrong) is left out of the file as well - if it
+//   went in, recover would stop there
+//============================================================================
+bool TrackJournal::
+apply(const Edit& edit, std::vector<unsigned char>* b)
+//============================================================================
+{
+	switch (edit.kind) {
+		case SET:
+			if (edit.index >= points.size())
+				return false;
+			points[edit.index] = edit.point;
+			break;
+		case INSERT:
+			if (edit.index > points.size())
+				return false;
+			points.insert(points.begin() + edit.index, edit.point);
+			break;
+		case DELETE:
+			if (edit.index >= points.size())
+				return false;
+			points.erase(points.begin() + edit.index);
+			break;
+		default:
+			return false;
+	}
+	if (b) {
+		size_t start = beginRecord(*b, edit.kind);
+		put64(*b, edit.index);
+		if (edit.kind != DELETE)
+			putPoint(*b, edit.point);
+		endRecord(*b, start);
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * The records in out, on the end of the file and down on the disk
+//============================================================================
+bool TrackJournal::
+append()
+//============================================================================
+{
+	if (!log)
+		return false;
+	if (out.empty())
+		return true;
+	bool ok = fwrite(out.data(), 1, out.size(), log) == out.size();
+	ok = syncFile(log) && ok;
+	editBytes += out.size();
+	return ok;
+}
+
+//****************************************************************************
+//
+// * A new file, with only a snapshot of the copy in it, in place of the old
+//   one - which stays as it was if this can't be done
+//============================================================================
+bool TrackJournal::
+compact()
+//============================================================================
+{
+	// the file can't be renamed over while it is open (on Windows)
+	if (log)
+		fclose(log);
+	log = 0;
+
+	out.clear();
+	out.reserve(HEADER_SIZE + RECORD_HEADER_SIZE + 1 + INDEX_SIZE + points.size() * POINT_SIZE);
+	out.push_back('R'); out.push_back('C'); out.push_back('T'); out.push_back('J');
+	put32(out, JOURNAL_VERSION);
+	size_t start = beginRecord(out, SNAPSHOT);
+	put64(out, points.size());
+	for (size_t i = 0; i < points.size(); ++i)
+		putPoint(out, points[i]);
+	endRecord(out, start);
+
+	AtomicFile file;
+	bool ok = file.open(name.c_str()) && file.write(out.data(), out.size()) && file.commit();
+	if (ok) {
+		snapshotBytes = out.size();
+		editBytes = 0;
+		damaged = false;
+	}
+	// a snapshot of a big track is big - don't hang on to the room
+	std::vector<unsigned char>().swap(out);
+
+	// carry on after whichever file is there now
+	log = fopen(name.c_str(), "ab");
+	return ok && log;
+}
+
+//****************************************************************************
+//
+// * Read a journal back, a record at a time. The first one that is cut
+//   short, fails its checksum, or doesn't make sense is where the writing
+//   stopped - everything before it is good
+//============================================================================
+bool TrackJournal::
+recover(const char* fname, std::vector<ControlPoint>& result, size_t* edits)
+//============================================================================
+{
+	MappedFile file;
+	if (!file.open(fname) || file.size() < HEADER_SIZE)
+		return false;
+	const unsigned char* p = (const unsigned char*)file.data();
+	const unsigned char* end = p + file.size();
+	if (memcmp(p, "RCTJ", 4) != 0 || get32(p + 4) > JOURNAL_VERSION)
+		return false;
+	p += HEADER_SIZE;
+
+	std::vector<ControlPoint> track;
+	bool snapshot = false;
+	size_t count = 0;
+	while ((size_t)(end - p) >= RECORD_HEADER_SIZE) {
+		size_t size = get32(p);
+		const unsigned char* r = p + RECORD_HEADER_SIZE;
+		if (size == 0 || size > (size_t)(end - r) ||
+			trackFileCrc(0, r, size) != get32(p + 4))
+			break;
+
+		unsigned char kind = r[0];
+		uint64_t index = (size > INDEX_SIZE) ? get64(r + 1) : 0;
+		const unsigned char* point = r + 1 + INDEX_SIZE;
+		bool good = true;
+		if (kind == SNAPSHOT) {
+			good = size >= 1 + INDEX_SIZE &&
+				   index == (size - 1 - INDEX_SIZE) / POINT_SIZE &&
+				   (size - 1 - INDEX_SIZE) % POINT_SIZE == 0;
+			if (good) {
+				track.resize((size_t)index);
+				for (size_t i = 0; i < track.size(); ++i)
+					track[i] = getPoint(point + i * POINT_SIZE);
+				snapshot = true;
+				count = 0;
+			}
+		}
+		else if (!snapshot)
+			good = false;
+		else if (kind == SET)
+			good = size == 1 + INDEX_SIZE + POINT_SIZE && index < track.size();
+		else if (kind == INSERT)
+			good = size == 1 + INDEX_SIZE + POINT_SIZE && index <= track.size();
+		else if (kind == DELETE)
+			good = size == 1 + INDEX_SIZE && index < track.size();
+		else
+			good = false;
+		if (!good)
+			break;
+
+		if (kind == SET)
+			track[(size_t)index] = getPoint(point);
+		else if (kind == INSERT)
+			track.insert(track.begin() + (size_t)index, getPoint(point));
+		else if (kind == DELETE)
+			track.erase(track.begin() + (size_t)index);
+		if (kind != SNAPSHOT)
+			++count;
+		p = r + size;
+	}
+	if (!snapshot)
+		return false;
+	result.swap(track);
+	if (edits)
+		*edits = count;
+	return true;
+}
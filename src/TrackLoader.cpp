@@ -0,0 +1,151 @@
+/************************************************************************
+     File:        TrackLoader.cpp
+
+     Comment:     Loads a track on a thread of its own
+
+						see TrackLoader.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include "TrackLoader.H"
+#include "ThreadPool.H"
+#include "Track.H"
+
+// how much of the progress is reading the file (and building the frames as
+// it goes) - the rest is the profile, at the end
+static const float READ_SHARE = 0.9f;
+
+// segments built between looks for a cancel
+static const size_t BUILD_BLOCK = 4096;
+
+//****************************************************************************
+//
+// * Constructor - nothing loading
+//============================================================================
+TrackLoader::
+TrackLoader()
+	: stop(false), finished(false), fraction(0), why(0)
+//============================================================================
+{
+}
+
+TrackLoader::
+~TrackLoader()
+{
+	cancel();
+}
+
+//****************************************************************************
+//
+// * Start the worker on a new track
+//============================================================================
+void TrackLoader::
+start(const char* fname, int type, float tieSpacing, std::function<void()> done)
+//============================================================================
+{
+	cancel();
+	name = fname;
+	onDone = done;
+	stop = false;
+	finished = false;
+	fraction = 0;
+	why = 0;
+	loaded.reset(new CTrack);
+	thread = std::thread(&TrackLoader::run, this, type, tieSpacing);
+}
+
+//****************************************************************************
+//
+// * Stop the worker and forget its track
+//============================================================================
+void TrackLoader::
+cancel()
+//============================================================================
+{
+	if (!busy())
+		return;
+	stop = true;
+	thread.join();
+	loaded.reset();
+}
+
+//****************************************************************************
+//
+// * Hand the new track over
+//============================================================================
+bool TrackLoader::
+take(CTrack& track, const char*& error)
+//============================================================================
+{
+	if (!busy()) {
+		error = "No Track is Being Loaded";
+		return false;
+	}
+	thread.join();
+	bool ok = !why;
+	error = why;
+	if (ok)
+		track.takeTrack(*loaded);
+	// the old track goes with it
+	loaded.reset();
+	return ok;
+}
+
+//****************************************************************************
+//
+// * Build the frames that are out of date, a block of segments at a time
+//   (shared out over the cores) so a cancel doesn't wait for all of
+//   them - false if there was one
+//============================================================================
+bool TrackLoader::
+build(CTrack& track, int type, float tieSpacing)
+//============================================================================
+{
+	TrackCache& cache = track.cache;
+	cache.prepare(track.points, type, tieSpacing);
+	const std::vector<size_t>& dirty = cache.dirtySegments();
+	// with the whole file in, what is left of the reading share is building
+	float from = fraction;
+	for (size_t i = 0; i < dirty.size(); i += BUILD_BLOCK) {
+		if (stop)
+			return false;
+		size_t end = (dirty.size() - i > BUILD_BLOCK) ? i + BUILD_BLOCK : dirty.size();
+		ThreadPool::shared().parallelFor(i, end, [&](size_t k) {
+			cache.rebuildSegment(track.points, dirty[k]);
+		}, 16);
+		if (!track.loading())
+			fraction = from + (READ_SHARE - from) * end / dirty.size();
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * The worker: read a chunk at a time, building the frames of each chunk
+//   as it comes in, and looking for a cancel in between
+//============================================================================
+void TrackLoader::
+run(int type, float tieSpacing)
+//============================================================================
+{
+	CTrack& track = *loaded;
+	const char* error = 0;
+	if (track.beginLoad(name.c_str(), &error) && build(track, type, tieSpacing)) {
+		while (!stop && track.loadMore(TrackReader::CHUNK, &error)) {
+			if (!build(track, type, tieSpacing))
+				break;
+			fraction = READ_SHARE * track.loadProgress();
+		}
+		// the last chunk, and the profile of the whole track
+		if (!stop && !error && build(track, type, tieSpacing))
+			track.getProfile(type);
+	}
+
+	why = stop ? "Cancelled" : error;
+	fraction = 1;
+	finished = true;
+	if (!stop && onDone)
+		onDone();
+}
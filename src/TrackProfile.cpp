@@ -0,0 +1,420 @@
+/************************************************************************
+     File:        TrackProfile.cpp
+
+     Comment:     The track sampled along its arc length, for the physics
+
+						see TrackProfile.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+
+#include "TrackProfile.H"
+#include "Spline.H"
+#include "ThreadPool.H"
+
+static const float PI_F = 3.14159265f;
+
+static bool samePoint(const ControlPoint& a, const ControlPoint& b)
+{
+	return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.pos.z == b.pos.z &&
+		   a.orient.x == b.orient.x && a.orient.y == b.orient.y && a.orient.z == b.orient.z;
+}
+
+//****************************************************************************
+//
+// * Constructor - no track
+//============================================================================
+TrackProfile::
+TrackProfile()
+	: builtType(0), total(0), rebuilt(0), bucketSize(1)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Sample again the segments whose points changed, then redo the running
+//   sums (where each segment starts, the slopes, the buckets)
+//============================================================================
+bool TrackProfile::
+update(const std::vector<ControlPoint>& points, int type, ThreadPool* pool)
+//============================================================================
+{
+	rebuilt = 0;
+	size_t n = points.size();
+	if (n == 0 || !splineBasis(type)) {
+		clear();
+		return false;
+	}
+
+	// segment i uses points i-1 .. i+2, so a point is in the segments
+	// before it, the two after, and its own
+	std::vector<bool> dirty(n, false);
+	size_t old = built.size();
+	// points added on the end (a track being loaded a chunk at a time):
+	// the new segments, and the ones that wrapped round to the start
+	bool added = n > old && old >= 3 && type == builtType;
+	if (n != old || type != builtType) {
+		if (added) {
+			for (size_t i = old; i < n; ++i)
+				dirty[i] = true;
+			dirty[0] = dirty[old - 2] = dirty[old - 1] = true;
+		}
+		else
+			dirty.assign(n, true);
+		size_t count = n * SAMPLES;
+		u.resize(count);
+		height.resize(count);
+		slope.resize(count);
+		curvV.resize(count);
+		curvL.resize(count);
+		upY.resize(count);
+		sideY.resize(count);
+		bank.resize(count);
+		segLength.resize(n);
+		segStart.resize(n + 1);
+	}
+	if (n == old || added) {
+		for (size_t p = 0; p < old; ++p) {
+			if (samePoint(points[p], built[p]))
+				continue;
+			for (size_t k = 0; k < 4; ++k)
+				dirty[(p + n + k - 2) % n] = true;
+		}
+	}
+
+	builtType = type;
+	std::vector<size_t> todo;
+	for (size_t i = 0; i < n; ++i)
+		if (dirty[i])
+			todo.push_back(i);
+	// each segment has its own samples, so any number can be done at once
+	if (!pool)
+		pool = &ThreadPool::shared();
+	pool->parallelFor(0, todo.size(), [&](size_t i) {
+		sampleSegment(points, todo[i]);
+	}, 16);
+	rebuilt = todo.size();
+	built = points;
+	if (!rebuilt)
+		return true;
+	return finish();
+}
+
+//****************************************************************************
+//
+// * Samples read from somewhere (a track file) instead of made here: u,
+//   height, the curvatures, upY, sideY, bank and segLength filled in for
+//   these points - the rest is worked out as update would
+//============================================================================
+bool TrackProfile::
+restore(const std::vector<ControlPoint>& points, int type)
+//============================================================================
+{
+	rebuilt = 0;
+	size_t n = points.size();
+	size_t count = n * SAMPLES;
+	if (n == 0 || !splineBasis(type) || segLength.size() != n || u.size() != count ||
+		height.size() != count || curvV.size() != count || curvL.size() != count ||
+		upY.size() != count || sideY.size() != count || bank.size() != count) {
+		clear();
+		return false;
+	}
+	slope.resize(count);
+	segStart.resize(n + 1);
+	builtType = type;
+	built = points;
+	return finish();
+}
+
+//****************************************************************************
+//
+// * The running sums: where each segment starts, the slopes, the buckets
+//============================================================================
+bool TrackProfile::
+finish()
+//============================================================================
+{
+	size_t n = segLength.size();
+
+	// where the segments start
+	segStart[0] = 0;
+	for (size_t i = 0; i < n; ++i)
+		segStart[i + 1] = segStart[i] + segLength[i];
+	total = segStart[n];
+	if (total <= 0) {
+		clear();
+		return false;
+	}
+
+	// the slope from each sample to the next (around the loop)
+	size_t count = n * SAMPLES;
+	for (size_t i = 0; i < n; ++i) {
+		float ds = segLength[i] / SAMPLES;
+		for (int j = 0; j < SAMPLES; ++j) {
+			size_t k = i * SAMPLES + j;
+			size_t next = (k + 1) % count;
+			slope[k] = (ds > 0) ? (height[next] - height[k]) / ds : 0;
+		}
+	}
+
+	// a couple of buckets per segment, so finding s is a step or two
+	size_t nb = 2 * n;
+	bucketSize = (float)(total / nb);
+	buckets.resize(nb);
+	size_t seg = 0;
+	for (size_t b = 0; b < nb; ++b) {
+		double s = b * (double)bucketSize;
+		while (seg + 1 < n && segStart[seg + 1] <= s)
+			++seg;
+		buckets[b] = (unsigned int)seg;
+	}
+	return true;
+}
+
+void TrackProfile::
+clear()
+{
+	u.clear();
+	height.clear();
+	slope.clear();
+	curvV.clear();
+	curvL.clear();
+	upY.clear();
+	sideY.clear();
+	bank.clear();
+	segStart.clear();
+	segLength.clear();
+	buckets.clear();
+	built.clear();
+	builtType = 0;
+	total = 0;
+}
+
+//****************************************************************************
+//
+// * Measure a segment in small pieces, then put the samples at even steps
+//   of arc length along it and work out the frame and curvature there
+//============================================================================
+void TrackProfile::
+sampleSegment(const std::vector<ControlPoint>& points, size_t seg)
+//============================================================================
+{
+	SplineCoeffs c;
+	splineCoeffs(points, seg, builtType, c);
+
+	float arc[MEASURE_STEPS + 1];
+	arc[0] = 0;
+	glm::vec3 prev = c.pos * glm::vec4(0, 0, 0, 1);
+	for (int j = 1; j <= MEASURE_STEPS; ++j) {
+		float t = (float)j / MEASURE_STEPS;
+		glm::vec3 p = c.pos * glm::vec4(t*t*t, t*t, t, 1);
+		arc[j] = arc[j - 1] + glm::length(p - prev);
+		prev = p;
+	}
+	float len = arc[MEASURE_STEPS];
+	segLength[seg] = len;
+
+	int piece = 0;
+	for (int j = 0; j < SAMPLES; ++j) {
+		// the parameter this far along
+		float target = len * j / SAMPLES;
+		while (piece + 1 < MEASURE_STEPS && arc[piece + 1] <= target)
+			++piece;
+		float pl = arc[piece + 1] - arc[piece];
+		float f = (pl > 0) ? (target - arc[piece]) / pl : 0;
+		float t = (piece + f) / MEASURE_STEPS;
+
+		glm::vec3 p  = c.pos * glm::vec4(t*t*t, t*t, t, 1);
+		glm::vec3 d1 = c.pos * glm::vec4(3*t*t, 2*t, 1, 0);
+		glm::vec3 d2 = c.pos * glm::vec4(6*t, 2, 0, 0);
+		glm::vec3 up = c.orient * glm::vec4(t*t*t, t*t, t, 1);
+
+		size_t k = seg * SAMPLES + j;
+		u[k] = seg + t;
+		height[k] = p.y;
+
+		float speed2 = glm::dot(d1, d1);
+		if (speed2 <= 0) {
+			curvV[k] = curvL[k] = sideY[k] = bank[k] = 0;
+			upY[k] = 1;
+			continue;
+		}
+		glm::vec3 tan = d1 / sqrtf(speed2);
+
+		// the track's frame: up made square to the direction of travel
+		glm::vec3 U = up - glm::dot(up, tan) * tan;
+		if (glm::dot(U, U) <= 1e-12f) {
+			U = glm::vec3(0, 1, 0) - tan.y * tan;
+			if (glm::dot(U, U) <= 1e-12f)
+				U = glm::vec3(1, 0, 0) - tan.x * tan;
+		}
+		U = glm::normalize(U);
+		glm::vec3 L = glm::cross(tan, U);
+
+		// curvature: the part of the second derivative that turns, over
+		// the speed squared
+		glm::vec3 kappa = (d2 - glm::dot(d2, tan) * tan) / speed2;
+		curvV[k] = glm::dot(kappa, U);
+		curvL[k] = glm::dot(kappa, L);
+		upY[k] = U.y;
+		sideY[k] = L.y;
+
+		// the roll from the frame the track would have if it were level
+		// side to side (there isn't one going straight up or down)
+		glm::vec3 n0 = glm::vec3(0, 1, 0) - tan.y * tan;
+		if (glm::dot(n0, n0) <= 1e-8f)
+			bank[k] = 0;
+		else {
+			n0 = glm::normalize(n0);
+			glm::vec3 s0 = glm::cross(tan, n0);
+			bank[k] = atan2f(glm::dot(U, s0), glm::dot(U, n0));
+		}
+	}
+}
+
+//****************************************************************************
+//
+// * Around the loop
+//============================================================================
+float TrackProfile::
+wrap(float s) const
+//============================================================================
+{
+	if (total <= 0)
+		return 0;
+	double w = fmod((double)s, total);
+	if (w < 0)
+		w += total;
+	return (w >= total) ? 0 : (float)w;
+}
+
+//****************************************************************************
+//
+// * The sample at or before s: the bucket gives a segment near it, and
+//   the samples in a segment are evenly spaced
+//============================================================================
+size_t TrackProfile::
+find(float s, float& f) const
+//============================================================================
+{
+	s = wrap(s);
+	size_t nb = buckets.size();
+	size_t b = (size_t)(s / bucketSize);
+	if (b >= nb)
+		b = nb - 1;
+	size_t seg = buckets[b];
+	size_t n = segLength.size();
+	while (seg > 0 && segStart[seg] > s)
+		--seg;
+	while (seg + 1 < n && segStart[seg + 1] <= s)
+		++seg;
+
+	float len = segLength[seg];
+	float x = (len > 0) ? (float)((s - segStart[seg]) / len * SAMPLES) : 0;
+	int j = (int)x;
+	if (j >= SAMPLES)
+		j = SAMPLES - 1;
+	if (j < 0)
+		j = 0;
+	f = x - j;
+	f = (f < 0) ? 0 : ((f > 1) ? 1 : f);
+	return seg * SAMPLES + j;
+}
+
+//****************************************************************************
+//
+// * Look things up
+//============================================================================
+void TrackProfile::
+sample(float s, float& h, float& sl) const
+//============================================================================
+{
+	float f;
+	size_t k = find(s, f);
+	sl = slope[k];
+	h = height[k] + (height[(k + 1) % height.size()] - height[k]) * f;
+}
+
+void TrackProfile::
+sample(float s, Sample& out) const
+{
+	float f;
+	size_t k = find(s, f);
+	size_t next = (k + 1) % height.size();
+
+	out.u = paramAt(s);
+	out.height = height[k] + (height[next] - height[k]) * f;
+	out.slope = slope[k];
+	out.curvV = curvV[k] + (curvV[next] - curvV[k]) * f;
+	out.curvL = curvL[k] + (curvL[next] - curvL[k]) * f;
+	out.upY = upY[k] + (upY[next] - upY[k]) * f;
+	out.sideY = sideY[k] + (sideY[next] - sideY[k]) * f;
+
+	// the short way round
+	float db = bank[next] - bank[k];
+	if (db > PI_F)
+		db -= 2 * PI_F;
+	else if (db < -PI_F)
+		db += 2 * PI_F;
+	out.bank = bank[k] + db * f;
+}
+
+float TrackProfile::
+heightAt(float s) const
+{
+	float h, sl;
+	sample(s, h, sl);
+	return h;
+}
+
+//****************************************************************************
+//
+// * Arc length to parameter, and back
+//============================================================================
+float TrackProfile::
+paramAt(float s) const
+//============================================================================
+{
+	if (empty())
+		return 0;
+	float f;
+	size_t k = find(s, f);
+	// the last sample of a segment runs on to the start of the next
+	float next = ((k + 1) % SAMPLES) ? u[k + 1] : (float)(k / SAMPLES + 1);
+	float p = u[k] + (next - u[k]) * f;
+	float n = (float)segLength.size();
+	return (p >= n) ? p - n : p;
+}
+
+float TrackProfile::
+arcAt(float param) const
+{
+	if (empty())
+		return 0;
+	float n = (float)segLength.size();
+	param = fmodf(param, n);
+	if (param < 0)
+		param += n;
+	size_t seg = (size_t)param;
+	if (seg >= segLength.size())
+		seg = segLength.size() - 1;
+
+	// the last sample in the segment at or before param
+	size_t lo = seg * SAMPLES;
+	size_t hi = lo + SAMPLES - 1;
+	while (lo < hi) {
+		size_t mid = (lo + hi + 1) / 2;
+		if (u[mid] <= param)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	float next = ((lo + 1) % SAMPLES) ? u[lo + 1] : (float)(seg + 1);
+	float f = (next > u[lo]) ? (param - u[lo]) / (next - u[lo]) : 0;
+	f = (f < 0) ? 0 : ((f > 1) ? 1 : f);
+	return (float)(segStart[seg] + (lo - seg * SAMPLES + f) * segLength[seg] / SAMPLES);
+}
@@ -0,0 +1,360 @@
+/************************************************************************
+     File:        TrackReader.cpp
+
+     Comment:     Reads a track file a piece at a time
+
+						see TrackReader.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <charconv>
+
+#include "TrackReader.H"
+#include "TrackFile.H"
+
+// a point in a binary file: 6 little-endian floats
+static const size_t POINT_BYTES = 24;
+
+// how far from 1 the squared length of a normalized orientation can come
+// out (it is a few rounding errors at most)
+static const float UNIT_TOLERANCE = 1e-6f;
+
+//****************************************************************************
+//
+// * The numbers on one line
+//============================================================================
+int
+trackLineNumbers(const char* p, const char* end, float* v, int max)
+//============================================================================
+{
+	int words = 0;
+	for (;;) {
+		while (p < end && *p <= ' ')
+			p++;
+		if (p == end || *p == '#')
+			return words;
+
+		if (words < max) {
+			// from_chars doesn't take a '+', strtod did
+			const char* q = (*p == '+') ? p + 1 : p;
+			float f = 0;
+			if (std::from_chars(q, end, f).ec != std::errc())
+				f = 0;
+			v[words] = f;
+		}
+		++words;
+		while (p < end && *p > ' ')
+			p++;
+	}
+}
+
+//****************************************************************************
+//
+// * The point on one line - normalizing an orientation that already is
+//   unit length would move it by a rounding error each time it is read
+//============================================================================
+ControlPoint
+trackLinePoint(const float* v, int words)
+//============================================================================
+{
+	ControlPoint c;
+	if (words >= 3)
+		c.pos = Pnt3f(v[0], v[1], v[2]);
+	if (words >= 6) {
+		Pnt3f& o = c.orient;
+		o = Pnt3f(v[3], v[4], v[5]);
+		if (fabs(o.x * o.x + o.y * o.y + o.z * o.z - 1) > UNIT_TOLERANCE)
+			o.normalize();
+	}
+	return c;
+}
+
+//****************************************************************************
+//
+// * Constructor - no file
+//============================================================================
+TrackReader::
+TrackReader()
+	: fp(0), start(0), end(0), atEof(false), isBinary(false), isArchive(false), tables(false),
+	  finished(true),
+	  total(0), count(0), crc(0), wantCrc(0), why(0)
+//============================================================================
+{
+}
+
+TrackReader::
+~TrackReader()
+{
+	close();
+}
+
+//****************************************************************************
+//
+// * Open the file and read how many points it has
+//============================================================================
+bool TrackReader::
+open(const char* fname)
+//============================================================================
+{
+	close();
+	why = 0;
+	fp = fopen(fname, "rb");
+	if (!fp) {
+		why = "Can't Open File!";
+		return false;
+	}
+	buffer.resize(BUFFER_SIZE);
+	finished = false;
+
+	char magic[4];
+	bool binaryFile = fread(magic, 1, 4, fp) == 4 && !memcmp(magic, "RCTK", 4);
+	rewind(fp);
+	if (binaryFile) {
+		TrackFilePoints where;
+		const char* error = 0;
+		if (!findTrackPoints(fp, where, error) || where.offset > LONG_MAX ||
+			where.count > (size_t)-1 || fseek(fp, (long)where.offset, SEEK_SET) != 0) {
+			close();
+			why = error ? error : "Track File is Damaged";
+			return false;
+		}
+		isBinary = true;
+		tables = where.tables;
+		total = (size_t)where.count;
+		wantCrc = where.crc;
+		return true;
+	}
+
+	// a compact one - the header, then blocks
+	const char* b = buffer.data();
+	while (end - start < TrackArchiveDecoder::HEADER_SIZE && fill())
+		;
+	if (isTrackArchive(b, end)) {
+		const char* error = 0;
+		if (end < TrackArchiveDecoder::HEADER_SIZE || !decoder.begin(b, error) ||
+			decoder.expected() > (size_t)-1) {
+			close();
+			why = error ? error : "Track File is Damaged";
+			return false;
+		}
+		isArchive = true;
+		start = TrackArchiveDecoder::HEADER_SIZE;
+		total = (size_t)decoder.expected();
+		return true;
+	}
+
+	// first line = number of points
+	const char* eol = 0;
+	while (!(eol = (const char*)memchr(b + start, '\n', end - start)) && fill())
+		;
+	eol = eol ? eol : b + end;
+	const char* p = b + start;
+	while (p < eol && *p <= ' ')
+		p++;
+	unsigned long long npts = 0;
+	if (std::from_chars(p, eol, npts).ec != std::errc())
+		npts = 0;
+	start = (eol < b + end) ? eol - b + 1 : end;
+
+	if (npts < 4 || npts > (size_t)-1) {
+		close();
+		why = "Illegal Number of Points Specified in File";
+		return false;
+	}
+	total = (size_t)npts;
+	return true;
+}
+
+//****************************************************************************
+//
+// * Done with the file (what went wrong is kept)
+//============================================================================
+void TrackReader::
+close()
+//============================================================================
+{
+	if (fp)
+		fclose(fp);
+	fp = 0;
+	std::vector<char>().swap(buffer);
+	start = end = 0;
+	atEof = false;
+	isBinary = isArchive = tables = false;
+	finished = true;
+	total = count = 0;
+	crc = wantCrc = 0;
+}
+
+//****************************************************************************
+//
+// * The next chunk
+//============================================================================
+size_t TrackReader::
+read(std::vector<ControlPoint>& out, size_t max)
+//============================================================================
+{
+	if (!fp || finished)
+		return 0;
+	size_t made = isBinary ? readBinary(out, max) :
+				  isArchive ? readArchive(out, max) : readText(out, max);
+	if (count >= total)
+		finished = true;
+	return made;
+}
+
+//****************************************************************************
+//
+// * Slide what is left to the front of the buffer and read more after it
+//============================================================================
+bool TrackReader::
+fill()
+//============================================================================
+{
+	if (start > 0) {
+		memmove(&buffer[0], &buffer[start], end - start);
+		end -= start;
+		start = 0;
+	}
+	if (atEof || end == buffer.size())
+		return false;
+	size_t want = buffer.size() - end;
+	size_t got = fread(&buffer[end], 1, want, fp);
+	end += got;
+	atEof = got < want;
+	return got > 0;
+}
+
+//****************************************************************************
+//
+// * A line a point, the same as CTrack::readPoints
+//============================================================================
+size_t TrackReader::
+readText(std::vector<ControlPoint>& out, size_t max)
+//============================================================================
+{
+	size_t made = 0;
+	while (made < max && count < total) {
+		const char* b = buffer.data();
+		const char* eol = (const char*)memchr(b + start, '\n', end - start);
+		bool cut = false;
+		if (!eol) {
+			// the line goes on past what is in the buffer
+			if (fill())
+				continue;
+			if (start == end) {
+				finished = true;
+				break;
+			}
+			// the last line - or one longer than the whole buffer, which
+			// is read as far as the buffer goes
+			eol = b + end;
+			cut = !atEof;
+		}
+
+		float v[6];
+		int words = trackLineNumbers(b + start, eol, v, 6);
+		out.push_back(trackLinePoint(v, words));
+		++made;
+		++count;
+		start = (eol < b + end) ? eol - b + 1 : end;
+
+		// and the rest of that line is skipped
+		while (cut) {
+			start = end;
+			if (!fill())
+				break;
+			const char* nl = (const char*)memchr(buffer.data(), '\n', end);
+			if (nl) {
+				start = nl - buffer.data() + 1;
+				cut = false;
+			}
+		}
+	}
+	return made;
+}
+
+//****************************************************************************
+//
+// * Straight out of the points section, checking as it goes
+//============================================================================
+size_t TrackReader::
+readBinary(std::vector<ControlPoint>& out, size_t max)
+//============================================================================
+{
+	size_t want = (max < total - count) ? max : total - count;
+	size_t made = 0;
+	while (made < want) {
+		size_t n = want - made;
+		if (n > buffer.size() / POINT_BYTES)
+			n = buffer.size() / POINT_BYTES;
+		size_t got = fread(buffer.data(), POINT_BYTES, n, fp);
+		crc = trackFileCrc(crc, buffer.data(), got * POINT_BYTES);
+
+		const unsigned char* b = (const unsigned char*)buffer.data();
+		for (size_t i = 0; i < got; ++i) {
+			float v[6];
+			for (int k = 0; k < 6; ++k, b += 4) {
+				uint32_t x = b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24;
+				memcpy(&v[k], &x, 4);
+			}
+			ControlPoint c;
+			c.pos = Pnt3f(v[0], v[1], v[2]);
+			c.orient = Pnt3f(v[3], v[4], v[5]);
+			out.push_back(c);
+		}
+		made += got;
+		count += got;
+		if (got < n) {
+			why = "Track File is Damaged";
+			finished = true;
+			return made;
+		}
+	}
+	if (count == total && crc != wantCrc)
+		why = "Track File is Damaged";
+	return made;
+}
+
+//****************************************************************************
+//
+// * A block at a time, decoded where it is in the buffer
+//============================================================================
+size_t TrackReader::
+readArchive(std::vector<ControlPoint>& out, size_t max)
+//============================================================================
+{
+	size_t made = 0;
+	while (made < max && count < total) {
+		// the block header, then all of the block
+		while (end - start < TrackArchiveDecoder::BLOCK_HEADER_SIZE && fill())
+			;
+		size_t points = 0;
+		size_t size = (end - start < TrackArchiveDecoder::BLOCK_HEADER_SIZE) ? 0 :
+					  decoder.blockSize(&buffer[start], points);
+		if (size == 0) {
+			why = "Track File is Damaged";
+			finished = true;
+			break;
+		}
+		// a whole block or nothing, unless nothing would come at all
+		if (made > 0 && made + points > max)
+			break;
+		while (end - start < size && fill())
+			;
+		const char* error = 0;
+		if (end - start < size || !decoder.block(&buffer[start], out, error)) {
+			why = error ? error : "Track File is Damaged";
+			finished = true;
+			break;
+		}
+		start += size;
+		made += points;
+		count += points;
+	}
+	return made;
+}
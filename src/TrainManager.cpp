@@ -0,0 +1,273 @@
+/************************************************************************
+     File:        TrainManager.cpp
+
+     Comment:     Lots of trains on one track, kept apart by blocks
+
+						see TrainManager.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <float.h>
+#include <math.h>
+
+#include "TrainManager.H"
+
+//****************************************************************************
+//
+// * Constructor - no track, no trains
+//============================================================================
+TrainManager::
+TrainManager()
+	: total(0), ds(1), invDs(1), entries(0), blockLen(1)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * A new track: the trains stay (where they are along it, as near as
+//   can be), the tables are made again
+//============================================================================
+void TrainManager::
+setTrack(const TrackProfile& p, const Params& pp)
+//============================================================================
+{
+	profile = p;
+	params = pp;
+	total = profile.length();
+	chains.clear();
+	slopes.clear();
+	normals.clear();
+	blockOwner.clear();
+	if (total <= 0)
+		return;
+
+	float spacing = (params.tableSpacing > 0) ? params.tableSpacing : 0.25f;
+	entries = (size_t)ceil(total / spacing);
+	if (entries < 4)
+		entries = 4;
+	ds = total / entries;
+	invDs = 1 / ds;
+
+	size_t nBlocks = (params.blockLength > 0) ? (size_t)(total / params.blockLength) : 1;
+	if (nBlocks < 1)
+		nBlocks = 1;
+	blockLen = total / nBlocks;
+	blockOwner.assign(nBlocks, -1);
+	nextTaken.assign(nBlocks, -1);
+
+	for (size_t i = 0; i < s.size(); ++i) {
+		s[i] = fmod(s[i], total);
+		tableOf[i] = chainFor(carts[i]);
+	}
+}
+
+//****************************************************************************
+//
+// * The table for trains of n carts, made the first time it is wanted
+//============================================================================
+size_t TrainManager::
+chainFor(int n)
+//============================================================================
+{
+	for (const Chain& c : chains)
+		if (c.carts == n)
+			return c.offset;
+
+	Chain c;
+	c.carts = n;
+	c.offset = slopes.size();
+	chains.push_back(c);
+	slopes.resize(c.offset + entries);
+	normals.resize(c.offset + entries);
+	if (total <= 0)
+		return c.offset;
+
+	// the average height of the carts with the front at each entry, and
+	// how hard they press down on the wheels
+	std::vector<float> height(entries + 1);
+	for (size_t j = 0; j < entries; ++j) {
+		float sum = 0;
+		float press = 0;
+		for (int k = 0; k < n; ++k) {
+			float h, sl;
+			profile.sample((float)(j * ds - k * params.cartSpacing), h, sl);
+			sum += h;
+			float c2 = 1 - sl * sl;
+			press += (c2 > 0) ? sqrtf(c2) : 0;
+		}
+		height[j] = sum / n;
+		normals[c.offset + j] = press / n;
+	}
+	height[entries] = height[0];
+	for (size_t j = 0; j < entries; ++j)
+		slopes[c.offset + j] = (float)((height[j + 1] - height[j]) * invDs);
+	return c.offset;
+}
+
+//****************************************************************************
+//
+// * More trains
+//============================================================================
+size_t TrainManager::
+addTrain(double at, float speed, int n, float mass)
+//============================================================================
+{
+	if (n < 1)
+		n = 1;
+	if (total > 0) {
+		at = fmod(at, total);
+		if (at < 0)
+			at += total;
+	}
+	s.push_back(at);
+	v.push_back(speed > 0 ? speed : 0);
+	carts.push_back(n);
+	invMass.push_back(mass > 0 ? 1 / mass : 1);
+	room.push_back(0);
+	tableOf.push_back(chainFor(n));
+	return s.size() - 1;
+}
+
+void TrainManager::
+spread(size_t n, float speed, int c, float mass)
+{
+	for (size_t i = 0; i < n; ++i)
+		addTrain(total * i / n, speed, c, mass);
+}
+
+void TrainManager::
+clear()
+{
+	s.clear();
+	v.clear();
+	carts.clear();
+	invMass.clear();
+	room.clear();
+	tableOf.clear();
+	blockOwner.assign(blockOwner.size(), -1);
+}
+
+//****************************************************************************
+//
+// * Who is in which block, and how much room each train has ahead
+//============================================================================
+void TrainManager::
+updateBlocks()
+//============================================================================
+{
+	int nBlocks = (int)blockOwner.size();
+	for (int& b : blockOwner)
+		b = -1;
+
+	// a train has every block from its last cart to its front
+	for (size_t i = 0; i < s.size(); ++i) {
+		double tail = s[i] - (carts[i] - 1) * (double)params.cartSpacing;
+		tail = fmod(tail, total);
+		if (tail < 0)
+			tail += total;
+		int front = (int)(s[i] / blockLen);
+		int b = (int)(tail / blockLen);
+		front = (front < nBlocks) ? front : nBlocks - 1;
+		b = (b < nBlocks) ? b : nBlocks - 1;
+		for (int k = 0; k < nBlocks; ++k) {
+			blockOwner[b] = (int)i;
+			if (b == front)
+				break;
+			b = (b + 1 == nBlocks) ? 0 : b + 1;
+		}
+	}
+
+	// the first occupied block at or after each one - twice round, so
+	// the ones near the end see past the start
+	int next = -1;
+	for (int k = 2 * nBlocks - 1; k >= 0; --k) {
+		int b = k % nBlocks;
+		if (blockOwner[b] >= 0)
+			next = b;
+		nextTaken[b] = next;
+	}
+
+	// up to the start of the first block ahead that some other train has
+	for (size_t i = 0; i < s.size(); ++i) {
+		int front = (int)(s[i] / blockLen);
+		front = (front < nBlocks) ? front : nBlocks - 1;
+		int ahead = nextTaken[(front + 1) % nBlocks];
+		if (ahead < 0 || blockOwner[ahead] == (int)i) {
+			room[i] = (float)total;
+			continue;
+		}
+		double dist = ahead * blockLen - s[i];
+		if (dist < 0)
+			dist += total;
+		room[i] = (float)dist;
+	}
+}
+
+//****************************************************************************
+//
+// * Everybody on by dt: the blocks once, then the substeps, each one a
+//   loop over all the trains with nothing in it but arithmetic and two
+//   table reads
+//============================================================================
+void TrainManager::
+step(double dt)
+//============================================================================
+{
+	size_t n = s.size();
+	if (total <= 0 || n == 0 || dt <= 0)
+		return;
+	updateBlocks();
+
+	const CoasterPhysics::Params& pp = params.physics;
+	int steps = (int)ceil(dt / pp.subStep);
+	float h = (float)(dt / steps);
+	float g = pp.gravity;
+	float friction = pp.rollingFriction * pp.gravity;
+	float ease = 1 / CoasterPhysics::FRICTION_EASE;
+	float drag = pp.drag;
+	float lift = pp.minSpeed;
+	float top = (pp.maxSpeed > 0) ? pp.maxSpeed : FLT_MAX;
+	float brake2 = 2 * params.brake;
+	double len = total;
+	double scale = invDs;
+	size_t last = entries - 1;
+
+	double* S = s.data();
+	float* V = v.data();
+	float* R = room.data();
+	const size_t* T = tableOf.data();
+	const float* SL = slopes.data();
+	const float* NR = normals.data();
+
+	for (int k = 0; k < steps; ++k) {
+		for (size_t i = 0; i < n; ++i) {
+			size_t j = (size_t)(S[i] * scale);
+			j = (j < last) ? j : last;
+			float sl = SL[T[i] + j];
+			float nr = NR[T[i] + j];
+
+			// speed first: gravity, friction (eased in from a stop), drag
+			float vi = V[i];
+			float a = -g * sl - friction * nr * fminf(vi * ease, 1) - drag * vi * vi;
+			vi += a * h;
+			vi = (vi > lift) ? vi : lift;
+			vi = (vi < top) ? vi : top;
+
+			// slow enough to stop before the next occupied block
+			float cap = sqrtf(brake2 * R[i]);
+			vi = (vi < cap) ? vi : cap;
+			vi = (vi > 0) ? vi : 0;
+
+			// then move, never past the end of the room
+			float move = vi * h;
+			move = (move < R[i]) ? move : R[i];
+			R[i] -= move;
+			double x = S[i] + move;
+			S[i] = (x >= len) ? x - len : x;
+			V[i] = vi;
+		}
+	}
+}
@@ -0,0 +1,511 @@
+/************************************************************************
+     File:        TrainSim.cpp
+
+     Comment:     The train simulation, on its own thread
+
+						see TrainSim.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+
+#include "TrainSim.H"
+#include "SimClock.H"
+#include "Spline.H"
+
+// the old idle loop moved the train 60 times a second - the movement per
+// step is scaled from that
+static const float BASE_RATE = 60.0f;
+
+// track units a second for one unit of speed (at the normal speed slider
+// setting of 2) - what the old code moved per frame, times the frames
+static const float SPEED_SCALE = .02f * 2 * BASE_RATE;
+
+//****************************************************************************
+//
+// * Constructor - the thread starts in start
+//============================================================================
+TrainSim::
+TrainSim()
+	: quit(false), settingsPosted(false), pointsPosted(false),
+	  placePosted(false), placeU(0), speedResetPosted(false), nudgePosted(0),
+	  clocked(true), stepTarget(0), posts(0), handled(0),
+	  u(0), prevU(0), wheelDegree(0), prevWheelDegree(0), speed(0), steps(0)
+//============================================================================
+{
+	params.defaultSpeed = 75;
+	params.minSpeed = params.defaultSpeed / 2;
+	params.maxSpeed = params.defaultSpeed * 4;
+	params.gravityFactor = 9.8f / 2;
+	params.rollingFriction = 0.015f;
+	params.drag = 0.0002f;
+	params.wheelRadius = 1;
+	params.cartsSpacing = 17;
+}
+
+//****************************************************************************
+//
+// * Destructor - don't leave the thread running
+//============================================================================
+TrainSim::
+~TrainSim()
+//============================================================================
+{
+	stop();
+}
+
+//****************************************************************************
+//
+// * Start the thread
+//============================================================================
+void TrainSim::
+start(const Params& p, std::function<void()> published)
+//============================================================================
+{
+	stop();
+	params = p;
+	onPublish = published;
+	speed = params.defaultSpeed;
+
+	// the physics works in track units and seconds. gravityFactor was the
+	// speed gained in one old frame going straight down
+	CoasterPhysics::Params pp;
+	pp.gravity = params.gravityFactor * BASE_RATE * SPEED_SCALE;
+	pp.rollingFriction = params.rollingFriction;
+	pp.drag = params.drag;
+	pp.minSpeed = params.minSpeed * SPEED_SCALE;
+	pp.maxSpeed = params.maxSpeed * SPEED_SCALE;
+	physics.setParams(pp);
+	ride.v = params.defaultSpeed * SPEED_SCALE;
+	physicsCarts = -1;
+	quit = false;
+	thread = std::thread(&TrainSim::run, this);
+}
+
+//****************************************************************************
+//
+// * Stop the thread and wait for it
+//============================================================================
+void TrainSim::
+stop()
+//============================================================================
+{
+	if (!thread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_one();
+	thread.join();
+	done.notify_all();
+}
+
+//****************************************************************************
+//
+// * Posting from the UI - each one wakes the thread
+//============================================================================
+void TrainSim::
+setSettings(const Settings& s)
+//============================================================================
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		postedSettings = s;
+		++posts;
+		settingsPosted = true;
+	}
+	wake.notify_one();
+}
+
+void TrainSim::
+setPoints(const std::vector<ControlPoint>& p)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		postedPoints = p;
+		++posts;
+		pointsPosted = true;
+	}
+	wake.notify_one();
+}
+
+void TrainSim::
+placeTrain(float pu)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		placeU = pu;
+		placePosted = true;
+		++posts;
+	}
+	wake.notify_one();
+}
+
+void TrainSim::
+resetSpeed()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		speedResetPosted = true;
+		++posts;
+	}
+	wake.notify_one();
+}
+
+void TrainSim::
+nudge(float dir)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		nudgePosted += dir;
+		++posts;
+	}
+	wake.notify_one();
+}
+
+void TrainSim::
+setClocked(bool c)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		clocked = c;
+		++posts;
+	}
+	wake.notify_one();
+}
+
+void TrainSim::
+runTo(unsigned long target)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (target > stepTarget)
+			stepTarget = target;
+		++posts;
+	}
+	wake.notify_one();
+	sync();
+}
+
+void TrainSim::
+sync()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	unsigned long want = posts;
+	done.wait(lock, [this, want] { return quit || handled >= want; });
+}
+
+//****************************************************************************
+//
+// * The thread - take what was posted, run the steps that are due,
+//   publish, sleep until the next step (or until something is posted)
+//============================================================================
+void TrainSim::
+run()
+//============================================================================
+{
+	SimClock clock(1.0 / RATE);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wake.wait(lock, [this] {
+			return quit || settingsPosted || pointsPosted || placePosted ||
+				   speedResetPosted || nudgePosted != 0 ||
+				   (settings.running && clocked) || handled != posts;
+		});
+		if (quit)
+			break;
+
+		// take what the UI posted
+		bool changed = false;
+		bool wasRunning = settings.running;
+		if (settingsPosted) {
+			settings = postedSettings;
+			settingsPosted = false;
+			changed = true;
+		}
+		bool newPoints = false;
+		if (pointsPosted) {
+			points.swap(postedPoints);
+			pointsPosted = false;
+			changed = true;
+			newPoints = true;
+		}
+		if (placePosted) {
+			u = prevU = placeU;
+			placePosted = false;
+			changed = true;
+		}
+		if (speedResetPosted) {
+			speed = params.defaultSpeed;
+			ride.v = params.defaultSpeed * SPEED_SCALE;
+			speedResetPosted = false;
+			changed = true;
+		}
+		float dir = nudgePosted;
+		nudgePosted = 0;
+		bool byClock = clocked;
+		unsigned long target = stepTarget;
+		unsigned long taking = posts;
+		lock.unlock();
+
+		if (settings.running && !wasRunning)
+			clock.start();
+
+		// the track as the physics sees it - only the segments whose
+		// points moved are sampled again
+		if (newPoints || settings.type != profileType) {
+			profile.update(points, settings.type);
+			profileType = settings.type;
+			if (profile.rebuiltLast())
+				rideU = -1;
+		}
+		if (settings.cartsCount != physicsCarts) {
+			physicsCarts = settings.cartsCount;
+			std::vector<float> masses(physicsCarts + 1, 1.0f);
+			physics.setCarts(masses, params.cartsSpacing);
+		}
+
+		if (dir != 0 && !points.empty()) {
+			nudgeBy(dir);
+			prevU = u;
+			prevWheelDegree = wheelDegree;
+			changed = true;
+		}
+
+		if (!byClock) {
+			// only the steps asked for
+			while (steps < target) {
+				prevU = u;
+				prevWheelDegree = wheelDegree;
+				if (!points.empty())
+					step(1.0f / RATE);
+				++steps;
+				changed = true;
+			}
+		}
+		else if (settings.running && !points.empty()) {
+			int n = clock.advance();
+			for (int i = 0; i < n; ++i) {
+				prevU = u;
+				prevWheelDegree = wheelDegree;
+				step(1.0f / RATE);
+				++steps;
+			}
+			changed = changed || (n > 0);
+		}
+		else {
+			prevU = u;
+			prevWheelDegree = wheelDegree;
+		}
+
+		if (changed) {
+			TrainSnapshot& s = snapshots.back();
+			s.steps = steps;
+			s.time = std::chrono::steady_clock::now() -
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<double>(settings.running ? clock.alpha() * clock.step : 0));
+			s.prevU = prevU;
+			s.u = u;
+			s.prevWheelDegree = prevWheelDegree;
+			s.wheelDegree = wheelDegree;
+			s.speed = speed;
+			placeCarts(s.carts);
+			publish();
+		}
+
+		// sleep until the next step is due
+		if (settings.running && byClock)
+			std::this_thread::sleep_for(std::chrono::duration<double>((1 - clock.alpha()) * clock.step));
+
+		lock.lock();
+		if (handled != taking) {
+			handled = taking;
+			done.notify_all();
+		}
+	}
+}
+
+//****************************************************************************
+//
+// * Move the train on by a step of dt seconds
+//   with arc length the train goes along the track at its speed - the
+//   physics works the speed out (see CoasterPhysics.H), or it is the
+//   default one. the speed slider is how fast the ride goes, 2 being
+//   real time
+//============================================================================
+void TrainSim::
+step(float dt)
+//============================================================================
+{
+	if (settings.arcLength && !profile.empty()) {
+		double timeScale = settings.speed * 0.5;
+		syncRide();
+		double before = ride.s;
+		if (settings.physics)
+			physics.step(profile, ride, dt * timeScale);
+		else {
+			ride.v = params.defaultSpeed * SPEED_SCALE;
+			ride.s += ride.v * timeScale * dt;
+		}
+		moveTo(ride.s, ride.s - before);
+		speed = (float)(ride.v / SPEED_SCALE);
+	}
+	else {
+		float scale = dt * BASE_RATE;
+		u += (settings.speed * .02f) * scale;
+		wheelDegree += 720 * (settings.speed * .02f) * scale;
+		wrapU();
+	}
+}
+
+//****************************************************************************
+//
+// * The << and >> buttons - move dir old frames' worth, without any
+//   physics
+//============================================================================
+void TrainSim::
+nudgeBy(float dir)
+//============================================================================
+{
+	if (settings.arcLength && !profile.empty()) {
+		syncRide();
+		double v = settings.physics ? ride.v : params.defaultSpeed * SPEED_SCALE;
+		double distance = v * settings.speed * 0.5 * dir / BASE_RATE;
+		moveTo(ride.s + distance, distance);
+	}
+	else {
+		u += dir * (settings.speed * .02f);
+		wheelDegree += 720 * dir * (settings.speed * .02f);
+		wrapU();
+	}
+}
+
+//****************************************************************************
+//
+// * The train may have been put somewhere by parameter (placeTrain, or
+//   running without arc length) - find it along the track again
+//============================================================================
+void TrainSim::
+syncRide()
+//============================================================================
+{
+	if (u != rideU)
+		ride.s = profile.arcAt(u);
+}
+
+//****************************************************************************
+//
+// * Put the train at arc length s, having moved along the track
+//============================================================================
+void TrainSim::
+moveTo(double s, double moved)
+//============================================================================
+{
+	// the short way round, if it went past the start
+	double len = profile.length();
+	if (moved > len / 2)
+		moved -= len;
+	if (moved < -len / 2)
+		moved += len;
+
+	ride.s = profile.wrap((float)s);
+	u = rideU = profile.paramAt((float)ride.s);
+	wheelDegree += (float)(360 * moved / (params.wheelRadius * 3.1415926 * 2));
+}
+
+void TrainSim::
+wrapU()
+{
+	float nct = (float)points.size();
+	if (u > nct) u -= nct;
+	if (u < 0) u += nct;
+}
+
+//****************************************************************************
+//
+// * The carts go behind the front one (at u), a cart spacing apart along
+//   the track
+//============================================================================
+void TrainSim::
+placeCarts(std::vector<float>& carts)
+//============================================================================
+{
+	carts.clear();
+	carts.push_back(u);
+	if (profile.empty())
+		return;
+
+	double s = (u == rideU) ? ride.s : profile.arcAt(u);
+	for (int c = 1; c <= settings.cartsCount; c++)
+		carts.push_back(profile.paramAt((float)(s - c * params.cartsSpacing)));
+}
+
+//****************************************************************************
+//
+// * Hand the snapshot over and tell the UI
+//============================================================================
+void TrainSim::
+publish()
+//============================================================================
+{
+	snapshots.publish();
+	if (onPublish)
+		onPublish();
+}
+
+//****************************************************************************
+//
+// * How far past the snapshot we are, in steps (0 to 1). without the
+//   clock it is always the snapshot itself
+//============================================================================
+float TrainSim::
+stepAlpha(const TrainSnapshot& s) const
+//============================================================================
+{
+	if (!clocked)
+		return 1;
+	double since = std::chrono::duration<double>(std::chrono::steady_clock::now() - s.time).count();
+	float alpha = (float)(since * RATE);
+	return (alpha < 0) ? 0 : ((alpha > 1) ? 1 : alpha);
+}
+
+//****************************************************************************
+//
+// * Where to draw the train - part way from prevU to u, by the time since
+//   the last step. the parameter wraps, so go the short way around
+//============================================================================
+float TrainSim::
+drawnU(size_t nPoints) const
+//============================================================================
+{
+	const TrainSnapshot& s = latest();
+	float alpha = stepAlpha(s);
+
+	float nct = (float)nPoints;
+	float u0 = s.prevU;
+	float u1 = s.u;
+	if (u1 - u0 > nct / 2) u0 += nct;
+	if (u0 - u1 > nct / 2) u0 -= nct;
+
+	float du = u0 + (u1 - u0) * alpha;
+	if (du >= nct) du -= nct;
+	if (du < 0) du += nct;
+	return du;
+}
+
+//****************************************************************************
+//
+// * The wheels, the same way
+//============================================================================
+float TrainSim::
+drawnWheelDegree() const
+//============================================================================
+{
+	const TrainSnapshot& s = latest();
+	float alpha = stepAlpha(s);
+	return s.prevWheelDegree + (s.wheelDegree - s.prevWheelDegree) * alpha;
+}
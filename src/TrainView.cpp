@@ -33,14 +33,15 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include "GL/glu.h"
 
 #include "TrainView.H"
 #include "TrainWindow.H"
 #include "Utilities/3DUtils.H"
+#include "Spline.H"
+#include "ThreadPool.H"
 #include <algorithm>
-#include <ppl.h>
-#include <mutex>
 
 #ifdef EXAMPLE_SOLUTION
 #	include "TrainExample/TrainExample.H"
@@ -58,6 +59,20 @@ TrainView(int x, int y, int w, int h, const char* l)
 {
 	mode(FL_RGB | FL_ALPHA | FL_DOUBLE | FL_STENCIL);
 
+	picked.kind = PickBuffer::PICK_NONE;
+	picked.index = -1;
+	picked.depth = 1;
+	pointPickerRevision = ~0u;
+
+	dragPending = false;
+	dragX = dragY = 0;
+	dragElevator = false;
+
+	// nothing has been drawn yet
+	changes = DAMAGE_ALL;
+	drawnRevision = ~0u;
+	gladLoaded = false;
+
 	resetArcball();
 }
 
@@ -86,12 +101,18 @@ resetArcball()
 //========================================================================
 int TrainView::handle(int event)
 {
+	// (only if we're recording a session)
+	tw->recorder.event(event);
+
 	// see if the ArcBall will handle the event - if it does, 
 	// then we're done
 	// note: the arcball only gets the event if we're in world view
+	// (it redraws by itself if the view moved)
 	if (tw->worldCam->value())
-		if (arcball.handle(event))
+		if (arcball.handle(event)) {
+			changes |= DAMAGE_CAMERA;
 			return 1;
+		}
 
 	// remember what button was used
 	static int last_push;
@@ -101,41 +122,38 @@ int TrainView::handle(int event)
 	case FL_PUSH:
 		last_push = Fl::event_button();
 		// if the left button be pushed is left mouse button
+		// (only redraw if that selects something else)
 		if (last_push == FL_LEFT_MOUSE) {
 			doPick();
-			damage(1);
 			return 1;
 		};
 		break;
 
 		// Mouse button release event
 	case FL_RELEASE: // button release
-		damage(1);
+		resolvePick(true);
+		// the last place the mouse was, and that's one edit done
+		applyDrag();
+		m_pTrack->endEdit();
 		last_push = 0;
 		return 1;
 
 		// Mouse button drag event
 	case FL_DRAG:
 
-		// Compute the new control point position
+		// the pick has to be in before we can drag what was picked
+		resolvePick(true);
+
+		// just remember where the mouse is - the point is moved once a
+		// frame (see applyDrag), however many drag events come in
 		if ((last_push == FL_LEFT_MOUSE) && (selectedCube >= 0)) {
-			ControlPoint* cp = &m_pTrack->points[selectedCube];
-
-			double r1x, r1y, r1z, r2x, r2y, r2z;
-			getMouseLine(r1x, r1y, r1z, r2x, r2y, r2z);
-
-			double rx, ry, rz;
-			mousePoleGo(r1x, r1y, r1z, r2x, r2y, r2z,
-				static_cast<double>(cp->pos.x),
-				static_cast<double>(cp->pos.y),
-				static_cast<double>(cp->pos.z),
-				rx, ry, rz,
-				(Fl::event_state() & FL_CTRL) != 0);
-
-			cp->pos.x = (float)rx;
-			cp->pos.y = (float)ry;
-			cp->pos.z = (float)rz;
-			damage(1);
+			dragX = Fl::event_x();
+			dragY = Fl::event_y();
+			dragElevator = (Fl::event_state() & FL_CTRL) != 0;
+			if (!dragPending) {
+				dragPending = true;
+				changed(DAMAGE_TRACK);
+			}
 		}
 		break;
 
@@ -151,7 +169,15 @@ int TrainView::handle(int event)
 	case FL_KEYBOARD:
 		int k = Fl::event_key();
 		int ks = Fl::event_state();
+		// undo and redo edits to the points
+		if ((ks & FL_CTRL) && (k == 'z' || k == 'y')) {
+			bool did = (k == 'z') ? m_pTrack->undo() : m_pTrack->redo();
+			if (did)
+				tw->damageMe(DAMAGE_TRACK);
+			return 1;
+		}
 		if (k == 'p') {
+			resolvePick(true);
 			// Print out the selected control point information
 			if (selectedCube >= 0)
 				printf("Selected(%d) (%g %g %g) (%g %g %g)\n",
@@ -186,13 +212,45 @@ void TrainView::draw()
 	// * Set up basic opengl informaiton
 	//
 	//**********************************************************************
-	//initialized glad
-	if (gladLoadGL())
-	{
-		//initiailize VAO, VBO, Shader...
+	//initialized glad (once - the context stays the same)
+	if (!gladLoaded) {
+		if (!gladLoadGL())
+			throw std::runtime_error("Could not initialize GLAD!");
+		gladLoaded = true;
 	}
-	else
-		throw std::runtime_error("Could not initialize GLAD!");
+
+	// a new context has none of our state, and a resized one needs a
+	// new projection
+	if (!valid())
+		changes |= DAMAGE_CAMERA | DAMAGE_LIGHTING;
+	if (camera.viewport[2] != w() || camera.viewport[3] != h())
+		changes |= DAMAGE_CAMERA;
+
+	// the control point being dragged goes where the mouse is now
+	applyDrag();
+
+	// any edit to the points bumps the revision, whoever made it
+	if (m_pTrack->revision != drawnRevision) {
+		changes |= DAMAGE_TRACK;
+		drawnRevision = m_pTrack->revision;
+	}
+
+	// pick up the result of a click, if the GPU has it by now
+	resolvePick(false);
+
+	// and where the simulation has got the train to
+	tw->updateDrawnTrain();
+
+	// a long track only has its tables near the train (see TrackCache) -
+	// when the train gets near the end of them, they move along. the GPU
+	// track doesn't use them
+	bool windowMoves = m_pTrack->cache.setFocus((size_t)m_pTrack->trainU);
+	if (windowMoves && !(tw->gpuSpline->value() && gpuTrack.ready()))
+		changes |= DAMAGE_TRACK;
+
+	// riding the train, the camera moves with it
+	if (tw->trainCam->value() && (changes & DAMAGE_TRAIN))
+		changes |= DAMAGE_CAMERA;
 
 	// Set up the view port
 	glViewport(0, 0, w(), h());
@@ -209,114 +267,34 @@ void TrainView::draw()
 	// Blayne prefers GL_DIFFUSE
 	glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
 
-	// prepare for projection
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	setProjection();		// put the code to set up matrices here
+	// prepare for projection - only worked out again if the camera moved,
+	// otherwise the matrices of the last frame are used as they are
+	if (changes & DAMAGE_CAMERA) {
+		glMatrixMode(GL_PROJECTION);
+		glLoadIdentity();
+		setProjection();		// put the code to set up matrices here
+	}
+	else {
+		glMatrixMode(GL_PROJECTION);
+		glLoadMatrixf(glm::value_ptr(camera.projection));
+		glMatrixMode(GL_MODELVIEW);
+		glLoadMatrixf(glm::value_ptr(camera.modelview));
+	}
 
 	//######################################################################
 	// TODO: 
 	// you might want to set the lighting up differently. if you do, 
 	// we need to set up the lights AFTER setting up the projection
 	//######################################################################
-	// enable the lighting
 	glEnable(GL_COLOR_MATERIAL);
 	glShadeModel(GL_SMOOTH);
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_LIGHTING);
-	glEnable(GL_LIGHT0);
-
-	// top view only needs one light
-	if (tw->topCam->value()) {
-		glDisable(GL_LIGHT1);
-		glDisable(GL_LIGHT2);
-	}
-	else {
-		glEnable(GL_LIGHT1);
-		glEnable(GL_LIGHT2);
-	}
-
-	//*********************************************************************
-	//
-	// * set the light parameters
-	//
-	//**********************************************************************
-	GLfloat lightPosition1[] = { 0,1,1,0 }; // {50, 200.0, 50, 1.0};
-	GLfloat lightPosition2[] = { 1, 0, 0, 0 };
-	GLfloat lightPosition3[] = { 0, -1, 0, 0 };
-	GLfloat yellowLight[] = { 0.5f, 0.5f, .1f, 1.0 };
-	GLfloat whiteLight[] = { .5f, .5f, .5f, 1.0 };
-	GLfloat blueLight[] = { .1f,.1f,.3f,1.0 };
-	GLfloat grayLight[] = { .15f, .15f, .15f, 1.0 };
-
-	glLightfv(GL_LIGHT0, GL_POSITION, lightPosition1);
-	glLightfv(GL_LIGHT0, GL_DIFFUSE, whiteLight);
-	glLightfv(GL_LIGHT0, GL_AMBIENT, grayLight);
-
-	glLightfv(GL_LIGHT1, GL_POSITION, lightPosition2);
-	glLightfv(GL_LIGHT1, GL_DIFFUSE, yellowLight);
-
-	glLightfv(GL_LIGHT2, GL_POSITION, lightPosition3);
-	glLightfv(GL_LIGHT2, GL_DIFFUSE, blueLight);
-
-	GLfloat noLight[] = { 0,0,0,1 };
-	GLfloat spotDir[] = { 0,-1,0 };
-
-	GLfloat light3Pos[] = { -50,200,-50,1 };
-	GLfloat light3ColorDeep[] = { 0,0.2,0,1 };
-	GLfloat light3ColorLight[] = { 0,0.4,0,1 };
-	glEnable(GL_LIGHT3);
-	glLightfv(GL_LIGHT3, GL_POSITION, light3Pos);
-	glLightfv(GL_LIGHT3, GL_AMBIENT, light3ColorDeep);
-	glLightfv(GL_LIGHT3, GL_DIFFUSE, light3ColorLight);
-	glLightfv(GL_LIGHT3, GL_SPECULAR, light3ColorLight);
-
-
-	glLightfv(GL_LIGHT3, GL_SPOT_DIRECTION, spotDir);
-	glLightf(GL_LIGHT3, GL_SPOT_CUTOFF, 30);
-	glLightf(GL_LIGHT3, GL_SPOT_EXPONENT, 10.0f);
-
-	GLfloat light4Pos[] = { 50,200,50,1 };
-	GLfloat light4ColorDeep[] = { 0.3,0,0,1 };
-	GLfloat light4ColorLight[] = { 0.6,0,0,1 };
-	glEnable(GL_LIGHT4);
-	glLightfv(GL_LIGHT4, GL_POSITION, light4Pos);
-	glLightfv(GL_LIGHT4, GL_AMBIENT, light4ColorDeep);
-	glLightfv(GL_LIGHT4, GL_DIFFUSE, light4ColorLight);
-	glLightfv(GL_LIGHT4, GL_SPECULAR, light4ColorLight);
-
-
-	glLightfv(GL_LIGHT4, GL_SPOT_DIRECTION, spotDir);
-	glLightf(GL_LIGHT4, GL_SPOT_CUTOFF, 30);
-	glLightf(GL_LIGHT4, GL_SPOT_EXPONENT, 10.0f);
-
-	GLfloat light5Pos[] = { -50,200,50,1 };
-	GLfloat light5ColorDeep[] = { 0,0,0.35,1 };
-	GLfloat light5ColorLight[] = { 0,0,0.7,1 };
-	glEnable(GL_LIGHT5);
-	glLightfv(GL_LIGHT5, GL_POSITION, light5Pos);
-	glLightfv(GL_LIGHT5, GL_AMBIENT, light5ColorDeep);
-	glLightfv(GL_LIGHT5, GL_DIFFUSE, light5ColorLight);
-	glLightfv(GL_LIGHT5, GL_SPECULAR, light5ColorLight);
-
-
-	glLightfv(GL_LIGHT5, GL_SPOT_DIRECTION, spotDir);
-	glLightf(GL_LIGHT5, GL_SPOT_CUTOFF, 30);
-	glLightf(GL_LIGHT5, GL_SPOT_EXPONENT, 10.0f);
-
-	GLfloat light6Pos[] = { 50,200,-50,1 };
-	GLfloat light6ColorDeep[] = { 0.3,0.2,0,1 };
-	GLfloat light6ColorLight[] = { 0.6,0.4,0,1 };
-	glEnable(GL_LIGHT6);
-	glLightfv(GL_LIGHT6, GL_POSITION, light6Pos);
-	glLightfv(GL_LIGHT6, GL_AMBIENT, light6ColorDeep);
-	glLightfv(GL_LIGHT6, GL_DIFFUSE, light6ColorLight);
-	glLightfv(GL_LIGHT6, GL_SPECULAR, light6ColorLight);
-
-
-	glLightfv(GL_LIGHT6, GL_SPOT_DIRECTION, spotDir);
-	glLightf(GL_LIGHT6, GL_SPOT_CUTOFF, 30);
-	glLightf(GL_LIGHT6, GL_SPOT_EXPONENT, 10.0f);
+	if (changes & DAMAGE_LIGHTING)
+		setupLights();
+	// light positions are given in eye space, so they follow the camera
+	if (changes & (DAMAGE_CAMERA | DAMAGE_LIGHTING))
+		placeLights();
 
 
 
@@ -346,6 +324,137 @@ void TrainView::draw()
 		drawStuff(true);
 		unsetupShadows();
 	}
+
+	// all caught up
+	changes = 0;
+	tw->recorder.frame();
+}
+
+//************************************************************************
+//
+// * Move the dragged control point to where the mouse was last seen
+//   only the segments next to it are sampled again (see TrackCache)
+//========================================================================
+void TrainView::
+applyDrag()
+//========================================================================
+{
+	if (!dragPending)
+		return;
+	dragPending = false;
+	if (selectedCube < 0 || selectedCube >= (int)m_pTrack->points.size())
+		return;
+
+	Pnt3f r1, r2;
+	if (!camera.mouseLine(dragX, dragY, r1, r2))
+		return;
+
+	// all of the drag is one step for undo
+	if (!m_pTrack->editing())
+		m_pTrack->beginEdit(selectedCube);
+
+	ControlPoint* cp = &m_pTrack->points[selectedCube];
+	double rx, ry, rz;
+	mousePoleGo(r1.x, r1.y, r1.z, r2.x, r2.y, r2.z,
+		static_cast<double>(cp->pos.x),
+		static_cast<double>(cp->pos.y),
+		static_cast<double>(cp->pos.z),
+		rx, ry, rz,
+		dragElevator);
+
+	cp->pos.x = (float)rx;
+	cp->pos.y = (float)ry;
+	cp->pos.z = (float)rz;
+	m_pTrack->pointChanged(selectedCube);
+	changes |= DAMAGE_TRACK;
+	tw->postToSim();
+}
+
+//************************************************************************
+//
+// * Something changed - remember what, and redraw
+//========================================================================
+void TrainView::
+changed(unsigned int what)
+//========================================================================
+{
+	if (!what)
+		return;
+	changes |= what;
+	damage(1);
+}
+
+//************************************************************************
+//
+// * The light colors, and which lights are on
+//   (these stay put until the camera type changes)
+//========================================================================
+void TrainView::
+setupLights()
+//========================================================================
+{
+	glEnable(GL_LIGHT0);
+
+	// top view only needs one light
+	if (tw->topCam->value()) {
+		glDisable(GL_LIGHT1);
+		glDisable(GL_LIGHT2);
+	}
+	else {
+		glEnable(GL_LIGHT1);
+		glEnable(GL_LIGHT2);
+	}
+
+	GLfloat yellowLight[] = { 0.5f, 0.5f, .1f, 1.0 };
+	GLfloat whiteLight[] = { .5f, .5f, .5f, 1.0 };
+	GLfloat blueLight[] = { .1f,.1f,.3f,1.0 };
+	GLfloat grayLight[] = { .15f, .15f, .15f, 1.0 };
+
+	glLightfv(GL_LIGHT0, GL_DIFFUSE, whiteLight);
+	glLightfv(GL_LIGHT0, GL_AMBIENT, grayLight);
+	glLightfv(GL_LIGHT1, GL_DIFFUSE, yellowLight);
+	glLightfv(GL_LIGHT2, GL_DIFFUSE, blueLight);
+
+	// the four colored spot lights over the corners
+	GLfloat spotColorDeep[4][4] = {
+		{ 0,0.2f,0,1 }, { 0.3f,0,0,1 }, { 0,0,0.35f,1 }, { 0.3f,0.2f,0,1 } };
+	GLfloat spotColorLight[4][4] = {
+		{ 0,0.4f,0,1 }, { 0.6f,0,0,1 }, { 0,0,0.7f,1 }, { 0.6f,0.4f,0,1 } };
+	for (int i = 0; i < 4; i++) {
+		GLenum light = GL_LIGHT3 + i;
+		glEnable(light);
+		glLightfv(light, GL_AMBIENT, spotColorDeep[i]);
+		glLightfv(light, GL_DIFFUSE, spotColorLight[i]);
+		glLightfv(light, GL_SPECULAR, spotColorLight[i]);
+		glLightf(light, GL_SPOT_CUTOFF, 30);
+		glLightf(light, GL_SPOT_EXPONENT, 10.0f);
+	}
+}
+
+//************************************************************************
+//
+// * Where the lights are - this has to be done again whenever the
+//   modelview changes, since OpenGL keeps them in eye space
+//========================================================================
+void TrainView::
+placeLights()
+//========================================================================
+{
+	GLfloat lightPosition1[] = { 0,1,1,0 }; // {50, 200.0, 50, 1.0};
+	GLfloat lightPosition2[] = { 1, 0, 0, 0 };
+	GLfloat lightPosition3[] = { 0, -1, 0, 0 };
+
+	glLightfv(GL_LIGHT0, GL_POSITION, lightPosition1);
+	glLightfv(GL_LIGHT1, GL_POSITION, lightPosition2);
+	glLightfv(GL_LIGHT2, GL_POSITION, lightPosition3);
+
+	GLfloat spotDir[] = { 0,-1,0 };
+	GLfloat spotPos[4][4] = {
+		{ -50,200,-50,1 }, { 50,200,50,1 }, { -50,200,50,1 }, { 50,200,-50,1 } };
+	for (int i = 0; i < 4; i++) {
+		glLightfv(GL_LIGHT3 + i, GL_POSITION, spotPos[i]);
+		glLightfv(GL_LIGHT3 + i, GL_SPOT_DIRECTION, spotDir);
+	}
 }
 
 //************************************************************************
@@ -353,6 +462,8 @@ void TrainView::draw()
 // * This sets up both the Projection and the ModelView matrices
 //   HOWEVER: it doesn't clear the projection first (the caller handles
 //   that) - its important for picking
+//   the matrices are worked out here and handed to the camera state, so
+//   the mouse handling never has to ask OpenGL for them
 //========================================================================
 void TrainView::
 setProjection()
@@ -364,7 +475,7 @@ setProjection()
 	// Check whether we use the world camp
 	if (tw->worldCam->value())
 	{
-		arcball.setProjection(false);
+		arcball.setProjection(false, &camera);
 	}
 	// Or we use the top cam
 	else if (tw->topCam->value()) {
@@ -380,11 +491,14 @@ setProjection()
 
 		// Set up the top camera drop mode to be orthogonal and set
 		// up proper projection matrix
+		glm::mat4 projection = glm::ortho(-wi, wi, -he, he, 200.f, -200.f);
+		glm::mat4 modelview = glm::rotate(glm::mat4(1.0f), glm::radians(-90.f), glm::vec3(1, 0, 0));
+
 		glMatrixMode(GL_PROJECTION);
-		glOrtho(-wi, wi, -he, he, 200, -200);
+		glMultMatrixf(glm::value_ptr(projection));
 		glMatrixMode(GL_MODELVIEW);
-		glLoadIdentity();
-		glRotatef(-90, 1, 0, 0);
+		glLoadMatrixf(glm::value_ptr(modelview));
+		camera.set(projection, modelview, w(), h());
 	}
 	// Or do the train view or other view here
 	//####################################################################
@@ -398,25 +512,25 @@ setProjection()
 		type = (this->tw->splineBrowser->selected(1)) ? 1 : type;
 		type = (this->tw->splineBrowser->selected(2)) ? 2 : type;
 		type = (this->tw->splineBrowser->selected(3)) ? 3 : type;
-		this->getPos(this->tw->m_Track.trainU, pos, type);
-		this->getDir(this->tw->m_Track.trainU, dir, type);
-		this->getOrient(this->tw->m_Track.trainU, up, type);
+		this->getPos(this->drawnU, pos, type);
+		this->getDir(this->drawnU, dir, type);
+		this->getOrient(this->drawnU, up, type);
 
-		glMatrixMode(GL_PROJECTION);
-		glLoadIdentity();
-		gluPerspective(70, aspect, 0.1, 1000);
-
-
-		glMatrixMode(GL_MODELVIEW);
-		glLoadIdentity();
 		pos = pos + up * (trainHeight / 2) + dir * (trainLength*1.1 / 2);
 
 		Pnt3f lookat = pos + dir;
 		lookat = lookat * 1;
 
-		gluLookAt(pos.x, pos.y, pos.z,
-			lookat.x, lookat.y, lookat.z,
-			up.x, up.y, up.z);
+		glm::mat4 projection = glm::perspective(glm::radians(70.f), aspect, 0.1f, 1000.f);
+		glm::mat4 modelview = glm::lookAt(glm::vec3(pos.x, pos.y, pos.z),
+			glm::vec3(lookat.x, lookat.y, lookat.z),
+			glm::vec3(up.x, up.y, up.z));
+
+		glMatrixMode(GL_PROJECTION);
+		glLoadMatrixf(glm::value_ptr(projection));
+		glMatrixMode(GL_MODELVIEW);
+		glLoadMatrixf(glm::value_ptr(modelview));
+		camera.set(projection, modelview, w(), h());
 	}
 }
 
@@ -461,36 +575,11 @@ void TrainView::drawStuff(bool doingShadows)
 	type = (this->tw->splineBrowser->selected(1)) ? 1 : type;
 	type = (this->tw->splineBrowser->selected(2)) ? 2 : type;
 	type = (this->tw->splineBrowser->selected(3)) ? 3 : type;
-	if (!this->tw->trainCam->value())
+	std::vector<float> carts;
+	this->cartPositions(carts);
+	for (size_t c = 0; c < carts.size(); c++)
 	{
-		this->drawCarts(this->m_pTrack->trainU, doingShadows);
-	}
-	if (this->cartsCount > 0)
-	{
-		double currCartT = this->m_pTrack->trainU;
-
-		for (int c = 0; c < this->cartsCount; c++)
-		{
-			double cartMoveSum = 0;
-			Pnt3f pv;
-
-
-			this->getPos(currCartT, pv, type);
-			double incT = -1.0 / (this->DIVIDE_LINE);
-			for (int i = 0; i < this->DIVIDE_LINE; i++)
-			{
-				if (cartMoveSum >= this->cartsSpacing)
-				{
-					break;
-				}
-				Pnt3f cv;
-				currCartT += incT;
-				this->getPos(currCartT, cv, type);
-				cartMoveSum += sqrt((cv.x - pv.x)*(cv.x - pv.x) + (cv.y - pv.y)*(cv.y - pv.y) + (cv.z - pv.z)*(cv.z - pv.z));
-				pv = cv;
-			}
-			this->drawCarts(currCartT, doingShadows);
-		}
+		this->drawCarts(carts[c], doingShadows);
 	}
 
 
@@ -500,133 +589,74 @@ void TrainView::drawStuff(bool doingShadows)
 	// TODO: 
 	// call your own track drawing code
 	//####################################################################
-	this->trackDrawList.clear();
-	this->barDrawList.clear();
-
+	// nothing about the track is regenerated unless it changed (and only
+	// once a frame - the shadow pass uses what the first pass made)
 	bool arcLengthEnabled = this->tw->arcLength->value();
-	if (this->tw->multiThread->value())
+	bool trackChanged = !doingShadows && (this->changes & DAMAGE_TRACK);
+	if (this->tw->gpuSpline->value() && this->gpuTrack.init())
+	{
+		// the spline is evaluated in the tessellation shaders - the CPU
+		// only hands over the control points when they change
+		if (trackChanged)
+			this->gpuTrack.update(this->m_pTrack->points, type, arcLengthEnabled, barSpacing, DIVIDE_LINE);
+		this->gpuTrack.drawRails(doingShadows);
+		this->gpuTrack.drawBars(doingShadows);
+	}
+	else
 	{
-		std::mutex g_mutex;
-		Concurrency::parallel_for(size_t(0), this->m_pTrack->points.size(), [&](size_t i)
+		// bring the frame table up to date - only the segments next to an
+		// edited control point, or that came into the window, get sampled
+		// again
+		TrackCache& cache = this->m_pTrack->cache;
+		if (trackChanged)
 		{
-			std::vector<BarNeeds> bars;
-			std::vector<TrackNeeds> lines;
-			lines.reserve(DIVIDE_LINE * 6);
-			Pnt3f pos, dir, up;
-			float t = i;
-
-			this->getPos(t, pos, type);
-			this->getOrient(t, up, type);
-			Pnt3f pv = pos;
-			Pnt3f po = up;
-			float distSum = 0;
-			for (int j = 0; j < DIVIDE_LINE; j++)
+			cache.prepare(this->m_pTrack->points, type, arcLengthEnabled ? barSpacing : 0);
+			const std::vector<size_t>& dirty = cache.dirtySegments();
+			if (this->tw->multiThread->value())
 			{
-				t += 1.0 / DIVIDE_LINE;
-				Pnt3f cv;
-				Pnt3f co;
-				this->getPos(t, cv, type);
-				this->getOrient(t, co, type);
-
-				if (arcLengthEnabled)
+				ThreadPool::shared().parallelFor(0, dirty.size(), [&](size_t i)
 				{
-					distSum += sqrt((cv.x - pv.x)*(cv.x - pv.x) + (cv.y - pv.y)*(cv.y - pv.y) + (cv.z - pv.z)*(cv.z - pv.z));
-				}
-
-				Pnt3f cross_t = (cv - pv) * co;
-				cross_t.normalize();
-				cross_t = cross_t * 2.5f;
-
-				//Track Lines
-
-				lines.push_back(TrackNeeds{ pv,cv,cross_t });
-
-				//Track Bars
-				if ((!arcLengthEnabled && j % (this->DIVIDE_LINE / 10) == 0) || (arcLengthEnabled && distSum >= barSpacing))
-				{
-					distSum = 0;
-					getDir(t, dir, type);
-
-					bars.push_back(BarNeeds{ cv, dir,co });
-				}
-				pv = cv;
+					cache.rebuildSegment(this->m_pTrack->points, dirty[i]);
+				});
+			}
+			else
+			{
+				for (size_t i = 0; i < dirty.size(); i++)
+					cache.rebuildSegment(this->m_pTrack->points, dirty[i]);
 			}
-			g_mutex.lock();
-			this->barDrawList.insert(this->barDrawList.end(), bars.begin(), bars.end());
-			this->trackDrawList.insert(this->trackDrawList.end(), lines.begin(), lines.end());
-			g_mutex.unlock();
-
-		});
 
-		for (auto& v : this->trackDrawList)
-		{
-			drawTrack(v.pv, v.cv, v.cross_t, doingShadows);
+			//Track Rails
+			this->railMesh.update(cache);
 		}
+		this->railMesh.draw(doingShadows);
 
-		for (auto& v : this->barDrawList)
-		{
-			drawBar(v.pos, v.dir, v.up, doingShadows);
-		}
-	}
-	else
-	{
-		for (int i = 0; i < this->m_pTrack->points.size(); i++)
+		//Track Bars - the ones in the window
+		for (size_t k = 0; k < cache.windowSize(); k++)
 		{
-			Pnt3f pos, dir, up;
-			float t = i;
-
-			this->getPos(t, pos, type);
-			this->getOrient(t, up, type);
-			Pnt3f pv = pos;
-			Pnt3f po = up;
-			float distSum = 0;
-			for (int j = 0; j < DIVIDE_LINE; j++)
+			for (auto& tie : cache.ties(cache.windowSegment(k)))
 			{
-				t += 1.0 / DIVIDE_LINE;
-				Pnt3f cv;
-				Pnt3f co;
-				this->getPos(t, cv, type);
-				this->getOrient(t, co, type);
-
-				if (arcLengthEnabled)
-				{
-					distSum += sqrt((cv.x - pv.x)*(cv.x - pv.x) + (cv.y - pv.y)*(cv.y - pv.y) + (cv.z - pv.z)*(cv.z - pv.z));
-				}
-
-				Pnt3f cross_t = (cv - pv) * co;
-				cross_t.normalize();
-				cross_t = cross_t * 2.5f;
-
-				//Track Lines
-				drawTrack(pv, cv, cross_t, doingShadows);
-
-				//Track Bars
-				if ((!arcLengthEnabled && j % (this->DIVIDE_LINE / 10) == 0) || (arcLengthEnabled && distSum >= barSpacing))
-				{
-					distSum = 0;
-					getDir(t, dir, type);
-					drawBar(cv, dir, co, doingShadows);
-				}
-				pv = cv;
+				drawBar(tie.pos, tie.dir, tie.up, doingShadows);
 			}
 		}
 	}
 }
 
-void TrainView::drawTrack(Pnt3f pv, Pnt3f cv, Pnt3f cross_t, bool doingShadows)
+//************************************************************************
+//
+// * Where the carts are drawn
+//========================================================================
+void TrainView::cartPositions(std::vector<float>& ts)
 {
-	if (!doingShadows)
+	// the simulation placed them (see TrainSim::placeCarts)
+	ts.clear();
+	for (size_t c = 0; c < this->drawnCarts.size(); c++)
 	{
-
-		glColor3ub(32, 32, 64);
+		if (c == 0 && this->tw->trainCam->value())
+		{
+			continue;
+		}
+		ts.push_back(this->drawnCarts[c]);
 	}
-	glLineWidth(5);
-	glBegin(GL_LINES);
-	glVertex3f(pv.x + cross_t.x, pv.y + cross_t.y, pv.z + cross_t.z);
-	glVertex3f(cv.x + cross_t.x, cv.y + cross_t.y, cv.z + cross_t.z);
-	glVertex3f(pv.x - cross_t.x, pv.y - cross_t.y, pv.z - cross_t.z);
-	glVertex3f(cv.x - cross_t.x, cv.y - cross_t.y, cv.z - cross_t.z);
-	glEnd();
 }
 
 void TrainView::drawBar(Pnt3f pos, Pnt3f dir, Pnt3f up, bool doingShadows)
@@ -856,7 +886,7 @@ void TrainView::drawWheel(bool doingShadows)
 		glColor3ub(255, 255, 255);
 	}
 	gluDisk(objDisk, 0, this->wheelRaduis, 64, 5);
-	glRotatef(this->wheelDegree, 0, 0, 1);
+	glRotatef(this->drawnWheelDegree, 0, 0, 1);
 	if (!doingShadows)
 	{
 		glColor3ub(128, 128, 105);
@@ -884,7 +914,7 @@ void TrainView::drawWheel(bool doingShadows)
 		glColor3ub(255, 255, 255);
 	}
 	gluDisk(objDisk, 0, this->wheelRaduis, 64, 5);
-	glRotatef(this->wheelDegree, 0, 0, 1);
+	glRotatef(this->drawnWheelDegree, 0, 0, 1);
 	if (!doingShadows)
 	{
 		glColor3ub(128, 128, 105);
@@ -906,327 +936,228 @@ void TrainView::drawWheel(bool doingShadows)
 // 
 //************************************************************************
 //
-// * this tries to see which control point is under the mouse
+// * this tries to see what is under the mouse
 //	  (for when the mouse is clicked)
-//		it uses OpenGL picking - which is always a trick
+//		control points are tried first, on the CPU (see PointPicker.H),
+//		since they are what gets dragged. if none is under the mouse,
+//		every pickable thing is drawn with its ID into an offscreen
+//		buffer (see PickBuffer.H) - the answer comes back later, in
+//		resolvePick
 //########################################################################
 // TODO: 
-//		if you want to pick things other than control points, or you
-//		changed how control points are drawn, you might need to change this
+//		if you want to pick other things, or you changed how things are
+//		drawn, you might need to change drawPick
 //########################################################################
 //========================================================================
 void TrainView::
 doPick()
 //========================================================================
 {
+	// the control points - no GL needed, just the camera of the last frame
+	// (they aren't drawn when driving, so they can't be picked then)
+	Pnt3f origin, dir;
+	if (!tw->trainCam->value() &&
+		camera.mouseRay(Fl::event_x(), Fl::event_y(), origin, dir)) {
+		if (pointPickerRevision != m_pTrack->revision) {
+			pointPicker.build(m_pTrack->points);
+			pointPickerRevision = m_pTrack->revision;
+		}
+		float dist;
+		int hit = pointPicker.pick(origin, dir, &dist);
+		if (hit >= 0) {
+			// forget about a GPU pick still on the way
+			PickBuffer::Hit stale;
+			if (pickBuffer.pending()) {
+				make_current();
+				pickBuffer.resolve(true, stale);
+			}
+			if (hit != selectedCube)
+				changed(DAMAGE_SELECTION);
+			selectedCube = hit;
+			picked.kind = PickBuffer::PICK_POINT;
+			picked.index = hit;
+			picked.depth = 0;
+			printf("Selected Cube %d\n", selectedCube);
+			return;
+		}
+	}
+
 	// since we'll need to do some GL stuff so we make this window as 
 	// active window
 	make_current();
 
-	// where is the mouse?
+	// where is the mouse? - remember, FlTk is upside down!
 	int mx = Fl::event_x();
-	int my = Fl::event_y();
+	int my = h() - 1 - Fl::event_y();
 
-	// get the viewport - most reliable way to turn mouse coords into GL coords
-	int viewport[4];
-	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (!pickBuffer.begin(w(), h(), mx, my)) {
+		// no ID buffer on this driver - nothing can be picked
+		if (selectedCube >= 0)
+			changed(DAMAGE_SELECTION);
+		selectedCube = -1;
+		picked.kind = PickBuffer::PICK_NONE;
+		printf("Selected Cube %d\n", selectedCube);
+		return;
+	}
 
-	// Set up the pick matrix on the stack - remember, FlTk is
-	// upside down!
+	// the same view as what's on the screen
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
-	gluPickMatrix((double)mx, (double)(viewport[3] - my),
-		5, 5, viewport);
-
-	// now set up the projection
 	setProjection();
 
-	// now draw the objects - but really only see what we hit
-	GLuint buf[100];
-	glSelectBuffer(100, buf);
-	glRenderMode(GL_SELECT);
-	glInitNames();
-	glPushName(0);
-
-	// draw the cubes, loading the names as we go
-	for (size_t i = 0; i < m_pTrack->points.size(); ++i) {
-		glLoadName((GLuint)(i + 1));
-		m_pTrack->points[i].draw();
-	}
+	drawPick();
 
-	// go back to drawing mode, and see how picking did
-	int hits = glRenderMode(GL_RENDER);
-	if (hits) {
-		// warning; this just grabs the first object hit - if there
-		// are multiple objects, you really want to pick the closest
-		// one - see the OpenGL manual 
-		// remember: we load names that are one more than the index
-		selectedCube = buf[3] - 1;
-	}
-	else // nothing hit, nothing selected
-		selectedCube = -1;
+	pickBuffer.end();
 
-	printf("Selected Cube %d\n", selectedCube);
+	// nothing else may redraw for a while, so keep asking for the answer
+	Fl::remove_timeout(pickPollCB, this);
+	Fl::add_timeout(PICK_POLL, pickPollCB, this);
 }
 
-void TrainView::getPos(float t, Pnt3f & pos, int type)
+//************************************************************************
+//
+// * Ask for the answer of a GPU pick until it is in
+//========================================================================
+void TrainView::
+pickPollCB(void* v)
+//========================================================================
 {
-	while (t < 0)
-	{
-		t += this->tw->m_Track.points.size();
-	}
-	while (t >= this->tw->m_Track.points.size())
-	{
-		t -= this->tw->m_Track.points.size();
-	}
-	if (type == 1)
-	{
-		const ControlPoint* p0, *p1;
-		int i = floor(t);
-		float percent = t - i;
-		p0 = &this->m_pTrack->points[i];
-		p1 = &this->m_pTrack->points[(i + 1) % this->m_pTrack->points.size()];
-
-
-
-		Pnt3f qt = (1 - percent) * p0->pos + percent * p1->pos;
-
-		pos = qt;
-	}
-	else if (type == 2)
-	{
-		const ControlPoint *p0, *p1, *p2, *p3;
-		int i = floor(t);
-		float percent = t - i;
-		p0 = &this->m_pTrack->points[(i == 0) ? this->m_pTrack->points.size() - 1 : i - 1];
-		p1 = &this->m_pTrack->points[(i)];
-		p2 = &this->m_pTrack->points[(i + 1) % this->m_pTrack->points.size()];
-		p3 = &this->m_pTrack->points[(i + 2) % this->m_pTrack->points.size()];
-
-		float Gmat[12] =
-		{
-			p0->pos.x,p0->pos.y,p0->pos.z,
-			p1->pos.x,p1->pos.y,p1->pos.z,
-			p2->pos.x,p2->pos.y,p2->pos.z,
-			p3->pos.x,p3->pos.y,p3->pos.z,
-		};
-		glm::mat4x3 G = glm::make_mat4x3(Gmat);
-
-		float Tv[4] = { percent*percent*percent,percent*percent,percent,1 };
-		glm::vec4 T = glm::make_vec4(Tv);
-
-		glm::vec3 Qt = G * CarrientalM*T;
-
-
-		pos.x = Qt.x;
-		pos.y = Qt.y;
-		pos.z = Qt.z;
-	}
-
-	else if (type == 3)
-	{
-		const ControlPoint *p0, *p1, *p2, *p3;
-		int i = floor(t);
-		float percent = t - i;
-		p0 = &this->m_pTrack->points[(i == 0) ? this->m_pTrack->points.size() - 1 : i - 1];
-		p1 = &this->m_pTrack->points[(i)];
-		p2 = &this->m_pTrack->points[(i + 1) % this->m_pTrack->points.size()];
-		p3 = &this->m_pTrack->points[(i + 2) % this->m_pTrack->points.size()];
-
-		float Gmat[12] =
-		{
-			p0->pos.x,p0->pos.y,p0->pos.z,
-			p1->pos.x,p1->pos.y,p1->pos.z,
-			p2->pos.x,p2->pos.y,p2->pos.z,
-			p3->pos.x,p3->pos.y,p3->pos.z,
-		};
-		glm::mat4x3 G = glm::make_mat4x3(Gmat);
-
-		float Tv[4] = { percent*percent*percent,percent*percent,percent,1 };
-		glm::vec4 T = glm::make_vec4(Tv);
-
-		glm::vec3 Qt = G * B_SplineM*T;
-
-		pos.x = Qt.x;
-		pos.y = Qt.y;
-		pos.z = Qt.z;
-	}
+	TrainView* tv = (TrainView*)v;
+	tv->resolvePick(false);
+	if (tv->pickBuffer.pending())
+		Fl::repeat_timeout(PICK_POLL, pickPollCB, v);
 }
 
-void TrainView::getDir(float t, Pnt3f & dir, int type)
+//************************************************************************
+//
+// * Both rails of a segment as wide lines through its frames, as wide
+//   as the GPU draws them
+//========================================================================
+static void drawRailLines(const std::vector<TrackFrame>& frames)
+//========================================================================
 {
-	while (t < 0)
-	{
-		t += this->tw->m_Track.points.size();
-	}
-	while (t >= this->tw->m_Track.points.size())
-	{
-		t -= this->tw->m_Track.points.size();
+	glLineWidth(5);
+	for (int r = 0; r < 2; ++r) {
+		float side = (r == 0) ? -RailMesh::RAIL_OFFSET : RailMesh::RAIL_OFFSET;
+		glBegin(GL_LINE_STRIP);
+		for (const TrackFrame& f : frames) {
+			Pnt3f p = f.pos + f.cross * side;
+			glVertex3f(p.x, p.y, p.z);
+		}
+		glEnd();
 	}
-	if (type == 1)
-	{
-		const ControlPoint* p0, *p1;
-		int i = floor(t);
-		float percent = t - i;
-		p0 = &this->m_pTrack->points[i];
-		p1 = &this->m_pTrack->points[(i + 1) % this->m_pTrack->points.size()];
+	glLineWidth(1);
+}
 
+//************************************************************************
+//
+// * Draw everything that can be picked with its ID
+//	 no colors - the ID shader ignores them anyway
+//========================================================================
+void TrainView::
+drawPick()
+//========================================================================
+{
+	int type = 0;
+	type = (this->tw->splineBrowser->selected(1)) ? 1 : type;
+	type = (this->tw->splineBrowser->selected(2)) ? 2 : type;
+	type = (this->tw->splineBrowser->selected(3)) ? 3 : type;
 
-		dir = (p1->pos - p0->pos);
-		dir.normalize();
+	// the control points (not when driving - they aren't drawn then)
+	if (!tw->trainCam->value()) {
+		for (size_t i = 0; i < m_pTrack->points.size(); ++i) {
+			pickBuffer.setId(PickBuffer::PICK_POINT, (int)i);
+			m_pTrack->points[i].draw();
+		}
 	}
-	else if (type == 2)
-	{
-		const ControlPoint *p0, *p1, *p2, *p3;
-		int i = floor(t);
-		float percent = t - i;
-		p0 = &this->m_pTrack->points[(i == 0) ? this->m_pTrack->points.size() - 1 : i - 1];
-		p1 = &this->m_pTrack->points[(i)];
-		p2 = &this->m_pTrack->points[(i + 1) % this->m_pTrack->points.size()];
-		p3 = &this->m_pTrack->points[(i + 2) % this->m_pTrack->points.size()];
 
-
-		float Gmat[12] =
-		{
-			p0->pos.x,p0->pos.y,p0->pos.z,
-			p1->pos.x,p1->pos.y,p1->pos.z,
-			p2->pos.x,p2->pos.y,p2->pos.z,
-			p3->pos.x,p3->pos.y,p3->pos.z,
-		};
-		glm::mat4x3 G = glm::make_mat4x3(Gmat);
-
-		float Tv[4] = { percent*percent*percent,percent*percent,percent,1 };
-		glm::vec4 T = glm::make_vec4(Tv);
-
-		float dTv[4] = { 3 * percent*percent,2 * percent,1,0 };
-		glm::vec4 dT = glm::make_vec4(dTv);
-		glm::vec3 dQt = G * CarrientalM*dT;
-		dir.x = dQt.x;
-		dir.y = dQt.y;
-		dir.z = dQt.z;
-
-		dir.normalize();
+	// the carts
+	std::vector<float> carts;
+	cartPositions(carts);
+	for (size_t c = 0; c < carts.size(); ++c) {
+		pickBuffer.setId(PickBuffer::PICK_CART, (int)c);
+		drawCarts(carts[c], true);
 	}
 
-	else if (type == 3)
-	{
-		const ControlPoint *p0, *p1, *p2, *p3;
-		int i = floor(t);
-		float percent = t - i;
-		p0 = &this->m_pTrack->points[(i == 0) ? this->m_pTrack->points.size() - 1 : i - 1];
-		p1 = &this->m_pTrack->points[(i)];
-		p2 = &this->m_pTrack->points[(i + 1) % this->m_pTrack->points.size()];
-		p3 = &this->m_pTrack->points[(i + 2) % this->m_pTrack->points.size()];
-
-		float Gmat[12] =
-		{
-			p0->pos.x,p0->pos.y,p0->pos.z,
-			p1->pos.x,p1->pos.y,p1->pos.z,
-			p2->pos.x,p2->pos.y,p2->pos.z,
-			p3->pos.x,p3->pos.y,p3->pos.z,
-		};
-		glm::mat4x3 G = glm::make_mat4x3(Gmat);
-
-
-		float Tv[4] = { percent*percent*percent,percent*percent,percent,1 };
-		glm::vec4 T = glm::make_vec4(Tv);
-
-		float dTv[4] = { 3 * percent*percent,2 * percent,1,0 };
-		glm::vec4 dT = glm::make_vec4(dTv);
-		glm::vec3 dQt = G * B_SplineM*dT;
-		dir.x = dQt.x;
-		dir.y = dQt.y;
-		dir.z = dQt.z;
-
-		dir.normalize();
+	// the track - the cache is shared with drawing, so this is usually
+	// already up to date (unless the GPU path is drawing the track). the
+	// GPU path has no rail mesh, so its rails are picked as wide lines
+	// through the frames. the ties are counted from the start of the
+	// window
+	TrackCache& cache = m_pTrack->cache;
+	cache.update(m_pTrack->points, type, tw->arcLength->value() ? barSpacing : 0);
+	bool gpu = tw->gpuSpline->value() && gpuTrack.ready();
+	if (!gpu)
+		railMesh.update(cache);
+	int tie = 0;
+	for (size_t k = 0; k < cache.windowSize(); ++k) {
+		size_t s = cache.windowSegment(k);
+		pickBuffer.setId(PickBuffer::PICK_SEGMENT, (int)s);
+		if (gpu)
+			drawRailLines(cache.frames(s));
+		else
+			railMesh.drawSegment(cache, s);
+		for (auto& t : cache.ties(s)) {
+			pickBuffer.setId(PickBuffer::PICK_TIE, tie++);
+			drawBar(t.pos, t.dir, t.up, true);
+		}
 	}
 }
 
-void TrainView::getOrient(float t, Pnt3f& up, int type)
+//************************************************************************
+//
+// * Take the answer of the last pick
+//========================================================================
+void TrainView::
+resolvePick(bool wait)
+//========================================================================
 {
-	while (t < 0)
-	{
-		t += this->tw->m_Track.points.size();
-	}
-	while (t >= this->tw->m_Track.points.size())
-	{
-		t -= this->tw->m_Track.points.size();
-	}
-	if (type == 1)
-	{
-		const ControlPoint* p0, *p1;
-		int i = floor(t);
-		float percent = t - i;
-		p0 = &this->m_pTrack->points[i];
-		p1 = &this->m_pTrack->points[(i + 1) % this->m_pTrack->points.size()];
-
-		Pnt3f orient_t = (1 - percent) * p0->orient + percent * p1->orient;
-		orient_t.normalize();
-
-		up = orient_t;
-		up.normalize();
-
-	}
-	else if (type == 2)
-	{
-		const ControlPoint *p0, *p1, *p2, *p3;
-		int i = floor(t);
-		float percent = t - i;
-		p0 = &this->m_pTrack->points[(i == 0) ? this->m_pTrack->points.size() - 1 : i - 1];
-		p1 = &this->m_pTrack->points[(i)];
-		p2 = &this->m_pTrack->points[(i + 1) % this->m_pTrack->points.size()];
-		p3 = &this->m_pTrack->points[(i + 2) % this->m_pTrack->points.size()];
-
+	if (!pickBuffer.pending())
+		return;
 
-		float Tv[4] = { percent*percent*percent,percent*percent,percent,1 };
-		glm::vec4 T = glm::make_vec4(Tv);
-
-
-		float Omat[12] =
-		{
-			p0->orient.x,p0->orient.y,p0->orient.z,
-			p1->orient.x,p1->orient.y,p1->orient.z,
-			p2->orient.x,p2->orient.y,p2->orient.z,
-			p3->orient.x,p3->orient.y,p3->orient.z,
-		};
-		glm::mat4x3 O = glm::make_mat4x3(Omat);
-		glm::vec3 Ot = O * CarrientalM*T;
-
-		up.x = Ot.x;
-		up.y = Ot.y;
-		up.z = Ot.z;
-
-		up.normalize();
+	make_current();
+	PickBuffer::Hit hit;
+	if (!pickBuffer.resolve(wait, hit))
+		return;
+
+	picked = hit;
+	int selected = (hit.kind == PickBuffer::PICK_POINT) ? hit.index : -1;
+	if (selected != selectedCube)
+		changed(DAMAGE_SELECTION);
+	selectedCube = selected;
+
+	switch (hit.kind) {
+	case PickBuffer::PICK_CART:
+		printf("Selected Cart %d\n", hit.index);
+		break;
+	case PickBuffer::PICK_TIE:
+		printf("Selected Tie %d\n", hit.index);
+		break;
+	case PickBuffer::PICK_SEGMENT:
+		printf("Selected Segment %d\n", hit.index);
+		break;
+	default:
+		printf("Selected Cube %d\n", selectedCube);
+		break;
 	}
+}
 
-	else if (type == 3)
-	{
-		const ControlPoint *p0, *p1, *p2, *p3;
-		int i = floor(t);
-		float percent = t - i;
-		p0 = &this->m_pTrack->points[(i == 0) ? this->m_pTrack->points.size() - 1 : i - 1];
-		p1 = &this->m_pTrack->points[(i)];
-		p2 = &this->m_pTrack->points[(i + 1) % this->m_pTrack->points.size()];
-		p3 = &this->m_pTrack->points[(i + 2) % this->m_pTrack->points.size()];
-
-
-		float Tv[4] = { percent*percent*percent,percent*percent,percent,1 };
-		glm::vec4 T = glm::make_vec4(Tv);
-
-		float Omat[12] =
-		{
-			p0->orient.x,p0->orient.y,p0->orient.z,
-			p1->orient.x,p1->orient.y,p1->orient.z,
-			p2->orient.x,p2->orient.y,p2->orient.z,
-			p3->orient.x,p3->orient.y,p3->orient.z,
-		};
-		glm::mat4x3 O = glm::make_mat4x3(Omat);
-		glm::vec3 Ot = O * B_SplineM*T;
+//************************************************************************
+//
+// * Evaluate the track - the spline math itself lives in Spline.cpp so
+//   the GPU path can share the basis matrices
+//========================================================================
+void TrainView::getPos(float t, Pnt3f & pos, int type)
+{
+	splinePos(this->m_pTrack->points, t, pos, type);
+}
 
-		up.x = Ot.x;
-		up.y = Ot.y;
-		up.z = Ot.z;
+void TrainView::getDir(float t, Pnt3f & dir, int type)
+{
+	splineDir(this->m_pTrack->points, t, dir, type);
+}
 
-		up.normalize();
-	}
+void TrainView::getOrient(float t, Pnt3f& up, int type)
+{
+	splineOrient(this->m_pTrack->points, t, up, type);
 }
@@ -27,7 +27,10 @@
 
 #include <FL/fl.h>
 #include <FL/Fl_Box.h>
+#include <FL/fl_ask.H>
 #include <string>
+#include <stdio.h>
+#include <chrono>
 
 // for using the real time clock
 #include <time.h>
@@ -35,6 +38,7 @@
 #include "TrainWindow.H"
 #include "TrainView.H"
 #include "CallBacks.H"
+#include "CatalogWindow.H"
 
 
 
@@ -63,6 +67,7 @@ TrainWindow(const int x, const int y)
 
 		runButton = new Fl_Button(605, pty, 60, 20, "Run");
 		togglify(runButton);
+		runButton->callback((Fl_Callback*)runButtonCB, this);
 
 		Fl_Button* fb = new Fl_Button(700, pty, 25, 20, "@>>");
 		fb->callback((Fl_Callback*)forwCB, this);
@@ -78,6 +83,7 @@ TrainWindow(const int x, const int y)
 		speed->value(2);
 		speed->align(FL_ALIGN_LEFT);
 		speed->type(FL_HORIZONTAL);
+		speed->callback((Fl_Callback*)damageCB, this);
 
 		pty += 30;
 
@@ -147,6 +153,10 @@ TrainWindow(const int x, const int y)
 		// TODO: add widgets for all of your fancier features here
 		physics = new Fl_Button(605, pty, 65, 20, "Physics");
 		togglify(physics, 1);
+		Fl_Button* exportb = new Fl_Button(675, pty, 60, 20, "Export");
+		exportb->callback((Fl_Callback*)exportCB, this);
+		Fl_Button* tracksb = new Fl_Button(740, pty, 55, 20, "Tracks");
+		tracksb->callback((Fl_Callback*)catalogCB, this);
 		
 
 		pty += 30;
@@ -166,6 +176,15 @@ TrainWindow(const int x, const int y)
 		pty += 30;
 		multiThread = new Fl_Button(605, pty, 100, 20, "Multi Threading");
 		togglify(multiThread, 1);
+		gpuSpline = new Fl_Button(710, pty, 85, 20, "GPU Spline");
+		togglify(gpuSpline, 0);
+
+		pty += 30;
+		loadStatus = new Fl_Box(605, pty, 120, 20, loadStatusStr);
+		loadStatus->align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+		cancelLoad = new Fl_Button(730, pty, 65, 20, "Cancel");
+		cancelLoad->callback((Fl_Callback*)cancelLoadCB, this);
+		cancelLoad->deactivate();
 
 		// we need to make a little phantom widget to have things resize correctly
 		Fl_Box* resizebox = new Fl_Box(600, 595, 200, 5);
@@ -175,8 +194,40 @@ TrainWindow(const int x, const int y)
 	}
 	end();	// done adding to this widget
 
-	// set up callback on idle
-	Fl::add_idle((void(*)(void*))runButtonCB, this);
+	// start the simulation - it wakes us up (Fl::awake) when it has
+	// something new to show, but only once until we've looked
+	TrainSim::Params params;
+	params.defaultSpeed = trainView->defaultSpeed;
+	params.minSpeed = trainView->minSpeed;
+	params.maxSpeed = trainView->maxSpeed;
+	params.gravityFactor = trainView->gravityFactor;
+	params.wheelRadius = trainView->wheelRaduis;
+	params.cartsSpacing = trainView->cartsSpacing;
+	params.rollingFriction = trainView->rollingFriction;
+	params.drag = trainView->airDrag;
+	trainSim.start(params, [this]() {
+		if (!simAwakePending.exchange(true))
+			Fl::awake(simPublishedCB, this);
+	});
+	postToSim();
+
+	// everything the widgets do can be recorded - except the load, save and
+	// export dialogs and the Tracks window (loading is recorded by file name
+	// instead, once it is in)
+	recorder.attach(widgets, { (Fl_Callback*)loadCB, (Fl_Callback*)saveCB,
+							   (Fl_Callback*)exportCB, (Fl_Callback*)catalogCB,
+							   (Fl_Callback*)cancelLoadCB });
+}
+
+//************************************************************************
+//
+// * The Tracks window goes with us (it may be reading tracks still)
+//========================================================================
+TrainWindow::
+~TrainWindow()
+//========================================================================
+{
+	delete catalogWindow;
 }
 
 //************************************************************************
@@ -198,86 +249,245 @@ togglify(Fl_Button* b, int val)
 // *
 //========================================================================
 void TrainWindow::
-damageMe()
+damageMe(unsigned int what)
 //========================================================================
 {
-	if (trainView->selectedCube >= ((int)m_Track.points.size()))
+	if (trainView->selectedCube >= ((int)m_Track.points.size())) {
 		trainView->selectedCube = 0;
-	trainView->damage(1);
+		what |= TrainView::DAMAGE_SELECTION;
+	}
+	postToSim();
+	trainView->changed(what);
 }
 
 //************************************************************************
 //
-// * This will get called (approximately) 30 times per second
-//   if the run button is pressed
+// * Hand the widget settings (and edited points) to the simulation
 //========================================================================
 void TrainWindow::
-advanceTrain(float dir)
+postToSim()
 //========================================================================
 {
-	//#####################################################################
-	// TODO: make this work for your train
-	//#####################################################################
+	TrainSim::Settings s;
+	s.running = runButton->value() != 0;
+	s.type = splineType();
+	s.arcLength = arcLength->value() != 0;
+	s.physics = physics->value() != 0;
+	s.speed = (float)speed->value();
+	s.cartsCount = trainView->cartsCount;
+	trainSim.setSettings(s);
+
+	if (postedRevision != m_Track.revision) {
+		trainSim.setPoints(m_Track.points);
+		postedRevision = m_Track.revision;
+	}
+}
 
-	// note - we give a little bit more example code here than normal,
-	// so you can see how this works
+//************************************************************************
+//
+// * Which line of the spline browser is picked
+//========================================================================
+int TrainWindow::
+splineType() const
+//========================================================================
+{
 	int type = 0;
-	type = (this->splineBrowser->selected(1)) ? 1 : type;
-	type = (this->splineBrowser->selected(2)) ? 2 : type;
-	type = (this->splineBrowser->selected(3)) ? 3 : type;
+	type = (splineBrowser->selected(1)) ? 1 : type;
+	type = (splineBrowser->selected(2)) ? 2 : type;
+	type = (splineBrowser->selected(3)) ? 3 : type;
+	return type;
+}
 
-	if (arcLength->value())
-	{
-		double targetMovement;
-		if (this->physics->value())
-		{
-			Pnt3f cDir;
-			this->trainView->getDir(this->m_Track.trainU, cDir, type);
-			this->trainView->currTrainSpeed += (-cDir.y)*this->trainView->gravityFactor;
-			this->trainView->currTrainSpeed = (this->trainView->currTrainSpeed < this->trainView->minSpeed) ? this->trainView->minSpeed : this->trainView->currTrainSpeed;
-			this->trainView->currTrainSpeed = (this->trainView->currTrainSpeed > this->trainView->maxSpeed) ? this->trainView->maxSpeed : this->trainView->currTrainSpeed;
-			targetMovement = this->trainView->currTrainSpeed * ((float)speed->value() * .02f) * dir;
-			std::string str = ("Current Speed: " + std::to_string(this->trainView->currTrainSpeed));
-			strcpy_s(this->currentSpeedStr, str.c_str());
-			this->currentSpeed->label(this->currentSpeedStr);
-		}
-		else
-		{
-			targetMovement = this->trainView->defaultSpeed * ((float)speed->value() * .02f) * dir;
-			std::string str = ("Current Speed: " + std::to_string(this->trainView->defaultSpeed));
-			strcpy_s(this->currentSpeedStr, str.c_str());
-			this->currentSpeed->label(this->currentSpeedStr);
-		}
+//************************************************************************
+//
+// * Where to draw the train - in between simulation steps
+//   the carts are moved along with the front one
+//========================================================================
+void TrainWindow::
+updateDrawnTrain()
+//========================================================================
+{
+	if (trainSim.update())
+		recorder.tick(trainSim.latest().steps);
+	const TrainSnapshot& snap = trainSim.latest();
+
+	float nct = (float)m_Track.points.size();
+	float u = trainSim.drawnU(m_Track.points.size());
+	float du = u - snap.u;
+
+	m_Track.trainU = snap.u;
+	trainView->drawnU = u;
+	trainView->wheelDegree = snap.wheelDegree;
+	trainView->drawnWheelDegree = trainSim.drawnWheelDegree();
+
+	trainView->drawnCarts.resize(snap.carts.size());
+	for (size_t c = 0; c < snap.carts.size(); ++c) {
+		float cu = snap.carts[c] + du;
+		if (cu >= nct) cu -= nct;
+		if (cu < 0) cu += nct;
+		trainView->drawnCarts[c] = cu;
+	}
+}
 
-		double sumMovement = 0;
-		Pnt3f pv;
-		this->trainView->getPos(this->m_Track.trainU, pv, type);
-		double tInc = (1.0 / this->trainView->DIVIDE_LINE);
-		if (signbit(targetMovement))
-		{
-			tInc *= -1;
-		}
-		for (int i = 0; i < this->trainView->DIVIDE_LINE; i++)
-		{
-			if (fabs(sumMovement) >= fabs(targetMovement))
-			{
-				break;
-			}
-			Pnt3f cv;
-			this->m_Track.trainU += tInc;
-			this->trainView->getPos(this->m_Track.trainU, cv, type);
-			sumMovement += sqrt((cv.x - pv.x)*(cv.x - pv.x) + (cv.y - pv.y)*(cv.y - pv.y) + (cv.z - pv.z)*(cv.z - pv.z));
-			pv = cv;
+//************************************************************************
+//
+// * Move the train by hand (the << and >> buttons)
+//========================================================================
+void TrainWindow::
+advanceTrain(float dir)
+//========================================================================
+{
+	trainSim.nudge(dir);
+}
 
+//************************************************************************
+//
+// * Read a track file
+//========================================================================
+void TrainWindow::
+loadTrack(const char* fname, bool whole)
+//========================================================================
+{
+	if (!whole) {
+		// the tables are built for what is picked now, so they are ready
+		// to draw when the track is swapped in
+		float tieSpacing = arcLength->value() ? trainView->barSpacing : 0;
+		trackLoader.start(fname, splineType(), tieSpacing, [this]() {
+			Fl::awake(loadFinishedCB, this);
+		});
+		Fl::remove_timeout(loadProgressCB, this);
+		Fl::add_timeout(0.1, loadProgressCB, this);
+		showLoading();
+		return;
+	}
+
+	trackLoader.cancel();
+	showLoading();
+	const char* error = 0;
+	if (!m_Track.readPoints(fname, &error)) {
+		fprintf(stderr, "%s: %s\n", fname, error);
+		return;
+	}
+	trainSim.placeTrain(m_Track.trainU);
+	recorder.load(fname);
+	damageMe();
+}
+
+//************************************************************************
+//
+// * The loading label and the cancel button
+//========================================================================
+void TrainWindow::
+showLoading()
+//========================================================================
+{
+	if (trackLoader.busy()) {
+		snprintf(loadStatusStr, sizeof(loadStatusStr), "Loading %d%%",
+				 (int)(trackLoader.progress() * 100));
+		cancelLoad->activate();
+	}
+	else {
+		loadStatusStr[0] = 0;
+		cancelLoad->deactivate();
+	}
+	loadStatus->redraw();
+}
+
+//************************************************************************
+//
+// * Play a session back - each thing is let finish before the next, so
+//   the same log always does the same work
+//========================================================================
+bool TrainWindow::
+replay(const char* fname)
+//========================================================================
+{
+	if (!recorder.replay(fname))
+		return false;
+
+	// the simulation steps come from the log, not the clock
+	trainSim.setClocked(false);
+	trainSim.sync();
+
+	unsigned long records = 0;
+	unsigned long frames = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	Recorder::Record r;
+	while (recorder.next(r)) {
+		++records;
+		switch (r.kind) {
+		case Recorder::REC_EVENT:
+			Recorder::applyEvent(r);
+			trainView->handle(r.event);
+			trainSim.sync();
+			break;
+		case Recorder::REC_WIDGET:
+			recorder.applyWidget(r);
+			trainSim.sync();
+			break;
+		case Recorder::REC_LOAD:
+			loadTrack(r.name.c_str(), true);
+			trainSim.sync();
+			break;
+		case Recorder::REC_TICK:
+			trainSim.runTo(r.steps);
+			simPublishedCB(this);
+			break;
+		case Recorder::REC_FRAME:
+			trainView->redraw();
+			Fl::flush();
+			++frames;
+			break;
+		default:
+			break;
 		}
-		this->trainView->wheelDegree += 360 * sumMovement / (this->trainView->wheelRaduis*3.1415926*2);
 	}
-	else
-	{
-		this->m_Track.trainU += dir * ((float)speed->value() * .02f);
-		this->trainView->wheelDegree += 720*dir * ((float)speed->value() * .02f);
+
+	double ms = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+	printf("Replayed %lu records, %lu frames in %.1f ms (%.3f ms a frame)\n",
+		   records, frames, ms, frames ? ms / frames : 0.0);
+
+	recorder.close();
+	trainSim.setClocked(true);
+	return true;
+}
+
+//************************************************************************
+//
+// * Autosave - a journal still there means the program didn't get to
+//   stopJournal last time
+//========================================================================
+void TrainWindow::
+startJournal(const char* fname)
+//========================================================================
+{
+	std::vector<ControlPoint> saved;
+	size_t edits = 0;
+	if (TrackJournal::recover(fname, saved, &edits) && saved.size() >= 4 &&
+		fl_choice("The last session didn't end cleanly. Bring back its track\n"
+				  "(%u points, %u edits since it was last saved whole)?",
+				  "Start Fresh", "Recover", 0,
+				  (unsigned)saved.size(), (unsigned)edits) == 1) {
+		m_Track.points.swap(saved);
+		m_Track.pointsChanged();
+		m_Track.trainU = 0;
+		trainSim.placeTrain(0);
+		damageMe();
 	}
-	float nct = this->m_Track.points.size();
-	if (this->m_Track.trainU > nct) this->m_Track.trainU -= nct;
-	if (this->m_Track.trainU < 0) this->m_Track.trainU += nct;
-}
\ No newline at end of file
+
+	// only hooked up once the journal has its first snapshot - that is
+	// the track as it is now
+	if (journal.start(fname, m_Track.points))
+		m_Track.journal = &journal;
+	else
+		fprintf(stderr, "Can't write the autosave journal %s\n", fname);
+}
+
+void TrainWindow::
+stopJournal()
+{
+	m_Track.journal = 0;
+	journal.stop(true);
+}
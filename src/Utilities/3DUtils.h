@@ -35,6 +35,8 @@
 //************************************************************************
 typedef float HMatrix[4][4];
 
+class CameraState;
+
 
 //************************************************************************
 // draw a little cube centered
@@ -103,7 +105,10 @@ void unsetupShadows(void);
 // Given the position of the mouse in 2D, we need to figure out where
 // it is in 3D. of course, its not in one place, its a line
 // this function gets that ray for you (well, it gets 2 points on the line)
-int getMouseLine(double& p1x, double& p1y, double& p1z,
+// the matrices come from the camera (see CameraState.H) - asking OpenGL
+// for them would stall the driver on every mouse event
+int getMouseLine(const CameraState& camera,
+								 double& p1x, double& p1y, double& p1z,
 								 double& p2x, double& p2y, double& p2z);
 			  
 //************************************************************************
@@ -68,6 +68,9 @@
 
 #include "stdio.h"
 
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
 //**************************************************************************
 //
 // * Constructor
@@ -116,24 +119,31 @@ setup(Fl_Gl_Window* _wind, float _fieldOfView, float _eyeZ,
 // * Set up the camera projection 
 //==========================================================================
 void ArcBallCam::
-setProjection(bool doClear)
+setProjection(bool doClear, CameraState* published)
 //==========================================================================
 {
+  // Compute the aspect ratio so we don't distort things
+  float aspect = ((float) wind->w()) / ((float) wind->h());
+  glm::mat4 projection = glm::perspective(glm::radians(fieldOfView), aspect, .1f, 1000.f);
+
+  // Put the camera where we want it to be, using the transformation in
+  // the ArcBall
+  HMatrix m;
+  getMatrix(m);
+  glm::mat4 modelview = glm::translate(glm::mat4(1.0f), glm::vec3(-eyeX, -eyeY, -eyeZ)) *
+						glm::make_mat4(asGlMatrix(m));
+
   glMatrixMode(GL_PROJECTION);
   if (doClear)
-	  glLoadIdentity();
+	  glLoadMatrixf(glm::value_ptr(projection));
+  else
+	  glMultMatrixf(glm::value_ptr(projection));
 
-  // Compute the aspect ratio so we don't distort things
-  double aspect = ((double) wind->w()) / ((double) wind->h());
-  gluPerspective(fieldOfView, aspect, .1, 1000);
-
-  // Put the camera where we want it to be
   glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
+  glLoadMatrixf(glm::value_ptr(modelview));
 
-  // Use the transformation in the ArcBall
-  glTranslatef(-eyeX, -eyeY, -eyeZ);
-  multMatrix();
+  if (published)
+	  published->set(projection, modelview, wind->w(), wind->h());
 }
 
 //**************************************************************************
@@ -163,8 +173,7 @@ handle(int e)
 				// Compute the mouse position
 				down(x, y);
 
-				// Tell window to refresh
-				wind->damage(1);
+				// nothing has moved yet, so no need to redraw
 
 				// Set up the mode
 				mode = (Fl::event_state() & FL_ALT) ? Pan : Rotate;
@@ -174,7 +183,6 @@ handle(int e)
 
 		case FL_RELEASE:
 			if (mode != None) {
-				wind->damage(1);
 				mode = None;
 				return 1;
 			}
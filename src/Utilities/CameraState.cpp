@@ -0,0 +1,98 @@
+/************************************************************************
+     File:        CameraState.cpp
+
+     Comment:     A CPU side copy of the camera
+
+						see CameraState.H
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+
+#include "CameraState.H"
+
+//**************************************************************************
+//
+// * No camera until someone sets one
+//==========================================================================
+CameraState::
+CameraState()
+	: valid(false)
+//==========================================================================
+{
+	viewport[0] = viewport[1] = viewport[2] = viewport[3] = 0;
+}
+
+//**************************************************************************
+//
+// * Keep the matrices - and the inverse, since every unproject needs it
+//==========================================================================
+void CameraState::
+set(const glm::mat4& proj, const glm::mat4& mv, int viewportWidth, int viewportHeight)
+//==========================================================================
+{
+	projection = proj;
+	modelview = mv;
+	viewport[0] = 0;
+	viewport[1] = 0;
+	viewport[2] = viewportWidth;
+	viewport[3] = viewportHeight;
+	inverse = glm::inverse(projection * modelview);
+	valid = true;
+}
+
+//**************************************************************************
+//
+// * What gluUnProject does
+//==========================================================================
+bool CameraState::
+unproject(double wx, double wy, double wz, Pnt3f& world) const
+//==========================================================================
+{
+	if (!valid || viewport[2] <= 0 || viewport[3] <= 0)
+		return false;
+
+	glm::vec4 ndc(
+		(float)(2 * (wx - viewport[0]) / viewport[2] - 1),
+		(float)(2 * (wy - viewport[1]) / viewport[3] - 1),
+		(float)(2 * wz - 1),
+		1.0f);
+	glm::vec4 p = inverse * ndc;
+	if (p.w == 0)
+		return false;
+
+	world = Pnt3f(p.x / p.w, p.y / p.w, p.z / p.w);
+	return true;
+}
+
+//**************************************************************************
+//
+// * The mouse line - FlTk is upside down
+//==========================================================================
+bool CameraState::
+mouseLine(int mx, int my, Pnt3f& p1, Pnt3f& p2) const
+//==========================================================================
+{
+	double y = viewport[3] - my;
+	return unproject(mx, y, .25, p1) && unproject(mx, y, .75, p2);
+}
+
+//**************************************************************************
+//
+// * The mouse line as a ray
+//==========================================================================
+bool CameraState::
+mouseRay(int mx, int my, Pnt3f& origin, Pnt3f& dir) const
+//==========================================================================
+{
+	Pnt3f p2;
+	double y = viewport[3] - my;
+	if (!unproject(mx, y, 0, origin) || !unproject(mx, y, 1, p2))
+		return false;
+
+	dir = p2 - origin;
+	dir.normalize();
+	return true;
+}
@@ -23,6 +23,9 @@
 *************************************************************************/
 
 #include "stdio.h"
+#include <stdlib.h>
+#include <string.h>
+#include "ThreadPool.H"
 #include "TrainWindow.H"
 
 #pragma warning(push)
@@ -32,12 +35,62 @@
 #pragma warning(pop)
 
 
-int main(int, char**)
+//
+// --record file	write everything that happens to a session log
+// --replay file	play a session log back as fast as possible, say how
+//					long it took, and quit (see Recorder.H)
+// --journal file	autosave the edits to file rather than autosave.jnl
+//					(see TrackJournal.H)
+// --no-journal		don't autosave
+// --threads n		share the work over n threads rather than one per core
+//					(see ThreadPool.H)
+//
+int main(int argc, char** argv)
 {
 	printf("CS559 Train Assignment\n");
 
+	const char* recordFile = 0;
+	const char* replayFile = 0;
+	const char* journalFile = "autosave.jnl";
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--no-journal"))
+			journalFile = 0;
+		else if (i + 1 == argc)
+			break;
+		else if (!strcmp(argv[i], "--record"))
+			recordFile = argv[++i];
+		else if (!strcmp(argv[i], "--replay"))
+			replayFile = argv[++i];
+		else if (!strcmp(argv[i], "--journal"))
+			journalFile = argv[++i];
+		else if (!strcmp(argv[i], "--threads"))
+			ThreadPool::setSharedSize((unsigned int)atoi(argv[++i]));
+	}
+
+	// the simulation thread wakes us up with Fl::awake, which needs the
+	// FlTk lock set up
+	Fl::lock();
+
 	TrainWindow tw;
 	tw.show();
 
+	if (replayFile) {
+		// get the window up before the first frame - a replay is never
+		// journaled, so it does the same work every time
+		Fl::check();
+		return tw.replay(replayFile) ? 0 : 1;
+	}
+
+	// offers to bring back the track from a session that didn't end
+	// cleanly - before the recording starts, so it begins with that track
+	if (journalFile)
+		tw.startJournal(journalFile);
+
+	if (recordFile)
+		tw.recorder.record(recordFile);
+
 	Fl::run();
-}
\ No newline at end of file
+
+	// the window was closed: nothing to recover
+	tw.stopJournal();
+}
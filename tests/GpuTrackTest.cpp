@@ -0,0 +1,339 @@
+/************************************************************************
+     File:        GpuTrackTest.cpp
+
+     Comment:     The GPU track drawn next to the CPU one, and compared
+
+						GpuTrack evaluates the spline in its shaders; the
+						CPU path draws from the frame table of TrackCache.
+						Both have to put the rails and the ties in the same
+						place. This draws a hilly, banked loop offscreen
+						both ways - the GPU rails and ties as GpuTrack
+						draws them, then the rails as lines through the
+						cache's frames and its ties as TrainView::drawBar
+						draws them - for each spline type, from above and
+						from the side, and compares the pictures. The ties
+						are drawn once more with fewer than ten steps a
+						segment, which has to work too.
+
+						Pixels are compared by whether anything was drawn
+						there, not by colour (the GPU ties are lit, the
+						reference ones aren't). A few along the edges may
+						be different - the GPU rails are tessellated, not
+						drawn through the frames - but no more than
+						MAX_DIFFERENT of them.
+
+						There is no window: the context is made with EGL
+						without a surface, so Mesa's llvmpipe will do and
+						no GPU is needed. Exits with 77 (skipped) if there
+						is no GL 4.3 context to be had, 1 if the pictures
+						differ. Given a directory, it writes the pictures
+						there as PPM files.
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glad/glad.h>
+
+#include "GpuTrack.H"
+#include "TrackCache.H"
+
+static const int SIZE = 320;
+// as TrainView draws the track
+static const float TIE_SPACING = 7.5f;
+static const int DIVIDE_LINE = 1000;
+static const float RAIL_OFFSET = 2.5f;
+// how much of what was drawn may differ
+static const double MAX_DIFFERENT = 0.005;
+static const int SKIPPED = 77;
+
+typedef std::vector<unsigned char> Image;
+
+//
+// a GL 4.3 compatibility context with nothing to draw on, then a
+// framebuffer of SIZE x SIZE to draw on instead
+//
+static bool makeContext(const char*& why)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay display = getDisplay ?
+		getDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0) : EGL_NO_DISPLAY;
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0)) {
+		why = "no EGL display";
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		why = "EGL can't do desktop GL";
+		return false;
+	}
+	const EGLint configWanted[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = 0;
+	EGLint configs = 0;
+	eglChooseConfig(display, configWanted, &config, 1, &configs);
+	const EGLint contextWanted[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE };
+	EGLContext context = eglCreateContext(display, configs ? config : 0, EGL_NO_CONTEXT,
+										  contextWanted);
+	if (context == EGL_NO_CONTEXT ||
+		!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		why = "no GL 4.3 compatibility context";
+		return false;
+	}
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+		why = "glad couldn't load GL";
+		return false;
+	}
+	printf("%s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+	GLuint fbo, buffers[2];
+	glGenFramebuffers(1, &fbo);
+	glGenRenderbuffers(2, buffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, buffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SIZE, SIZE);
+	glBindRenderbuffer(GL_RENDERBUFFER, buffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SIZE, SIZE);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, buffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, buffers[1]);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		why = "no framebuffer";
+		return false;
+	}
+	glViewport(0, 0, SIZE, SIZE);
+	glEnable(GL_DEPTH_TEST);
+	return true;
+}
+
+//
+// eight points round a loop, up and down, rolled one way then the other
+//
+static std::vector<ControlPoint> loop()
+{
+	std::vector<ControlPoint> points;
+	for (int i = 0; i < 8; ++i) {
+		float a = i * 6.2831853f / 8;
+		Pnt3f pos(60 * cosf(a), 10 + 12 * sinf(2 * a), 60 * sinf(a));
+		Pnt3f orient(0.4f * sinf(3 * a) * cosf(a), 1, 0.4f * sinf(3 * a) * sinf(a));
+		points.push_back(ControlPoint(pos, orient));
+	}
+	return points;
+}
+
+//
+// looking straight down, or from the side and a little above
+//
+static void look(int view)
+{
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	if (view == 0) {
+		glMatrixMode(GL_PROJECTION);
+		glOrtho(-80, 80, -80, 80, -200, 200);
+		glMatrixMode(GL_MODELVIEW);
+		glRotatef(90, 1, 0, 0);
+	}
+	else {
+		glMatrixMode(GL_PROJECTION);
+		glFrustum(-1, 1, -1, 1, 2, 500);
+		glMatrixMode(GL_MODELVIEW);
+		glTranslatef(0, -10, -170);
+		glRotatef(25, 1, 0, 0);
+		glRotatef(30, 0, 1, 0);
+	}
+}
+
+static void clear()
+{
+	glClearColor(0, 0, 0, 1);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+static Image grab()
+{
+	Image pixels(SIZE * SIZE * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, SIZE, SIZE, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+//
+// a tie, as TrainView::drawBar draws it
+//
+static void drawTie(const TrackFrame& tie)
+{
+	const float L = 7.5f / 2, H = 0.5f / 2, W = 1.0f / 2;
+	Pnt3f u = tie.dir;
+	Pnt3f w = u * tie.up;
+	w.normalize();
+	Pnt3f v = w * u;
+	v.normalize();
+	float rotation[16] = {
+		u.x, u.y, u.z, 0,
+		v.x, v.y, v.z, 0,
+		w.x, w.y, w.z, 0,
+		0, 0, 0, 1 };
+
+	glPushMatrix();
+	glTranslatef(tie.pos.x, tie.pos.y, tie.pos.z);
+	glMultMatrixf(rotation);
+	glRotatef(90, 0, 1, 0);
+	glTranslatef(0, -2 * H, 0);
+	glBegin(GL_QUADS);
+	const float box[6][4][3] = {
+		{ {-L,-H,-W}, {-L,-H, W}, { L,-H, W}, { L,-H,-W} },
+		{ {-L, H,-W}, {-L, H, W}, {-L,-H, W}, {-L,-H,-W} },
+		{ { L, H,-W}, { L, H, W}, { L,-H, W}, { L,-H,-W} },
+		{ {-L,-H,-W}, {-L, H,-W}, { L, H,-W}, { L,-H,-W} },
+		{ {-L,-H, W}, {-L, H, W}, { L, H, W}, { L,-H, W} },
+		{ {-L, H,-W}, {-L, H, W}, { L, H, W}, { L, H,-W} },
+	};
+	for (int f = 0; f < 6; ++f)
+		for (int k = 0; k < 4; ++k)
+			glVertex3fv(box[f][k]);
+	glEnd();
+	glPopMatrix();
+}
+
+//
+// the CPU picture: the rails as lines through the frames, the ties as boxes
+//
+static void drawCpu(const TrackCache& cache, bool rails)
+{
+	if (rails) {
+		glColor3ub(32, 32, 64);
+		glLineWidth(5);
+		for (size_t s = 0; s < cache.segmentCount(); ++s)
+			for (float side = -1; side <= 1; side += 2) {
+				glBegin(GL_LINE_STRIP);
+				for (const TrackFrame& f : cache.frames(s)) {
+					Pnt3f p = f.pos + f.cross * (side * RAIL_OFFSET);
+					glVertex3f(p.x, p.y, p.z);
+				}
+				glEnd();
+			}
+	}
+	else {
+		glColor3ub(255, 255, 255);
+		for (size_t s = 0; s < cache.segmentCount(); ++s)
+			for (const TrackFrame& tie : cache.ties(s))
+				drawTie(tie);
+	}
+}
+
+static bool drawn(const Image& image, int x, int y)
+{
+	const unsigned char* p = &image[(y * SIZE + x) * 3];
+	return p[0] || p[1] || p[2];
+}
+
+//
+// the pixels drawn in a but not in b
+//
+static size_t missing(const Image& a, const Image& b, size_t& lit)
+{
+	size_t n = 0;
+	lit = 0;
+	for (int y = 0; y < SIZE; ++y)
+		for (int x = 0; x < SIZE; ++x)
+			if (drawn(a, x, y)) {
+				++lit;
+				n += !drawn(b, x, y);
+			}
+	return n;
+}
+
+static void writePpm(const std::string& fname, const Image& image)
+{
+	FILE* fp = fopen(fname.c_str(), "wb");
+	if (!fp)
+		return;
+	fprintf(fp, "P6\n%d %d\n255\n", SIZE, SIZE);
+	// GL's rows go up the picture
+	for (int y = SIZE - 1; y >= 0; --y)
+		fwrite(&image[y * SIZE * 3], 1, SIZE * 3, fp);
+	fclose(fp);
+}
+
+int main(int argc, char** argv)
+{
+	const char* why = 0;
+	if (!makeContext(why)) {
+		printf("skipped: %s\n", why);
+		return SKIPPED;
+	}
+	GpuTrack gpu;
+	if (!gpu.init()) {
+		printf("skipped: the GPU track can't be drawn here\n");
+		return SKIPPED;
+	}
+	gpu.railTessLevel = (float)TrackCache::FRAMES_PER_SEGMENT;
+
+	std::vector<ControlPoint> points = loop();
+	const char* typeNames[] = { 0, "linear", "cardinal", "b-spline" };
+	const char* viewNames[] = { "above", "side" };
+	int failed = 0;
+	for (int type = 1; type <= 3; ++type) {
+		TrackCache cache;
+		cache.update(points, type, TIE_SPACING);
+		gpu.update(points, type, true, TIE_SPACING, DIVIDE_LINE);
+
+		for (int view = 0; view < 2; ++view)
+			for (int part = 0; part < 2; ++part) {
+				bool rails = part == 0;
+				look(view);
+				clear();
+				if (rails)
+					gpu.drawRails(false);
+				else
+					gpu.drawBars(false);
+				Image fromGpu = grab();
+				clear();
+				drawCpu(cache, rails);
+				Image fromCpu = grab();
+
+				size_t gpuLit, cpuLit;
+				size_t onlyGpu = missing(fromGpu, fromCpu, gpuLit);
+				size_t onlyCpu = missing(fromCpu, fromGpu, cpuLit);
+				size_t lit = (gpuLit > cpuLit) ? gpuLit : cpuLit;
+				bool ok = lit > 0 && glGetError() == GL_NO_ERROR &&
+					onlyGpu + onlyCpu <= MAX_DIFFERENT * lit;
+				printf("%s: %s, %s, from %s: %zu pixels drawn, %zu only by the GPU, "
+					   "%zu only by the CPU\n", ok ? "ok" : "FAIL", typeNames[type],
+					   rails ? "rails" : "ties", viewNames[view], lit, onlyGpu, onlyCpu);
+				failed += !ok;
+
+				if (argc > 1) {
+					std::string base = std::string(argv[1]) + "/" + typeNames[type] + "-" +
+						(rails ? "rails" : "ties") + "-" + viewNames[view];
+					writePpm(base + "-gpu.ppm", fromGpu);
+					writePpm(base + "-cpu.ppm", fromCpu);
+				}
+			}
+	}
+
+	// fewer than ten steps a segment, and no arc length: a tie every step
+	gpu.update(points, 2, false, TIE_SPACING, 5);
+	look(0);
+	clear();
+	gpu.drawBars(false);
+	size_t lit;
+	missing(grab(), Image(SIZE * SIZE * 3), lit);
+	bool ok = lit > 0 && glGetError() == GL_NO_ERROR;
+	printf("%s: ties with 5 steps a segment: %zu pixels drawn\n", ok ? "ok" : "FAIL", lit);
+	failed += !ok;
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+/************************************************************************
+     File:        PhysicsTest.cpp
+
+     Comment:     CoasterPhysics keeps the energy when nothing takes it
+
+						A train of carts of different masses goes round a
+						hilly loop for a minute with no friction and no
+						drag: kinetic plus potential energy has to stay
+						where it started (RK4 loses a little, but very
+						little). With friction and drag on it may only
+						ever go down.
+
+						Exits with 1 if either isn't so.
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "CoasterPhysics.H"
+#include "TrackProfile.H"
+
+// how far the energy may wander without friction, as a part of it
+static const double MAX_DRIFT = 1e-4;
+static const double DT = 1.0 / 120;
+static const int FRAMES = 60 * 120;
+
+//
+// a loop of 16 points with three hills on it
+//
+static std::vector<ControlPoint> hills()
+{
+	std::vector<ControlPoint> points;
+	for (int i = 0; i < 16; ++i) {
+		float a = i * 6.2831853f / 16;
+		points.push_back(ControlPoint(Pnt3f(80 * cosf(a), 20 + 15 * sinf(3 * a), 80 * sinf(a))));
+	}
+	return points;
+}
+
+//
+// a minute round the loop: the worst drift from the start, as a part of
+// the energy, and whether it ever went up from one frame to the next
+//
+static void ride(const TrackProfile& track, const CoasterPhysics& physics,
+				 double& drift, bool& rose)
+{
+	CoasterPhysics::Train train;
+	train.v = 30;
+	double e0 = physics.energy(track, train);
+	double last = e0;
+	drift = 0;
+	rose = false;
+	for (int f = 0; f < FRAMES; ++f) {
+		physics.step(track, train, DT);
+		double e = physics.energy(track, train);
+		drift = fmax(drift, fabs(e - e0) / e0);
+		rose = rose || e > last + 1e-9 * e0;
+		last = e;
+	}
+}
+
+int main()
+{
+	TrackProfile track;
+	if (!track.update(hills(), 2)) {
+		printf("FAIL: no track\n");
+		return 1;
+	}
+
+	CoasterPhysics physics;
+	std::vector<float> masses = { 1.5f, 1, 1, 1, 1, 0.8f };
+	physics.setCarts(masses, 2);
+	int failed = 0;
+
+	// nothing to take the energy
+	CoasterPhysics::Params params;
+	params.rollingFriction = 0;
+	params.drag = 0;
+	physics.setParams(params);
+	double drift;
+	bool rose;
+	ride(track, physics, drift, rose);
+	bool ok = drift < MAX_DRIFT;
+	printf("%s: no friction, no drag: energy within %.2g of where it started (at most %.2g)\n",
+		   ok ? "ok" : "FAIL", drift, MAX_DRIFT);
+	failed += !ok;
+
+	// friction and drag only ever take it
+	params.rollingFriction = 0.015f;
+	params.drag = 0.0002f;
+	physics.setParams(params);
+	ride(track, physics, drift, rose);
+	ok = !rose && drift > 0;
+	printf("%s: friction and drag: %.2g of the energy gone, %s\n",
+		   ok ? "ok" : "FAIL", drift, rose ? "but it went up on the way" : "never going up");
+	failed += !ok;
+
+	return failed ? 1 : 0;
+}
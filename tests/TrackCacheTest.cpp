@@ -0,0 +1,140 @@
+/************************************************************************
+     File:        TrackCacheTest.cpp
+
+     Comment:     A long track only has its tables for a window
+
+						A track of more segments than TrackCache::WINDOW
+						keeps frames for the window and none for the rest;
+						what it keeps is what sampleSegment gives for the
+						same segment. Moving the focus samples only the
+						segments that came into the window, and the ones
+						that stayed keep their slots. A moved point only
+						resamples its segments if they are in the window,
+						points added on the end keep the window as full as
+						it was, and a short track is in it all.
+
+						Exits with 1 if any of that isn't so.
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "TrackCache.H"
+
+static const size_t LONG = TrackCache::WINDOW * 3 + 17;
+static const float TIE_SPACING = 5;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+	printf("%s: %s\n", ok ? "ok" : "FAIL", what);
+	failures += !ok;
+}
+
+//
+// n points round a wavy circle
+//
+static std::vector<ControlPoint> circle(size_t n)
+{
+	std::vector<ControlPoint> points;
+	for (size_t i = 0; i < n; ++i) {
+		float a = i * 6.2831853f / n;
+		points.push_back(ControlPoint(Pnt3f(n * cosf(a), 10 + 5 * sinf(7.f * i), n * sinf(a))));
+	}
+	return points;
+}
+
+static bool same(const std::vector<TrackFrame>& a, const std::vector<TrackFrame>& b)
+{
+	return a.size() == b.size() &&
+		   (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(TrackFrame)) == 0);
+}
+
+// the segments in the window with frames, and the ones outside it without
+static bool windowFull(const TrackCache& cache)
+{
+	for (size_t s = 0; s < cache.segmentCount(); ++s)
+		if (cache.frames(s).empty() == cache.resident(s))
+			return false;
+	return true;
+}
+
+int main()
+{
+	std::vector<ControlPoint> points = circle(LONG);
+	TrackCache cache;
+	size_t built = cache.update(points, SPLINE_CARDINAL, TIE_SPACING);
+	check(built == TrackCache::WINDOW && cache.windowSize() == TrackCache::WINDOW &&
+		  cache.segmentCount() == LONG, "a long track samples a window of it");
+	check(windowFull(cache), "only the window has frames");
+
+	bool matches = true;
+	std::vector<TrackFrame> frames, ties;
+	for (size_t k = 0; k < cache.windowSize(); k += 97) {
+		size_t s = cache.windowSegment(k);
+		cache.sampleSegment(points, s, frames, ties);
+		matches = matches && same(frames, cache.frames(s)) && same(ties, cache.ties(s));
+	}
+	check(matches, "what is kept is what sampleSegment gives");
+
+	// well inside the window, it stays where it is
+	bool moves = cache.setFocus(cache.windowSegment(TrackCache::WINDOW / 2));
+	check(!moves && cache.update(points, SPLINE_CARDINAL, TIE_SPACING) == 0,
+		  "a focus inside the window doesn't move it");
+
+	// move it on by less than a window: what is in both keeps its slot
+	size_t stays = cache.windowSegment(TrackCache::WINDOW - 10);
+	size_t slotBefore = cache.slot(stays);
+	unsigned int revisionBefore = cache.segmentRevision(stays);
+	size_t oldStart = cache.windowStart();
+	check(cache.setFocus(cache.windowSegment(TrackCache::WINDOW - 200)),
+		  "a focus near the end moves the window");
+	built = cache.update(points, SPLINE_CARDINAL, TIE_SPACING);
+	size_t moved = (cache.windowStart() + LONG - oldStart) % LONG;
+	check(built == moved && cache.slot(stays) == slotBefore &&
+		  cache.segmentRevision(stays) == revisionBefore,
+		  "only the segments that came in are sampled");
+	check(windowFull(cache), "still only the window has frames");
+
+	// a point in the window, and one well outside it
+	size_t inside = cache.windowSegment(cache.windowSize() / 2);
+	cache.pointChanged(inside);
+	check(cache.update(points, SPLINE_CARDINAL, TIE_SPACING) == 4,
+		  "a point in the window resamples its 4 segments");
+	cache.pointChanged((cache.windowStart() + cache.windowSize() + 100) % LONG);
+	check(cache.update(points, SPLINE_CARDINAL, TIE_SPACING) == 0,
+		  "a point outside it resamples nothing");
+
+	// the train at the start, and points put on the end in chunks
+	std::vector<ControlPoint> more = circle(LONG + 2000);
+	std::vector<ControlPoint> growing(more.begin(), more.begin() + LONG);
+	cache.setFocus(0);
+	cache.invalidate();
+	cache.update(growing, SPLINE_CARDINAL, TIE_SPACING);
+	bool chunks = true;
+	for (size_t at = LONG; at < more.size(); at += 500) {
+		growing.insert(growing.end(), more.begin() + at, more.begin() + at + 500);
+		cache.pointsAdded(at);
+		cache.update(growing, SPLINE_CARDINAL, TIE_SPACING);
+		chunks = chunks && cache.windowSize() == TrackCache::WINDOW && windowFull(cache);
+	}
+	size_t last = cache.windowSegment(0);
+	cache.sampleSegment(growing, last, frames, ties);
+	check(chunks && same(frames, cache.frames(last)),
+		  "points added in chunks keep the window whole");
+
+	// a short track is all in it
+	std::vector<ControlPoint> few = circle(50);
+	TrackCache small;
+	small.update(few, SPLINE_BSPLINE, 0);
+	check(small.windowSize() == 50 && !small.setFocus(30) && windowFull(small),
+		  "a short track is all in the window");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+/************************************************************************
+     File:        TrackFileTest.cpp
+
+     Comment:     A track written and read back is the same to the bit
+
+						200000 points - numbers of every size, and the
+						awkward ones: -0, denormals, the smallest normal
+						float and the largest ones - are written as text
+						and as a binary track, read back, and compared
+						bit for bit. The text is written and read a second
+						time too, so nothing creeps on a save after a load.
+						How fast each was written and read is printed as
+						well, to keep an eye on.
+
+						Exits with 1 if any point comes back different.
+
+     Platform:    Visual Studio (CMake)
+
+*************************************************************************/
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string>
+
+#include "Track.H"
+
+static const size_t POINTS = 200000;
+
+static double msSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+// the points that aren't the same, bit for bit (all of them if there
+// aren't as many)
+static size_t differ(const CTrack& a, const CTrack& b)
+{
+	if (a.points.size() != b.points.size())
+		return a.points.size();
+	size_t n = 0;
+	for (size_t i = 0; i < a.points.size(); ++i)
+		n += memcmp(&a.points[i], &b.points[i], sizeof(ControlPoint)) != 0;
+	return n;
+}
+
+//
+// write from to fname, read it into to, and say how it went
+//
+static bool roundTrip(const CTrack& from, CTrack& to, const std::string& fname, const char* what)
+{
+	CTrack writer;
+	writer.points = from.points;
+	const char* error = 0;
+	auto start = std::chrono::steady_clock::now();
+	if (!writer.writePoints(fname.c_str(), &error)) {
+		printf("FAIL: %s: can't write %s (%s)\n", what, fname.c_str(), error ? error : "?");
+		return false;
+	}
+	double wrote = msSince(start);
+	start = std::chrono::steady_clock::now();
+	if (!to.readPoints(fname.c_str(), &error)) {
+		printf("FAIL: %s: can't read %s back (%s)\n", what, fname.c_str(), error ? error : "?");
+		return false;
+	}
+	double read = msSince(start);
+
+	std::error_code ec;
+	double mb = std::filesystem::file_size(fname, ec) / 1e6;
+	size_t bad = differ(from, to);
+	printf("%s: %s: %zu of %zu points differ (%.1f MB written in %.1f ms, %.0f MB/s; "
+		   "read in %.1f ms)\n", bad ? "FAIL" : "ok", what, bad, from.points.size(),
+		   mb, wrote, mb * 1000 / wrote, read);
+	return bad == 0;
+}
+
+int main()
+{
+	// random ones, from 1e-30 to 1e30 and either sign
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> unit(-1, 1);
+	std::uniform_int_distribution<int> exponent(-30, 30);
+	CTrack track;
+	track.points.clear();
+	for (size_t i = 0; i < POINTS; ++i) {
+		Pnt3f pos(unit(random) * powf(10, (float)exponent(random)), unit(random) * 300,
+				  unit(random) * 1e-3f);
+		Pnt3f orient(unit(random), unit(random), unit(random) + 2);
+		track.points.push_back(ControlPoint(pos, orient));
+	}
+
+	// and the awkward ones
+	const float awkward[] = {
+		-0.0f, 0.0f,
+		FLT_MIN, -FLT_MIN,							// the smallest normal
+		1e-40f, -1e-40f, 1.4e-45f, -1.4e-45f,		// denormals, down to the smallest
+		nextafterf(FLT_MIN, 0),						// the largest denormal
+		FLT_MAX, -FLT_MAX, nextafterf(FLT_MAX, 0),
+		1.0f / 3, 16777217.0f, 0.1f
+	};
+	size_t n = sizeof(awkward) / sizeof(awkward[0]);
+	for (size_t i = 0; i < n; ++i) {
+		ControlPoint& p = track.points[i];
+		p.pos.x = awkward[i];
+		p.pos.y = -awkward[i];
+		p.pos.z = awkward[(i + 1) % n];
+	}
+
+	std::error_code ec;
+	std::filesystem::path dir = std::filesystem::temp_directory_path(ec);
+	std::string base = (dir / "TrackFileTest").string();
+	int failed = 0;
+
+	CTrack text, binary, again;
+	failed += !roundTrip(track, text, base + ".txt", "text");
+	failed += !roundTrip(track, binary, base + ".trk", "binary");
+	failed += !roundTrip(text, again, base + "2.txt", "text, saved again after a load");
+
+	std::filesystem::remove(base + ".txt", ec);
+	std::filesystem::remove(base + ".trk", ec);
+	std::filesystem::remove(base + "2.txt", ec);
+	return failed ? 1 : 0;
+}